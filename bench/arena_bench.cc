@@ -0,0 +1,103 @@
+// Evaluates allocation-heavy statements with every term allocated on the heap, then with the terms of each statement
+// allocated from an arena, which is released at once after the statement.
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "ast.h"
+#include "context.h"
+#include "evaluator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "type-checker.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+const int kRounds = 5;
+
+const char* const kPrelude = R"(
+letrec gen:Nat->List[Nat] = lambda x:Nat. if iszero x then nil[Nat] else cons x (gen (pred x));
+letrec map:(Nat->Nat)->List[Nat]->List[Nat] =
+  lambda f:Nat->Nat l:List[Nat]. match l with nil -> nil[Nat] | cons h t -> cons (f h) (map f t);
+)";
+
+const char* const kStatements[] = {
+    "foldl (lambda acc:Nat x:Nat. succ acc) 0 (map (lambda x:Nat. succ x) (gen 2000));",
+    "foldl (lambda r:{n:Nat, l:List[Nat]} x:Nat. {r with n = succ r.n, l = cons x r.l}) {n: 0, l: nil[Nat]} "
+    "(gen 2000);",
+    "(letrec total:List[Nat]->Nat = lambda l:List[Nat]. match l with nil -> 0 | cons h t -> succ (total t) "
+    "in total (gen 2000));",
+};
+
+vector<unique_ptr<Term>> Parse(Context* ctx, const string& input) {
+  unique_ptr<Lexer> lexer(Lexer::Create(input));
+  Parser parser(lexer.get());
+  vector<unique_ptr<Term>> terms;
+  for (unique_ptr<Stmt>& stmt : parser.ParseAST(ctx)) {
+    terms.push_back(std::move(cast<EvalStmt>(stmt.get())->term()));
+  }
+  return terms;
+}
+
+double Run(Context* ctx, const vector<unique_ptr<Term>>& terms, bool arena, Arena::Stats* stats) {
+  TypeChecker type_checker(ctx);
+  TermEvaluator evaluator(ctx);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; ++round) {
+    for (const unique_ptr<Term>& term : terms) {
+      unique_ptr<Arena> statement_arena = arena ? std::make_unique<Arena>() : nullptr;
+      unique_ptr<TermType> type = type_checker.TypeCheck(term.get());
+      unique_ptr<Term> value = evaluator.Evaluate(term.get());
+      value.reset();
+      if (statement_arena != nullptr) {
+        stats->allocations += statement_arena->stats().allocations;
+        stats->reused += statement_arena->stats().reused;
+        stats->allocated += statement_arena->stats().allocated;
+        stats->reserved += statement_arena->stats().reserved;
+      }
+    }
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main() {
+  Context ctx;
+  TypeChecker type_checker(&ctx);
+  TermEvaluator evaluator(&ctx);
+
+  unique_ptr<Lexer> lexer(Lexer::Create(kPrelude));
+  Parser parser(lexer.get());
+  for (unique_ptr<Stmt>& stmt : parser.ParseAST(&ctx)) {
+    BindTermStmt* const term_stmt = cast<BindTermStmt>(stmt.get());
+    unique_ptr<TermType> type = type_checker.TypeCheck(term_stmt->term().get());
+    unique_ptr<Term> value = evaluator.Evaluate(term_stmt->term().get());
+    ctx.AddBinding(term_stmt->variable(), new Binding(value.release(), type.release()));
+  }
+
+  string input;
+  for (const char* statement : kStatements) {
+    input += statement;
+    input += '\n';
+  }
+  const vector<unique_ptr<Term>> terms = Parse(&ctx, input);
+
+  Arena::Stats stats;
+  const double heap_ms = Run(&ctx, terms, false, &stats);
+  const double arena_ms = Run(&ctx, terms, true, &stats);
+
+  printf("heap:  %.1f ms\n", heap_ms);
+  printf("arena: %.1f ms, %zu terms, %zu reused, %zu KiB allocated, %zu KiB reserved\n", arena_ms, stats.allocations,
+         stats.reused, stats.allocated / 1024, stats.reserved / 1024);
+  return 0;
+}
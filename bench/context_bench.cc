@@ -0,0 +1,66 @@
+// Parses a generated program of 10^5 top-level bindings x, x_1, x_2 ..., each one applying the one before it, then
+// prints every binding back in the context it is bound in. Every identifier is looked up by name while parsing, and
+// every lambda printed picks a fresh alias for its variable 'x', which is shadowed by all the bindings before it.
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "lexer.h"
+#include "parser.h"
+#include "pprinter.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+const int kBindings = 100000;
+
+string BindingName(int i) {
+  return i == 0 ? "x" : "x_" + std::to_string(i);
+}
+
+string CreateProgram(int bindings) {
+  string program = "let x = lambda x:Nat. x;\n";
+  for (int i = 1; i < bindings; ++i) {
+    program += "let " + BindingName(i) + " = lambda x:Nat. " + BindingName(i - 1) + " x;\n";
+  }
+  return program;
+}
+
+long long ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main() {
+  const string program = CreateProgram(kBindings);
+  Context ctx;
+
+  auto start = std::chrono::steady_clock::now();
+  unique_ptr<Lexer> lexer(Lexer::Create(program));
+  Parser parser(lexer.get());
+  vector<unique_ptr<Stmt>> stmts = parser.ParseAST(&ctx);
+  const long long parse_ms = ElapsedMs(start);
+
+  start = std::chrono::steady_clock::now();
+  PrettyPrinter pprinter(&ctx);
+  size_t printed = 0;
+  for (const unique_ptr<Stmt>& stmt : stmts) {
+    const BindTermStmt* const term_stmt = cast<BindTermStmt>(stmt.get());
+    printed += pprinter.PrettyPrint(term_stmt->term().get()).size();
+    ctx.AddName(term_stmt->variable());
+  }
+  const long long print_ms = ElapsedMs(start);
+
+  printf("parsed %zu bindings in %lld ms, printed them back (%zu bytes) in %lld ms\n", stmts.size(), parse_ms, printed,
+         print_ms);
+  return 0;
+}
@@ -0,0 +1,121 @@
+// Walks a list of 10^6 elements three ways:
+//  - from context with <isnil> and <tail>, rebinding the list to its tail after every step. With shared list cells
+//    each step takes constant time, the whole walk is linear in the length of the list;
+//  - in the language with <foldl>, counting the elements;
+//  - in the language with a letrec matching on the list, counting the elements. The evaluator recurses on the stack for
+//    every call, so the walk is split into lists of 10^3 elements.
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "evaluator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "pprinter.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+const int kLength = 1000000;
+const int kMatchLength = 1000;
+
+unique_ptr<Term> CreateList(int length) {
+  const Location location(size_t(0), size_t(0));
+  unique_ptr<Term> list = std::make_unique<NilTerm>(location, new NatTermType(location));
+  for (int i = 0; i < length; ++i) {
+    list = std::make_unique<BinaryTerm>(location, BinaryTermToken::Cons,
+                                        NullaryTerm::CreateInt(location, i % 8).release(), list.release());
+  }
+  return std::make_unique<SharedTerm>(location, std::shared_ptr<Term>(list.release()));
+}
+
+void BindList(Context* ctx, const string& name, int length) {
+  const Location location(size_t(0), size_t(0));
+  ctx->AddBinding(name, new Binding(CreateList(length).release(),
+                                    new ListTermType(location, new NatTermType(location))));
+}
+
+unique_ptr<Term> ParseTerm(Context* ctx, const string& input) {
+  unique_ptr<Lexer> lexer(Lexer::Create(input));
+  Parser parser(lexer.get());
+  vector<unique_ptr<Stmt>> stmts = parser.ParseAST(ctx);
+  assert(stmts.size() == 1);
+  return std::move(cast<EvalStmt>(stmts[0].get())->term());
+}
+
+// Returns the value of a term evaluated at top level, which is shared.
+const Term* Value(const unique_ptr<Term>& term) {
+  return cast<SharedTerm>(term.get())->value().get();
+}
+
+long long ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int WalkFromContext(Context* ctx) {
+  BindList(ctx, "l", kLength);
+  unique_ptr<Term> isnil = ParseTerm(ctx, "isnil l;");
+  unique_ptr<Term> tail = ParseTerm(ctx, "tail l;");
+  TermEvaluator evaluator(ctx);
+
+  int steps = 0;
+  while (true) {
+    unique_ptr<Term> empty = evaluator.Evaluate(isnil.get());
+    if (cast<NullaryTerm>(Value(empty))->type() == NullaryTermToken::True) {
+      break;
+    }
+
+    unique_ptr<Term> rest = evaluator.Evaluate(tail.get());
+    unique_ptr<TermType> type(ctx->get(0).second->type()->clone());
+    ctx->DropBindings(1);
+    ctx->AddBinding("l", new Binding(rest.release(), type.release()));
+    ++steps;
+  }
+  ctx->DropBindings(1);
+  return steps;
+}
+
+// Evaluates <term>, a Nat, and checks it is <expected>.
+void EvaluateCount(Context* ctx, const Term* term, int expected) {
+  unique_ptr<Term> count = TermEvaluator(ctx).Evaluate(term);
+  const string printed = PrettyPrinter(ctx).PrettyPrint(Value(count));
+  assert(printed == std::to_string(expected));
+  (void)printed;
+  (void)expected;
+}
+
+}  // namespace
+
+int main() {
+  Context ctx;
+
+  auto start = std::chrono::steady_clock::now();
+  const int steps = WalkFromContext(&ctx);
+  printf("walked %d cells from context with isnil/tail in %lld ms\n", steps, ElapsedMs(start));
+
+  BindList(&ctx, "l", kLength);
+  unique_ptr<Term> fold = ParseTerm(&ctx, "foldl (lambda n:Nat x:Nat. succ n) 0 l;");
+  start = std::chrono::steady_clock::now();
+  EvaluateCount(&ctx, fold.get(), kLength);
+  printf("walked %d cells with foldl in %lld ms\n", kLength, ElapsedMs(start));
+  ctx.DropBindings(1);
+
+  BindList(&ctx, "l", kMatchLength);
+  unique_ptr<Term> walk = ParseTerm(
+      &ctx, "letrec len:List[Nat]->Nat = lambda l:List[Nat]. match l with nil -> 0 | cons h t -> succ (len t) in len l;");
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kLength / kMatchLength; ++i) {
+    EvaluateCount(&ctx, walk.get(), kMatchLength);
+  }
+  printf("walked %d cells with match in %lld ms\n", kLength, ElapsedMs(start));
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "arena.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#endif
+
+namespace {
+
+// Addresses only, the range is committed from kMinCommitSize on, doubling up to kMaxCommitSize at a time.
+const size_t kRangeSize = size_t{64} << 30;
+const size_t kMinCommitSize = 64 * 1024;
+const size_t kMaxCommitSize = 16 * 1024 * 1024;
+const size_t kAlignment = alignof(std::max_align_t);
+
+thread_local Arena* arena_set_up = nullptr;
+thread_local int heap_scopes = 0;
+
+size_t align(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+}  // namespace
+
+Arena::Arena() : free_lists_(kMaxFreeSize / kAlignment, nullptr) {
+  assert(arena_set_up == nullptr && "arenas are not nested");
+  void* const range = mmap(nullptr, kRangeSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (range == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  begin_ = cursor_ = committed_ = static_cast<char*>(range);
+  arena_set_up = this;
+}
+
+Arena::~Arena() {
+  assert(arena_set_up == this);
+  arena_set_up = nullptr;
+  // Released terms are poisoned, see Release().
+  ASAN_UNPOISON_MEMORY_REGION(begin_, cursor_ - begin_);
+  munmap(begin_, kRangeSize);
+}
+
+Arena* Arena::current() {
+  return heap_scopes == 0 ? arena_set_up : nullptr;
+}
+
+bool Arena::Owns(const void* ptr) {
+  return arena_set_up != nullptr && arena_set_up->InRange(ptr);
+}
+
+void* Arena::Allocate(size_t size) {
+  size = align(size);
+  ++stats_.allocations;
+
+  if (size <= kMaxFreeSize && free_lists_[size / kAlignment - 1] != nullptr) {
+    FreeNode* const node = free_lists_[size / kAlignment - 1];
+    ASAN_UNPOISON_MEMORY_REGION(node, size);
+    free_lists_[size / kAlignment - 1] = node->next;
+    ++stats_.reused;
+    return node;
+  }
+  stats_.allocated += size;
+
+  if (static_cast<size_t>(committed_ - cursor_) < size) {
+    // Commits grow geometrically, so that there are only a few of them.
+    const size_t step = std::clamp(stats_.reserved, kMinCommitSize, kMaxCommitSize);
+    const size_t commit = std::max(step, (cursor_ + size - committed_ + step - 1) / step * step);
+    if (commit > kRangeSize - stats_.reserved || mprotect(committed_, commit, PROT_READ | PROT_WRITE) != 0) {
+      throw std::bad_alloc();
+    }
+    committed_ += commit;
+    stats_.reserved += commit;
+  }
+  char* const ptr = cursor_;
+  cursor_ += size;
+  return ptr;
+}
+
+void Arena::Release(void* ptr, size_t size) {
+  assert(Owns(ptr));
+  arena_set_up->Free(ptr, size);
+}
+
+void Arena::Free(void* ptr, size_t size) {
+  size = align(size);
+  // Larger terms are rare, they are left to the arena.
+  if (size > kMaxFreeSize) {
+    return;
+  }
+  FreeNode* const node = static_cast<FreeNode*>(ptr);
+  node->next = free_lists_[size / kAlignment - 1];
+  free_lists_[size / kAlignment - 1] = node;
+  // All but the link is poisoned, so that the sanitizer still catches uses of released terms.
+  ASAN_POISON_MEMORY_REGION(node + 1, size - sizeof(FreeNode));
+}
+
+Arena::HeapScope::HeapScope() {
+  ++heap_scopes;
+}
+
+Arena::HeapScope::~HeapScope() {
+  --heap_scopes;
+}
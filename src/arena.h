@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Bump-pointer allocator for the terms of a single statement. While an arena is set up, terms are allocated from it
+// (see Term::operator new), a released term is kept on a free list of its size class in the arena and reused by the
+// next term of the class, and the memory of all terms is released at once with the arena. Values that outlive the
+// statement are copied out of the arena first, see TermExtractor.
+//
+// At most one arena is set up at a time, every term allocated from it must be released before the arena is. The arena
+// reserves one range of addresses, so that Owns() is a single compare, and commits the range as it is bumped.
+class Arena final {
+ public:
+  struct Stats {
+    size_t allocations = 0;
+    size_t reused = 0;     // allocations taken from the free lists.
+    size_t allocated = 0;  // in bytes, including paddings, of the allocations bumped.
+    size_t reserved = 0;   // in bytes, of the range committed.
+  };
+
+  Arena();
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // The arena terms are allocated from, nullptr if there is none or inside of a HeapScope.
+  static Arena* current();
+  // Whether <ptr> is allocated from the arena set up, false if there is none.
+  static bool Owns(const void* ptr);
+
+  // Takes back <ptr> of <size> bytes, which the arena set up owns.
+  static void Release(void* ptr, size_t size);
+
+  void* Allocate(size_t size);
+  const Stats& stats() const { return stats_; }
+
+  // Terms are allocated on the heap while a HeapScope is alive, e.g. when they are copied out of the arena.
+  class HeapScope final {
+   public:
+    HeapScope();
+    ~HeapScope();
+
+    HeapScope(const HeapScope&) = delete;
+    HeapScope& operator=(const HeapScope&) = delete;
+  };
+
+ private:
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  static constexpr size_t kMaxFreeSize = 256;
+
+  bool InRange(const void* ptr) const { return begin_ <= ptr && ptr < cursor_; }
+  void Free(void* ptr, size_t size);
+
+  char* begin_ = nullptr;
+  // Free lists of the size classes up to kMaxFreeSize, by multiples of the alignment.
+  std::vector<FreeNode*> free_lists_;
+  char* cursor_ = nullptr;
+  char* committed_ = nullptr;  // the end of the range committed.
+  Stats stats_;
+};
@@ -1,11 +1,38 @@
 #include "ast.h"
 
 #include <memory>
+#include <utility>
+#include <vector>
 
+#include "arena.h"
+#include "hamt.h"
+#include "hash-cons.h"
+#include "node-pool.h"
 #include "type-helper.h"
 
 using std::unique_ptr;
 
+namespace {
+
+// Releases nested deeper than this are left to the outermost release, see Term::Release.
+const int kMaxReleaseDepth = 64;
+
+thread_local int release_depth = 0;
+thread_local std::vector<Term*>* pending_releases = nullptr;
+
+// Subterms left to copy by Term::clone(), along with the slots their copies go to.
+thread_local std::vector<std::pair<const Term*, unique_ptr<Term>*>> clone_stack;
+
+// Schedules the subterms of <term> to be copied into the slots of <copy>, a copy of the node alone.
+void schedule_copies(const Term* term, Term* copy) {
+  const size_t begin = clone_stack.size();
+  ForEachSubterm(term, [](const unique_ptr<Term>& subterm, int) { clone_stack.emplace_back(subterm.get(), nullptr); });
+  size_t i = begin;
+  ForEachSubterm(copy, [&i](unique_ptr<Term>& slot, int) { clone_stack[i++].second = &slot; });
+}
+
+}  // namespace
+
 #define TermTypeCompare(Type, Comparator) \
   bool Type::Compare(const Context* ctx, const TermType* rhs_old) const { \
     unique_ptr<TermType> simplified = SimplifyType(ctx, rhs_old); \
@@ -22,9 +49,128 @@ TermTypeCompare(BoolTermType, BoolTermTypeComparator);
 TermTypeCompare(NatTermType, NatTermTypeComparator);
 TermTypeCompare(UnitTermType, UnitTermTypeComparator);
 TermTypeCompare(ListTermType, ListTermTypeComparator);
+TermTypeCompare(ArrayTermType, ArrayTermTypeComparator);
+TermTypeCompare(RefTermType, RefTermTypeComparator);
+TermTypeCompare(MapTermType, MapTermTypeComparator);
 TermTypeCompare(RecordTermType, RecordTermTypeComparator);
+TermTypeCompare(VariantTermType, VariantTermTypeComparator);
 TermTypeCompare(ArrowTermType, ArrowTermTypeComparator);
 
+void TermType::Accept(Visitor<TermType>* visitor) const {
+  switch (kind_) {
+    case TermTypeKind::Bool: visitor->Visit(static_cast<const BoolTermType*>(this)); break;
+    case TermTypeKind::Nat: visitor->Visit(static_cast<const NatTermType*>(this)); break;
+    case TermTypeKind::Unit: visitor->Visit(static_cast<const UnitTermType*>(this)); break;
+    case TermTypeKind::List: visitor->Visit(static_cast<const ListTermType*>(this)); break;
+    case TermTypeKind::Array: visitor->Visit(static_cast<const ArrayTermType*>(this)); break;
+    case TermTypeKind::Ref: visitor->Visit(static_cast<const RefTermType*>(this)); break;
+    case TermTypeKind::Map: visitor->Visit(static_cast<const MapTermType*>(this)); break;
+    case TermTypeKind::Record: visitor->Visit(static_cast<const RecordTermType*>(this)); break;
+    case TermTypeKind::Variant: visitor->Visit(static_cast<const VariantTermType*>(this)); break;
+    case TermTypeKind::Arrow: visitor->Visit(static_cast<const ArrowTermType*>(this)); break;
+    case TermTypeKind::UserDefined: visitor->Visit(static_cast<const UserDefinedTermType*>(this)); break;
+  }
+}
+
+void Term::Accept(Visitor<Term>* visitor) const {
+  switch (kind_) {
+    case TermKind::Nullary: visitor->Visit(static_cast<const NullaryTerm*>(this)); break;
+    case TermKind::Nat: visitor->Visit(static_cast<const NatTerm*>(this)); break;
+    case TermKind::Unary: visitor->Visit(static_cast<const UnaryTerm*>(this)); break;
+    case TermKind::Binary: visitor->Visit(static_cast<const BinaryTerm*>(this)); break;
+    case TermKind::Ternary: visitor->Visit(static_cast<const TernaryTerm*>(this)); break;
+    case TermKind::Nil: visitor->Visit(static_cast<const NilTerm*>(this)); break;
+    case TermKind::Variable: visitor->Visit(static_cast<const VariableTerm*>(this)); break;
+    case TermKind::Record: visitor->Visit(static_cast<const RecordTerm*>(this)); break;
+    case TermKind::Project: visitor->Visit(static_cast<const ProjectTerm*>(this)); break;
+    case TermKind::RecordUpdate: visitor->Visit(static_cast<const RecordUpdateTerm*>(this)); break;
+    case TermKind::Let: visitor->Visit(static_cast<const LetTerm*>(this)); break;
+    case TermKind::Abs: visitor->Visit(static_cast<const AbsTerm*>(this)); break;
+    case TermKind::Ascribe: visitor->Visit(static_cast<const AscribeTerm*>(this)); break;
+    case TermKind::Variant: visitor->Visit(static_cast<const VariantTerm*>(this)); break;
+    case TermKind::Case: visitor->Visit(static_cast<const CaseTerm*>(this)); break;
+    case TermKind::Match: visitor->Visit(static_cast<const MatchTerm*>(this)); break;
+    case TermKind::LetRec: visitor->Visit(static_cast<const LetRecTerm*>(this)); break;
+    case TermKind::Shared: visitor->Visit(static_cast<const SharedTerm*>(this)); break;
+    case TermKind::PackedList: visitor->Visit(static_cast<const PackedListTerm*>(this)); break;
+    case TermKind::Array: visitor->Visit(static_cast<const ArrayTerm*>(this)); break;
+    case TermKind::Map: visitor->Visit(static_cast<const MapTerm*>(this)); break;
+    case TermKind::Ref: visitor->Visit(static_cast<const RefTerm*>(this)); break;
+  }
+}
+
+SharedTermType ShareType(TermType* type) {
+  return HashCons::Type(SharedTermType(type));
+}
+
+void* TermType::operator new(size_t size) {
+  return NodePool::Allocate(size);
+}
+
+void TermType::operator delete(void* ptr, size_t size) {
+  NodePool::Release(ptr, size);
+}
+
+void* Term::operator new(size_t size) {
+  Arena* const arena = Arena::current();
+  return arena != nullptr ? arena->Allocate(size) : NodePool::Allocate(size);
+}
+
+void Term::operator delete(void* ptr, size_t size) {
+  // Terms of the arena are released to the arena even inside of a HeapScope.
+  if (Arena::Owns(ptr)) {
+    Arena::Release(ptr, size);
+  } else {
+    NodePool::Release(ptr, size);
+  }
+}
+
+Term* Term::clone() const {
+  Term* const ret = CloneNode();
+  const size_t base = clone_stack.size();
+  schedule_copies(this, ret);
+  while (clone_stack.size() > base) {
+    const Term* const term = clone_stack.back().first;
+    unique_ptr<Term>* const slot = clone_stack.back().second;
+    clone_stack.pop_back();
+    if (term != nullptr) {
+      slot->reset(term->CloneNode());
+      schedule_copies(term, slot->get());
+    }
+  }
+  return ret;
+}
+
+void Term::Release(Term* term) {
+  if (release_depth >= kMaxReleaseDepth) {
+    pending_releases->push_back(term);
+    return;
+  }
+  if (release_depth > 0) {
+    ++release_depth;
+    delete term;
+    --release_depth;
+    return;
+  }
+
+  // The outermost release, it releases the terms left by nested ones until there is none.
+  std::vector<Term*> pending;
+  pending_releases = &pending;
+  ++release_depth;
+  delete term;
+  while (!pending.empty()) {
+    Term* const next = pending.back();
+    pending.pop_back();
+    delete next;
+  }
+  --release_depth;
+  pending_releases = nullptr;
+}
+
+int MapTerm::ast_level() const {
+  return hamt_->size() == 0 ? 5 : 2;
+}
+
 bool UserDefinedTermType::Compare(const Context* ctx, const TermType* rhs) const {
   unique_ptr<TermType> simplified = SimplifyType(ctx, this);
   assert(simplified != nullptr);
@@ -8,7 +8,10 @@
 // Statement = Term ';'
 //           | 'type' ucid '=' Type ';'
 //           | 'let' Pattern '=' Term ';'
-//           | 'letrec' TypedBinder '=' Term ';'
+//           | 'letrec' LetRecBindings ';'
+//
+// LetRecBindings = TypedBinder '=' Term
+//                | TypedBinder '=' Term 'and' LetRecBindings
 //
 // TypedBinders = TypedBinder
 //              | TypedBinder TypedBinders
@@ -23,7 +26,11 @@
 //      | 'lambda' TypedBinders '.' Term
 //      | 'if' Term 'then' Term 'else' Term
 //      | 'let' Pattern '=' Term 'in' Term
-//      | 'letrec' TypedBinder '=' Term 'in' Term
+//      | 'letrec' LetRecBindings 'in' Term
+//      | 'case' Term 'of' Cases
+//      | 'match' Term 'with' Arms
+//      | AppTerm '==' AppTerm
+//      | AppTerm ':=' Term
 //
 // AppTerm = PathTerm
 //         | 'succ' PathTerm
@@ -33,28 +40,74 @@
 //         | 'isnil' PathTerm
 //         | 'head' PathTerm
 //         | 'tail' PathTerm
+//         | 'sum' PathTerm
+//         | 'maximum' PathTerm
+//         | 'length' PathTerm
+//         | 'reverse' PathTerm
+//         | 'append' PathTerm PathTerm
+//         | 'nth' PathTerm PathTerm
+//         | 'range' PathTerm PathTerm
+//         | 'foldl' PathTerm PathTerm PathTerm
+//         | 'less' PathTerm PathTerm
+//         | 'array_make' PathTerm PathTerm
+//         | 'array_get' PathTerm PathTerm
+//         | 'array_set' PathTerm PathTerm PathTerm
+//         | 'array_length' PathTerm
+//         | 'array_of_list' PathTerm
+//         | 'list_of_array' PathTerm
+//         | 'map_insert' PathTerm PathTerm PathTerm
+//         | 'map_lookup' PathTerm PathTerm
+//         | 'map_size' PathTerm
+//         | 'ref' PathTerm
+//         | '!' PathTerm
 //         | AppTerm PathTerm
 //
+// The builtins from 'sum' to 'map_size', and 'map_empty', are lcids rather than keywords, so that bindings of the same
+// names shadow them.
+//
 // PathTerm = PathTerm '.' lcid
 //          | AscribeTerm
 //
 // AscribeTerm = AtomicTerm
 //             | AtomicTerm 'as' Type
 //
-// AtomicTerm = '(' Term ')'
+// AtomicTerm = '(' Sequence ')'
 //            | 'true'
 //            | 'false'
 //            | int
 //            | 'nil' '[' Type ']'
+//            | 'map_empty' '[' Type ',' Type ']'
 //            | 'unit'
 //            | '{' Fields '}'
+//            | '{' Term 'with' Updates '}'
+//            | '<' lcid ':' Term '>' 'as' Type
 //            | lcid
 //
+// Sequence = Term
+//          | Term ';' Sequence
+//
 // Fields = Field
 //        | Field ',' Fields
 //
 // Field = lcid '=' Term
 //
+// Updates = Update
+//         | Update ',' Updates
+//
+// Update = lcid '=' Term
+//
+// Cases = Case
+//       | Case '|' Cases
+//
+// Case = '<' lcid ':' Pattern '>' '->' Term
+//
+// Arms = Arm '|' Arm
+//
+// Arm = 'nil' '->' Term
+//     | 'cons' Pattern Pattern '->' Term
+//     | '0' '->' Term
+//     | 'succ' Pattern '->' Term
+//
 // Type = ArrowType
 //
 // ArrowType = AtomicType '->' ArrowType
@@ -64,20 +117,34 @@
 //            | 'Bool'
 //            | 'Nat'
 //            | 'List' '[' Type ']'
+//            | 'Array' '[' Type ']'
+//            | 'Ref' '[' Type ']'
+//            | 'Map' '[' Type ',' Type ']'
 //            | 'Unit'
 //            | '{' FieldTypes '}'
+//            | '<' TagTypes '>'
 //            | ucid
 //
 // FieldTypes = FieldType
 //            | FieldType ',' FieldTypes
 //
 // FieldType = lcid ':' Type
+//
+// TagTypes = TagType
+//          | TagType ',' TagTypes
+//
+// TagType = lcid ':' Type
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 #include "location.h"
+#include "symbol.h"
 #include "token.h"
 #include "visitor.h"
 
@@ -88,6 +155,15 @@ class TermType;
 
 class Context;
 class TermTypeComparator;
+struct PackedCells;
+class Hamt;
+
+// Types carried by terms (e.g. of 'nil' and lambdas) are never changed once parsed, so they are shared by all copies
+// of a term instead of being cloned with it.
+using SharedTermType = std::shared_ptr<const TermType>;
+
+// Takes <type> over as a SharedTermType, hash-consed if enabled, see HashCons.
+SharedTermType ShareType(TermType* type);
 
 // Pattern.
 class Pattern : public Locatable {
@@ -126,24 +202,82 @@ class TypedBinders : public Locatable {
   std::vector<std::pair<std::string, std::unique_ptr<TermType>>> binders_;
 };
 
+// Kind tags of nodes, so that the type of a node is told without dynamic_cast, see isa(), cast() and dyn_cast().
+// Every concrete node class names its tag as kKind.
+enum class TermTypeKind : uint8_t {
+  Bool, Nat, Unit, List, Array, Ref, Map, Record, Variant, Arrow, UserDefined,
+};
+
+enum class TermKind : uint8_t {
+  Nullary, Nat, Unary, Binary, Ternary, Nil, Variable, Record, Project, RecordUpdate, Let, Abs, Ascribe, Variant,
+  Case, Match, LetRec, Shared, PackedList, Array, Map, Ref,
+};
+
+enum class StmtKind : uint8_t {
+  Eval, BindTerm, BindType,
+};
+
+// Whether <node> is a T, <node> must not be nullptr.
+template<typename T, typename Node>
+bool isa(const Node* node) {
+  return node->kind() == T::kKind;
+}
+
+// <node> as a T, <node> must be a T.
+template<typename T, typename Node>
+T* cast(Node* node) {
+  assert(node != nullptr && isa<T>(node));
+  return static_cast<T*>(node);
+}
+
+template<typename T, typename Node>
+const T* cast(const Node* node) {
+  assert(node != nullptr && isa<T>(node));
+  return static_cast<const T*>(node);
+}
+
+// <node> as a T, or nullptr if it is not a T (or is nullptr itself), like dynamic_cast.
+template<typename T, typename Node>
+T* dyn_cast(Node* node) {
+  return node != nullptr && isa<T>(node) ? static_cast<T*>(node) : nullptr;
+}
+
+template<typename T, typename Node>
+const T* dyn_cast(const Node* node) {
+  return node != nullptr && isa<T>(node) ? static_cast<const T*>(node) : nullptr;
+}
+
 // TermType.
-class TermType : public Locatable, public virtual Visitable<TermType> {
+class TermType : public Locatable {
  public:
-  TermType(Location location) : Locatable(location) { }
+  TermType(Location location, TermTypeKind kind) : Locatable(location), kind_(kind) { }
   virtual ~TermType() = default;
   virtual TermType* clone() const = 0;
 
+  TermTypeKind kind() const { return kind_; }
+  // Dispatches on the kind tag of the type.
+  void Accept(Visitor<TermType>* visitor) const;
+
+  // TermTypes are allocated from NodePool.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
   // ast_level() denotes the level of this TermType node in AST.
   // Currently there are two levels, ArrowType(1) and AtomicType(2).
   virtual int ast_level() const = 0;
 
   virtual TermTypeComparator* CreateComparator(const Context* ctx) const = 0;
   virtual bool Compare(const Context* ctx, const TermType* rhs) const = 0;
+
+ private:
+  const TermTypeKind kind_;
 };
 
-class BoolTermType : public TermType, public VisitableImpl<TermType, BoolTermType> {
+class BoolTermType : public TermType {
  public:
-  BoolTermType(Location location) : TermType(location) { }
+  static constexpr TermTypeKind kKind = TermTypeKind::Bool;
+
+  BoolTermType(Location location) : TermType(location, kKind) { }
   TermType* clone() const override { return new BoolTermType(location_); }
 
   int ast_level() const override { return 2; }
@@ -151,9 +285,11 @@ class BoolTermType : public TermType, public VisitableImpl<TermType, BoolTermTyp
   bool Compare(const Context* ctx, const TermType* rhs) const override;
 };
 
-class NatTermType : public TermType, public VisitableImpl<TermType, NatTermType> {
+class NatTermType : public TermType {
  public:
-  NatTermType(Location location) : TermType(location) { }
+  static constexpr TermTypeKind kKind = TermTypeKind::Nat;
+
+  NatTermType(Location location) : TermType(location, kKind) { }
   TermType* clone() const override { return new NatTermType(location_); }
 
   int ast_level() const override { return 2; }
@@ -161,9 +297,11 @@ class NatTermType : public TermType, public VisitableImpl<TermType, NatTermType>
   bool Compare(const Context* ctx, const TermType* rhs) const override;
 };
 
-class UnitTermType : public TermType, public VisitableImpl<TermType, UnitTermType> {
+class UnitTermType : public TermType {
  public:
-  UnitTermType(Location location) : TermType(location) { }
+  static constexpr TermTypeKind kKind = TermTypeKind::Unit;
+
+  UnitTermType(Location location) : TermType(location, kKind) { }
   TermType* clone() const override { return new UnitTermType(location_); }
 
   int ast_level() const override { return 2; }
@@ -171,9 +309,11 @@ class UnitTermType : public TermType, public VisitableImpl<TermType, UnitTermTyp
   bool Compare(const Context* ctx, const TermType* rhs) const override;
 };
 
-class ListTermType : public TermType, public VisitableImpl<TermType, ListTermType> {
+class ListTermType : public TermType {
  public:
-  ListTermType(Location location, TermType* type) : TermType(location), type_(type) { }
+  static constexpr TermTypeKind kKind = TermTypeKind::List;
+
+  ListTermType(Location location, TermType* type) : TermType(location, kKind), type_(type) { }
   TermType* clone() const override { return new ListTermType(location_, type_->clone()); }
 
   int ast_level() const override { return 2; }
@@ -187,13 +327,73 @@ class ListTermType : public TermType, public VisitableImpl<TermType, ListTermTyp
   std::unique_ptr<TermType> type_;
 };
 
-class RecordTermType : public TermType, public VisitableImpl<TermType, RecordTermType> {
+class ArrayTermType : public TermType {
+ public:
+  static constexpr TermTypeKind kKind = TermTypeKind::Array;
+
+  ArrayTermType(Location location, TermType* type) : TermType(location, kKind), type_(type) { }
+  TermType* clone() const override { return new ArrayTermType(location_, type_->clone()); }
+
+  int ast_level() const override { return 2; }
+  TermTypeComparator* CreateComparator(const Context* ctx) const override;
+  bool Compare(const Context* ctx, const TermType* rhs) const override;
+
+  std::unique_ptr<TermType>& type() { return type_; }
+  const std::unique_ptr<TermType>& type() const { return type_; }
+
+ private:
+  std::unique_ptr<TermType> type_;
+};
+
+class RefTermType : public TermType {
+ public:
+  static constexpr TermTypeKind kKind = TermTypeKind::Ref;
+
+  RefTermType(Location location, TermType* type) : TermType(location, kKind), type_(type) { }
+  TermType* clone() const override { return new RefTermType(location_, type_->clone()); }
+
+  int ast_level() const override { return 2; }
+  TermTypeComparator* CreateComparator(const Context* ctx) const override;
+  bool Compare(const Context* ctx, const TermType* rhs) const override;
+
+  std::unique_ptr<TermType>& type() { return type_; }
+  const std::unique_ptr<TermType>& type() const { return type_; }
+
+ private:
+  std::unique_ptr<TermType> type_;
+};
+
+class MapTermType : public TermType {
+ public:
+  static constexpr TermTypeKind kKind = TermTypeKind::Map;
+
+  MapTermType(Location location, TermType* key_type, TermType* value_type)
+    : TermType(location, kKind), key_type_(key_type), value_type_(value_type) { }
+  TermType* clone() const override { return new MapTermType(location_, key_type_->clone(), value_type_->clone()); }
+
+  int ast_level() const override { return 2; }
+  TermTypeComparator* CreateComparator(const Context* ctx) const override;
+  bool Compare(const Context* ctx, const TermType* rhs) const override;
+
+  std::unique_ptr<TermType>& key_type() { return key_type_; }
+  const std::unique_ptr<TermType>& key_type() const { return key_type_; }
+  std::unique_ptr<TermType>& value_type() { return value_type_; }
+  const std::unique_ptr<TermType>& value_type() const { return value_type_; }
+
+ private:
+  std::unique_ptr<TermType> key_type_, value_type_;
+};
+
+class RecordTermType : public TermType {
  public:
-  RecordTermType(Location location) : TermType(location) { }
+  static constexpr TermTypeKind kKind = TermTypeKind::Record;
+
+  RecordTermType(Location location) : TermType(location, kKind) { }
   TermType* clone() const override {
     RecordTermType* ret = new RecordTermType(location_);
+    ret->fields_.reserve(fields_.size());
     for (size_t i = 0; i < fields_.size(); ++i) {
-      ret->add(fields_[i].first, fields_[i].second->clone());
+      ret->fields_.emplace_back(fields_[i].first, fields_[i].second->clone());
     }
     return ret;
   }
@@ -208,26 +408,88 @@ class RecordTermType : public TermType, public VisitableImpl<TermType, RecordTer
     }
   }
 
-  void add(const std::string& field, TermType* type) {
-    fields_.push_back(std::make_pair(field, std::unique_ptr<TermType>(type)));
+  // Fields are kept sorted by name, which is the layout of record values as well.
+  void add(Symbol field, TermType* type) {
+    auto iter = fields_.end();
+    while (iter != fields_.begin() && field < (iter - 1)->first) --iter;
+    fields_.emplace(iter, field, std::unique_ptr<TermType>(type));
+  }
+
+  // Index of <field>, or -1 if there is no such field.
+  int find(Symbol field) const {
+    auto iter = std::lower_bound(fields_.begin(), fields_.end(), field,
+                                 [](const auto& lhs, Symbol rhs) { return lhs.first < rhs; });
+    return iter != fields_.end() && iter->first == field ? iter - fields_.begin() : -1;
   }
 
   size_t size() const { return fields_.size(); }
-  std::pair<std::string, std::unique_ptr<TermType>&> get(int index) {
+  std::pair<Symbol, std::unique_ptr<TermType>&> get(int index) {
     return {fields_.at(index).first, fields_[index].second};
   }
-  std::pair<std::string, const std::unique_ptr<TermType>&> get(int index) const {
+  std::pair<Symbol, const std::unique_ptr<TermType>&> get(int index) const {
     return {fields_.at(index).first, fields_[index].second};
   }
 
  private:
-  std::vector<std::pair<std::string, std::unique_ptr<TermType>>> fields_;
+  std::vector<std::pair<Symbol, std::unique_ptr<TermType>>> fields_;
 };
 
-class ArrowTermType : public TermType, public VisitableImpl<TermType, ArrowTermType> {
+// Tags are kept sorted by name like fields of records, values of the variant are tagged with the index of their tag.
+class VariantTermType : public TermType {
  public:
+  static constexpr TermTypeKind kKind = TermTypeKind::Variant;
+
+  VariantTermType(Location location) : TermType(location, kKind) { }
+  TermType* clone() const override {
+    VariantTermType* ret = new VariantTermType(location_);
+    ret->tags_.reserve(tags_.size());
+    for (size_t i = 0; i < tags_.size(); ++i) {
+      ret->tags_.emplace_back(tags_[i].first, tags_[i].second->clone());
+    }
+    return ret;
+  }
+
+  int ast_level() const override { return 2; }
+  TermTypeComparator* CreateComparator(const Context* ctx) const override;
+  bool Compare(const Context* ctx, const TermType* rhs) const override;
+
+  void merge(VariantTermType&& type) {
+    for (size_t i = 0; i < type.size(); ++i) {
+      add(type.tags_[i].first, type.tags_[i].second.release());
+    }
+  }
+
+  void add(Symbol tag, TermType* type) {
+    auto iter = tags_.end();
+    while (iter != tags_.begin() && tag < (iter - 1)->first) --iter;
+    tags_.emplace(iter, tag, std::unique_ptr<TermType>(type));
+  }
+
+  // Index of <tag>, or -1 if there is no such tag.
+  int find(Symbol tag) const {
+    auto iter = std::lower_bound(tags_.begin(), tags_.end(), tag,
+                                 [](const auto& lhs, Symbol rhs) { return lhs.first < rhs; });
+    return iter != tags_.end() && iter->first == tag ? iter - tags_.begin() : -1;
+  }
+
+  size_t size() const { return tags_.size(); }
+  std::pair<Symbol, std::unique_ptr<TermType>&> get(int index) {
+    return {tags_.at(index).first, tags_[index].second};
+  }
+  std::pair<Symbol, const std::unique_ptr<TermType>&> get(int index) const {
+    return {tags_.at(index).first, tags_[index].second};
+  }
+
+ private:
+  std::vector<std::pair<Symbol, std::unique_ptr<TermType>>> tags_;
+};
+
+class ArrowTermType : public TermType {
+ public:
+  static constexpr TermTypeKind kKind = TermTypeKind::Arrow;
+
   ArrowTermType(Location location, TermType* type1, TermType* type2)
-    : TermType(location), type1_(type1), type2_(type2) { }
+    : TermType(location, kKind), type1_(type1), type2_(type2) { }
   TermType* clone() const override { return new ArrowTermType(location_, type1_->clone(), type2_->clone()); }
 
   int ast_level() const override { return 1; }
@@ -243,9 +505,11 @@ class ArrowTermType : public TermType, public VisitableImpl<TermType, ArrowTermT
   std::unique_ptr<TermType> type1_, type2_;
 };
 
-class UserDefinedTermType : public TermType, public VisitableImpl<TermType, UserDefinedTermType> {
+class UserDefinedTermType : public TermType {
  public:
-  UserDefinedTermType(Location location, int index) : TermType(location), index_(index) { }
+  static constexpr TermTypeKind kKind = TermTypeKind::UserDefined;
+
+  UserDefinedTermType(Location location, int index) : TermType(location, kKind), index_(index) { }
   TermType* clone() const override { return new UserDefinedTermType(location_, index_); }
 
   int ast_level() const override { return 2; }
@@ -259,15 +523,52 @@ class UserDefinedTermType : public TermType, public VisitableImpl<TermType, User
 };
 
 // Term.
-class Term : public Locatable, public virtual Visitable<Term> {
+class Term : public Locatable {
  public:
-  Term(Location location) : Locatable(location) { }
+  Term(Location location, TermKind kind) : Locatable(location), kind_(kind) { }
   virtual ~Term() = default;
-  virtual Term* clone() const = 0;
+  // Copies the term node by node with an explicit stack, so that deep terms do not overflow the stack.
+  Term* clone() const;
+
+  TermKind kind() const { return kind_; }
+  // Dispatches on the kind tag of the term.
+  void Accept(Visitor<Term>* visitor) const;
+
+  // Terms are allocated from the arena of the current statement if there is one, see Arena, and from NodePool
+  // otherwise.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
+  // Releases the term held by <term>. Terms release their subterms through it, and releases nested too deep are left
+  // to the outermost one, so that releasing a deep term does not overflow the stack either.
+  static void Release(std::unique_ptr<Term>& term) {
+    if (term == nullptr) {
+      return;
+    }
+    switch (term->kind()) {
+      // Releasing these never releases other terms.
+      case TermKind::Nullary: case TermKind::Nat: case TermKind::Nil: case TermKind::Variable:
+      case TermKind::PackedList: {
+        term.reset();
+      } break;
+      default: {
+        Release(term.release());
+      } break;
+    }
+  }
 
   // ast_level() denotes the level of this Term node in AST.
   // Currently there are five levels, Term(1), AppTerm(2), PathTerm(3), AscribeTerm(4) and AtomicTerm(5).
   virtual int ast_level() const = 0;
+
+ protected:
+  // Copies this node alone, its subterms are left null for clone() to fill in.
+  virtual Term* CloneNode() const = 0;
+
+ private:
+  static void Release(Term* term);
+
+  const TermKind kind_;
 };
 
 enum class NullaryTermToken {
@@ -275,15 +576,16 @@ enum class NullaryTermToken {
 };
 
 enum class UnaryTermToken {
-  Succ, Pred, IsZero, IsNil, Head, Tail, Fix,
+  Succ, Pred, IsZero, IsNil, Head, Tail, Fix, Sum, Maximum, Length, Reverse, ArrayLength, ArrayOfList, ListOfArray,
+  MapSize, Ref, Deref,
 };
 
 enum class BinaryTermToken {
-  Cons, App
+  Cons, App, Equal, Append, Nth, Range, Less, ArrayMake, ArrayGet, MapLookup, Assign, Seq,
 };
 
 enum class TernaryTermToken {
-  If,
+  If, Foldl, ArraySet, MapInsert,
 };
 
 // As it is verbose to write down all n-ary terms that take n terms, a better approach is to do some abstraction,
@@ -292,8 +594,13 @@ enum class TernaryTermToken {
 template<int N, typename TermToken>
 class NAryTerm : public Term {
  public:
-  NAryTerm(Location location, TermToken type)
-    : Term(location), type_(type) { }
+  NAryTerm(Location location, TermKind kind, TermToken type)
+    : Term(location, kind), type_(type) { }
+  ~NAryTerm() override {
+    for (std::unique_ptr<Term>& term : terms_) {
+      Release(term);
+    }
+  }
 
   TermToken type() const { return type_; }
 
@@ -302,72 +609,118 @@ class NAryTerm : public Term {
   std::array<std::unique_ptr<Term>, N> terms_;
 };
 
-class UnaryTerm : public NAryTerm<1, UnaryTermToken>, public VisitableImpl<Term, UnaryTerm> {
+// NatTerm stands for 'succ' applied <value> times on zero, stored as a machine integer.
+class NatTerm : public Term {
  public:
-  UnaryTerm(Location location, UnaryTermToken type, Term* term1)
-    : NAryTerm(location, type) {
+  static constexpr TermKind kKind = TermKind::Nat;
+
+  NatTerm(Location location, uint64_t value)
+    : Term(location, kKind), value_(value) { }
+  Term* CloneNode() const override { return new NatTerm(location_, value_); }
+
+  // Same as its equivalent 'succ' chain.
+  int ast_level() const override { return value_ == 0 ? 5 : 2; }
+
+  uint64_t value() const { return value_; }
+  void set_value(uint64_t value) { value_ = value; }
+
+ private:
+  uint64_t value_;
+};
+
+class UnaryTerm : public NAryTerm<1, UnaryTermToken> {
+ public:
+  static constexpr TermKind kKind = TermKind::Unary;
+
+  UnaryTerm(Location location, UnaryTermToken type, Term* term1, SharedTermType value_type = nullptr)
+    : NAryTerm(location, kKind, type), value_type_(std::move(value_type)) {
     terms_[0].reset(term1);
   }
-  virtual Term* clone() const override { return new UnaryTerm(location_, type_, terms_[0]->clone()); }
+  Term* CloneNode() const override { return new UnaryTerm(location_, type_, nullptr, value_type_); }
 
   int ast_level() const override { return 2; }
 
   std::unique_ptr<Term>& term() { return terms_[0]; }
   const std::unique_ptr<Term>& term() const { return terms_[0]; }
+
+  // Type of the value stored by 'ref', set by the type checker with aliases expanded, so that it holds wherever the
+  // term is copied to. nullptr before that and for other builtins.
+  const SharedTermType& value_type() const { return value_type_; }
+  void set_value_type(SharedTermType value_type) const { value_type_ = std::move(value_type); }
+
+ private:
+  mutable SharedTermType value_type_;
 };
 
-class NullaryTerm : public NAryTerm<0, NullaryTermToken>, public VisitableImpl<Term, NullaryTerm> {
+class NullaryTerm : public NAryTerm<0, NullaryTermToken> {
  public:
+  static constexpr TermKind kKind = TermKind::Nullary;
+
   NullaryTerm(Location location, NullaryTermToken type)
-    : NAryTerm(location, type) { }
-  virtual Term* clone() const override { return new NullaryTerm(location_, type_); }
+    : NAryTerm(location, kKind, type) { }
+  Term* CloneNode() const override { return new NullaryTerm(location_, type_); }
 
   static std::unique_ptr<Term> CreateInt(Location location, int n) {
     if (n < 0) {
       return nullptr;
     }
-    std::unique_ptr<Term> term = std::make_unique<NullaryTerm>(location, NullaryTermToken::Zero);
-    for (int i = 0; i < n; ++i) {
-      term.reset(new UnaryTerm(location, UnaryTermToken::Succ, term.release()));
-    }
-    return term;
+    return std::make_unique<NatTerm>(location, n);
   }
 
   int ast_level() const override { return 5; }
 };
 
-class BinaryTerm : public NAryTerm<2, BinaryTermToken>, public VisitableImpl<Term, BinaryTerm> {
+class BinaryTerm : public NAryTerm<2, BinaryTermToken> {
  public:
-  BinaryTerm(Location location, BinaryTermToken type, Term* term1, Term* term2)
-    : NAryTerm(location, type) {
+  static constexpr TermKind kKind = TermKind::Binary;
+
+  BinaryTerm(Location location, BinaryTermToken type, Term* term1, Term* term2, SharedTermType element_type = nullptr)
+    : NAryTerm(location, kKind, type), element_type_(std::move(element_type)) {
     terms_[0].reset(term1);
     terms_[1].reset(term2);
   }
-  virtual Term* clone() const override {
-    return new BinaryTerm(location_, type_, terms_[0]->clone(), terms_[1]->clone());
-  }
+  Term* CloneNode() const override { return new BinaryTerm(location_, type_, nullptr, nullptr, element_type_); }
 
-  int ast_level() const override { return 2; }
+  int ast_level() const override {
+    switch (type_) {
+      case BinaryTermToken::Equal: case BinaryTermToken::Assign: return 1;
+      case BinaryTermToken::Seq: return 5;  // Always printed in parentheses.
+      default: return 2;
+    }
+  }
 
   std::unique_ptr<Term>& term1() { return terms_[0]; }
   const std::unique_ptr<Term>& term1() const { return terms_[0]; }
   std::unique_ptr<Term>& term2() { return terms_[1]; }
   const std::unique_ptr<Term>& term2() const { return terms_[1]; }
+
+  // Structural hash of the list starting at this cons cell, cached by HashValue(), 0 if not computed yet.
+  uint64_t cached_hash() const { return cached_hash_; }
+  void set_cached_hash(uint64_t hash) const { cached_hash_ = hash; }
+
+  // Type of the elements of 'array_make', set by the type checker with aliases expanded, see UnaryTerm::value_type().
+  const SharedTermType& element_type() const { return element_type_; }
+  void set_element_type(SharedTermType element_type) const { element_type_ = std::move(element_type); }
+
+ private:
+  mutable SharedTermType element_type_;
+  mutable uint64_t cached_hash_ = 0;
 };
 
-class TernaryTerm : public NAryTerm<3, TernaryTermToken>, public VisitableImpl<Term, TernaryTerm> {
+class TernaryTerm : public NAryTerm<3, TernaryTermToken> {
  public:
-  TernaryTerm(Location location, TernaryTermToken type, Term* term1, Term* term2, Term* term3)
-    : NAryTerm(location, type) {
+  static constexpr TermKind kKind = TermKind::Ternary;
+
+  TernaryTerm(Location location, TernaryTermToken type, Term* term1, Term* term2, Term* term3,
+              SharedTermType map_type = nullptr)
+    : NAryTerm(location, kKind, type), map_type_(std::move(map_type)) {
     terms_[0].reset(term1);
     terms_[1].reset(term2);
     terms_[2].reset(term3);
   }
-  virtual Term* clone() const override {
-    return new TernaryTerm(location_, type_, terms_[0]->clone(), terms_[1]->clone(), terms_[2]->clone());
-  }
+  Term* CloneNode() const override { return new TernaryTerm(location_, type_, nullptr, nullptr, nullptr, map_type_); }
 
-  int ast_level() const override { return 1; }
+  int ast_level() const override { return type_ == TernaryTermToken::If ? 1 : 2; }
 
   std::unique_ptr<Term>& term1() { return terms_[0]; }
   const std::unique_ptr<Term>& term1() const { return terms_[0]; }
@@ -375,28 +728,40 @@ class TernaryTerm : public NAryTerm<3, TernaryTermToken>, public VisitableImpl<T
   const std::unique_ptr<Term>& term2() const { return terms_[1]; }
   std::unique_ptr<Term>& term3() { return terms_[2]; }
   const std::unique_ptr<Term>& term3() const { return terms_[2]; }
+
+  // Type of the map of 'map_insert', set by the type checker with aliases expanded, so that it holds wherever the term
+  // is copied to. nullptr before that and for other builtins.
+  const SharedTermType& map_type() const { return map_type_; }
+  void set_map_type(SharedTermType map_type) const { map_type_ = std::move(map_type); }
+
+ private:
+  mutable SharedTermType map_type_;
 };
 
-class NilTerm : public Term, public VisitableImpl<Term, NilTerm> {
+class NilTerm : public Term {
  public:
-  NilTerm(Location location, TermType* list_type)
-    : Term(location), list_type_(list_type) { }
-  virtual Term* clone() const override { return new NilTerm(location_, list_type_->clone()); }
+  static constexpr TermKind kKind = TermKind::Nil;
+
+  NilTerm(Location location, SharedTermType list_type)
+    : Term(location, kKind), list_type_(std::move(list_type)) { }
+  NilTerm(Location location, TermType* list_type) : NilTerm(location, ShareType(list_type)) { }
+  Term* CloneNode() const override { return new NilTerm(location_, list_type_); }
 
   int ast_level() const override { return 5; }
 
-  std::unique_ptr<TermType>& list_type() { return list_type_; }
-  const std::unique_ptr<TermType>& list_type() const { return list_type_; }
+  const SharedTermType& list_type() const { return list_type_; }
 
  private:
-  std::unique_ptr<TermType> list_type_;
+  const SharedTermType list_type_;
 };
 
-class VariableTerm : public Term, public VisitableImpl<Term, VariableTerm> {
+class VariableTerm : public Term {
  public:
+  static constexpr TermKind kKind = TermKind::Variable;
+
   VariableTerm(Location location, int index)
-    : Term(location), index_(index) { }
-  virtual Term* clone() const override { return new VariableTerm(location_, index_); }
+    : Term(location, kKind), index_(index) { }
+  Term* CloneNode() const override { return new VariableTerm(location_, index_); }
 
   int ast_level() const override { return 5; }
 
@@ -406,13 +771,17 @@ class VariableTerm : public Term, public VisitableImpl<Term, VariableTerm> {
   int index_;
 };
 
-class RecordTerm : public Term, public VisitableImpl<Term, RecordTerm> {
+class RecordTerm : public Term {
  public:
-  RecordTerm(Location location) : Term(location) { }
-  virtual Term* clone() const override {
+  static constexpr TermKind kKind = TermKind::Record;
+
+  RecordTerm(Location location) : Term(location, kKind) { }
+  ~RecordTerm() override { clear(); }
+  Term* CloneNode() const override {
     RecordTerm* ret = new RecordTerm(location_);
+    ret->fields_.reserve(fields_.size());
     for (size_t i = 0; i < fields_.size(); ++i) {
-      ret->add(fields_[i].first, fields_[i].second->clone());
+      ret->fields_.emplace_back(fields_[i].first, nullptr);
     }
     return ret;
   }
@@ -425,86 +794,162 @@ class RecordTerm : public Term, public VisitableImpl<Term, RecordTerm> {
     }
   }
 
-  void add(const std::string& field, Term* term) {
-    fields_.push_back(std::make_pair(field, std::unique_ptr<Term>(term)));
+  // Fields are kept sorted by name, so that records of the same type share one layout, see ProjectTerm::slot().
+  // Fields mostly come in order (e.g. from another record), and are then appended in O(1).
+  void add(Symbol field, Term* term) {
+    auto iter = fields_.end();
+    while (iter != fields_.begin() && field < (iter - 1)->first) --iter;
+    fields_.emplace(iter, field, std::unique_ptr<Term>(term));
+  }
+
+  void clear() {
+    for (auto& field : fields_) {
+      Release(field.second);
+    }
+    fields_.clear();
   }
 
   size_t size() const { return fields_.size(); }
-  std::pair<std::string, std::unique_ptr<Term>&> get(int index) {
+  std::pair<Symbol, std::unique_ptr<Term>&> get(int index) {
     return {fields_.at(index).first, fields_.at(index).second};
   }
-  std::pair<std::string, const std::unique_ptr<Term>&> get(int index) const {
+  std::pair<Symbol, const std::unique_ptr<Term>&> get(int index) const {
     return {fields_.at(index).first, fields_.at(index).second};
   }
  private:
-  std::vector<std::pair<std::string, std::unique_ptr<Term>>> fields_;
+  std::vector<std::pair<Symbol, std::unique_ptr<Term>>> fields_;
 };
 
-class ProjectTerm : public Term, public VisitableImpl<Term, ProjectTerm> {
+class ProjectTerm : public Term {
  public:
-  ProjectTerm(Location location, Term* term, const std::string& field)
-    : Term(location), term_(term), field_(field) { }
-  virtual Term* clone() const override { return new ProjectTerm(location_, term_->clone(), field_); }
+  static constexpr TermKind kKind = TermKind::Project;
+
+  ProjectTerm(Location location, Term* term, Symbol field, int slot = -1)
+    : Term(location, kKind), term_(term), field_(field), slot_(slot) { }
+  ~ProjectTerm() override { Release(term_); }
+  Term* CloneNode() const override { return new ProjectTerm(location_, nullptr, field_, slot_); }
 
   int ast_level() const override { return 3; }
 
   std::unique_ptr<Term>& term() { return term_; }
   const std::unique_ptr<Term>& term() const { return term_; }
-  const std::string& field() const { return field_; }
+  Symbol field() const { return field_; }
+
+  // Index of <field> in the sorted fields of the record, resolved by the type checker, -1 before that.
+  int slot() const { return slot_; }
+  void set_slot(int slot) const { slot_ = slot; }
+
+ private:
+  std::unique_ptr<Term> term_;
+  Symbol field_;
+  mutable int slot_;
+};
+
+// '{t with f_1 = t_1, ..., f_n = t_n}' is the record <t> with fields f_i replaced by t_i. The fields left unchanged are
+// moved or shared from the original record rather than copied.
+class RecordUpdateTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::RecordUpdate;
+
+  struct Update {
+    Symbol field;
+    std::unique_ptr<Term> term;
+    mutable int slot;
+  };
+
+  RecordUpdateTerm(Location location, Term* term) : Term(location, kKind), term_(term) { }
+  ~RecordUpdateTerm() override {
+    Release(term_);
+    for (Update& update : updates_) {
+      Release(update.term);
+    }
+  }
+  Term* CloneNode() const override {
+    RecordUpdateTerm* ret = new RecordUpdateTerm(location_, nullptr);
+    ret->updates_.reserve(updates_.size());
+    for (const Update& update : updates_) {
+      ret->add(update.field, nullptr, update.slot);
+    }
+    return ret;
+  }
+
+  int ast_level() const override { return 5; }
+
+  void add(Symbol field, Term* term, int slot = -1) {
+    updates_.push_back({field, std::unique_ptr<Term>(term), slot});
+  }
+
+  std::unique_ptr<Term>& term() { return term_; }
+  const std::unique_ptr<Term>& term() const { return term_; }
+  size_t size() const { return updates_.size(); }
+  Update& get(int index) { return updates_.at(index); }
+  const Update& get(int index) const { return updates_.at(index); }
+
+  // Index of the updated field in the sorted fields of the record, resolved by the type checker, -1 before that.
+  void set_slot(int index, int slot) const { updates_.at(index).slot = slot; }
 
  private:
   std::unique_ptr<Term> term_;
-  std::string field_;
+  std::vector<Update> updates_;
 };
 
-class LetTerm : public Term, public VisitableImpl<Term, LetTerm> {
+class LetTerm : public Term {
  public:
-  LetTerm(Location location, const std::string& variable, Term* bind_term, Term* body_term)
-    : Term(location), variable_(variable), term1_(bind_term), term2_(body_term) { }
-  virtual Term* clone() const override { return new LetTerm(location_, variable_, term1_->clone(), term2_->clone()); }
+  static constexpr TermKind kKind = TermKind::Let;
+
+  LetTerm(Location location, Symbol variable, Term* bind_term, Term* body_term)
+    : Term(location, kKind), variable_(variable), term1_(bind_term), term2_(body_term) { }
+  ~LetTerm() override {
+    Release(term1_);
+    Release(term2_);
+  }
+  Term* CloneNode() const override { return new LetTerm(location_, variable_, nullptr, nullptr); }
 
   int ast_level() const override { return 1; }
 
-  const std::string& variable() const { return variable_; }
+  Symbol variable() const { return variable_; }
   std::unique_ptr<Term>& bind_term() { return term1_; }
   const std::unique_ptr<Term>& bind_term() const { return term1_; }
   std::unique_ptr<Term>& body_term() { return term2_; }
   const std::unique_ptr<Term>& body_term() const { return term2_; }
 
  private:
-  const std::string variable_;
+  const Symbol variable_;
   std::unique_ptr<Term> term1_, term2_;
 };
 
-class AbsTerm : public Term, public VisitableImpl<Term, AbsTerm> {
+class AbsTerm : public Term {
  public:
-  AbsTerm(Location location, const std::string& variable, TermType* type, Term* term)
-    : Term(location), variable_(variable), variable_type_(type), term_(term) { }
-  virtual Term* clone() const override {
-    return new AbsTerm(location_, variable_, variable_type_->clone(), term_->clone());
-  }
+  static constexpr TermKind kKind = TermKind::Abs;
+
+  AbsTerm(Location location, Symbol variable, SharedTermType type, Term* term)
+    : Term(location, kKind), variable_(variable), variable_type_(std::move(type)), term_(term) { }
+  AbsTerm(Location location, Symbol variable, TermType* type, Term* term)
+    : AbsTerm(location, variable, ShareType(type), term) { }
+  ~AbsTerm() override { Release(term_); }
+  Term* CloneNode() const override { return new AbsTerm(location_, variable_, variable_type_, nullptr); }
 
   int ast_level() const override { return 1; }
 
-  const std::string& variable() const { return variable_; }
-  std::unique_ptr<TermType>& variable_type() { return variable_type_; }
-  const std::unique_ptr<TermType>& variable_type() const { return variable_type_; }
+  Symbol variable() const { return variable_; }
+  const SharedTermType& variable_type() const { return variable_type_; }
   std::unique_ptr<Term>& term() { return term_; }
   const std::unique_ptr<Term>& term() const { return term_; }
 
  private:
-  const std::string variable_;
-  std::unique_ptr<TermType> variable_type_;
+  const Symbol variable_;
+  const SharedTermType variable_type_;
   std::unique_ptr<Term> term_;
 };
 
-class AscribeTerm : public Term, public VisitableImpl<Term, AscribeTerm> {
+class AscribeTerm : public Term {
  public:
+  static constexpr TermKind kKind = TermKind::Ascribe;
+
   AscribeTerm(Location location, Term* term, TermType* type)
-    : Term(location), term_(term), ascribe_type_(type) { }
-  virtual Term* clone() const override {
-    return new AscribeTerm(location_, term_->clone(), ascribe_type_->clone());
-  }
+    : Term(location, kKind), term_(term), ascribe_type_(type) { }
+  ~AscribeTerm() override { Release(term_); }
+  Term* CloneNode() const override { return new AscribeTerm(location_, nullptr, ascribe_type_->clone()); }
 
   int ast_level() const override { return 4; }
 
@@ -518,17 +963,401 @@ class AscribeTerm : public Term, public VisitableImpl<Term, AscribeTerm> {
   std::unique_ptr<TermType> ascribe_type_;
 };
 
+// '<tag: term> as type', <variant_type> is kept for printing values.
+class VariantTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::Variant;
+
+  VariantTerm(Location location, Symbol tag, Term* term, SharedTermType type, int index = -1)
+    : Term(location, kKind), tag_(tag), term_(term), variant_type_(std::move(type)), index_(index) { }
+  VariantTerm(Location location, Symbol tag, Term* term, TermType* type)
+    : VariantTerm(location, tag, term, ShareType(type)) { }
+  ~VariantTerm() override { Release(term_); }
+  Term* CloneNode() const override { return new VariantTerm(location_, tag_, nullptr, variant_type_, index_); }
+
+  int ast_level() const override { return 4; }
+
+  Symbol tag() const { return tag_; }
+  std::unique_ptr<Term>& term() { return term_; }
+  const std::unique_ptr<Term>& term() const { return term_; }
+  const SharedTermType& variant_type() const { return variant_type_; }
+
+  // Index of <tag> in the sorted tags of the variant type, resolved by the type checker, -1 before that. It is the
+  // tag the evaluator dispatches on.
+  int index() const { return index_; }
+  void set_index(int index) const { index_ = index; }
+
+ private:
+  const Symbol tag_;
+  std::unique_ptr<Term> term_;
+  const SharedTermType variant_type_;
+  mutable int index_;
+};
+
+// 'case term of <tag_1: x_1> -> t_1 | <tag_2: x_2> -> t_2 ...'. Branches are kept sorted by tag, and the type checker
+// makes sure they are exactly the tags of the variant type, so the i-th branch handles the tag of index i, i.e. the
+// branches are the jump table.
+class CaseTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::Case;
+
+  struct Branch {
+    Symbol tag;
+    Symbol variable;
+    std::unique_ptr<Term> body;
+  };
+
+  CaseTerm(Location location, Term* term) : Term(location, kKind), term_(term) { }
+  ~CaseTerm() override {
+    Release(term_);
+    for (Branch& branch : branches_) {
+      Release(branch.body);
+    }
+  }
+  Term* CloneNode() const override {
+    CaseTerm* ret = new CaseTerm(location_, nullptr);
+    ret->branches_.reserve(branches_.size());
+    for (size_t i = 0; i < branches_.size(); ++i) {
+      ret->add(branches_[i].tag, branches_[i].variable, nullptr);
+    }
+    return ret;
+  }
+
+  int ast_level() const override { return 1; }
+
+  std::unique_ptr<Term>& term() { return term_; }
+  const std::unique_ptr<Term>& term() const { return term_; }
+
+  void add(Symbol tag, Symbol variable, Term* body) {
+    auto iter = branches_.end();
+    while (iter != branches_.begin() && tag < (iter - 1)->tag) --iter;
+    branches_.insert(iter, Branch{tag, variable, std::unique_ptr<Term>(body)});
+  }
+
+  size_t size() const { return branches_.size(); }
+  Branch& get(int index) { return branches_.at(index); }
+  const Branch& get(int index) const { return branches_.at(index); }
+
+ private:
+  std::unique_ptr<Term> term_;
+  std::vector<Branch> branches_;
+};
+
+enum class MatchTermToken {
+  List, Nat,
+};
+
+// 'match t with nil -> t_1 | cons h t -> t_2' on lists, or 'match t with 0 -> t_1 | succ n -> t_2' on Nats. The value
+// is inspected once, and the cell arm binds the fields of the cell directly. Its <variables> are bound in order, i.e.
+// in the cons arm <t> has deBruijn index 0 and <h> has 1.
+class MatchTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::Match;
+
+  MatchTerm(Location location, MatchTermToken type, Term* term, Term* empty_arm, std::vector<Symbol> variables,
+            Term* cell_arm)
+    : Term(location, kKind), type_(type), term_(term), empty_arm_(empty_arm), variables_(std::move(variables)),
+      cell_arm_(cell_arm) { }
+  ~MatchTerm() override {
+    Release(term_);
+    Release(empty_arm_);
+    Release(cell_arm_);
+  }
+  Term* CloneNode() const override { return new MatchTerm(location_, type_, nullptr, nullptr, variables_, nullptr); }
+
+  int ast_level() const override { return 1; }
+
+  MatchTermToken type() const { return type_; }
+  std::unique_ptr<Term>& term() { return term_; }
+  const std::unique_ptr<Term>& term() const { return term_; }
+  // The arm of 'nil' or '0'.
+  std::unique_ptr<Term>& empty_arm() { return empty_arm_; }
+  const std::unique_ptr<Term>& empty_arm() const { return empty_arm_; }
+  // The arm of 'cons' or 'succ'.
+  const std::vector<Symbol>& variables() const { return variables_; }
+  std::unique_ptr<Term>& cell_arm() { return cell_arm_; }
+  const std::unique_ptr<Term>& cell_arm() const { return cell_arm_; }
+
+ private:
+  const MatchTermToken type_;
+  std::unique_ptr<Term> term_, empty_arm_;
+  const std::vector<Symbol> variables_;
+  std::unique_ptr<Term> cell_arm_;
+};
+
+// 'letrec f_1:T_1 = t_1 and ... and f_n:T_n = t_n in body'. All of f_i are bound in order in every t_i, T_i and the
+// body, i.e. f_n has deBruijn index 0. The bindings are immutable and shared by all copies of the term, so that the
+// closures unfolded from one group refer to one recursive environment. <closed> tells whether no binding has free
+// variables besides f_i.
+//
+// The term binds the members of the group from <first> on, the ones before are bound around it in the same order, e.g.
+// by the top-level statements of the group before the one of f_<first>. <first> is 0 once the term is mapped.
+class LetRecTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::LetRec;
+
+  struct Binding {
+    Symbol variable;
+    SharedTermType type;
+    std::unique_ptr<Term> term;
+  };
+  using Bindings = std::vector<Binding>;
+
+  LetRecTerm(Location location, std::shared_ptr<const Bindings> bindings, Term* body, bool closed, size_t first = 0)
+    : Term(location, kKind), bindings_(std::move(bindings)), body_(body), closed_(closed), first_(first) { }
+  ~LetRecTerm() override { Release(body_); }
+  Term* CloneNode() const override { return new LetRecTerm(location_, bindings_, nullptr, closed_, first_); }
+
+  int ast_level() const override { return 1; }
+
+  // All bindings of the group, including the ones before <first>.
+  const std::shared_ptr<const Bindings>& bindings() const { return bindings_; }
+  size_t first() const { return first_; }
+  // The members bound by the term.
+  size_t size() const { return bindings_->size() - first_; }
+  const Binding& get(size_t index) const { return bindings_->at(first_ + index); }
+  std::unique_ptr<Term>& body() { return body_; }
+  const std::unique_ptr<Term>& body() const { return body_; }
+  bool closed() const { return closed_; }
+
+ private:
+  const std::shared_ptr<const Bindings> bindings_;
+  std::unique_ptr<Term> body_;
+  const bool closed_;
+  const size_t first_;
+};
+
+// SharedTerm is a reference-counted handle to an evaluated value without free variables, it only appears in runtime
+// terms. Several terms could refer to one value through handles instead of holding their own copies, and the evaluator
+// is free to destruct the value in place once it holds the only reference.
+class SharedTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::Shared;
+
+  SharedTerm(Location location, std::shared_ptr<Term> value)
+    : Term(location, kKind), value_(std::move(value)) { }
+  Term* CloneNode() const override { return new SharedTerm(location_, value_); }
+
+  int ast_level() const override { return value_->ast_level(); }
+
+  std::shared_ptr<Term>& value() { return value_; }
+  const std::shared_ptr<Term>& value() const { return value_; }
+  bool unique() const { return value_.use_count() == 1; }
+
+ private:
+  std::shared_ptr<Term> value_;
+};
+
+// PackedListTerm is a fully evaluated List[Nat] or List[Bool] whose elements are stored contiguously, it stands for
+// the elements of <cells> from <begin> to <end>. It only appears in runtime terms, <head> materializes one element at a
+// time and <tail> only advances <begin>.
+class PackedListTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::PackedList;
+
+  PackedListTerm(Location location, std::shared_ptr<const PackedCells> cells, size_t begin, size_t end)
+    : Term(location, kKind), cells_(std::move(cells)), begin_(begin), end_(end) { }
+  Term* CloneNode() const override { return new PackedListTerm(location_, cells_, begin_, end_); }
+
+  // Same as its equivalent 'cons' cells or 'nil'.
+  int ast_level() const override { return size() == 0 ? 5 : 2; }
+
+  const std::shared_ptr<const PackedCells>& cells() const { return cells_; }
+  size_t begin() const { return begin_; }
+  size_t end() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+
+ private:
+  std::shared_ptr<const PackedCells> cells_;
+  const size_t begin_, end_;
+};
+
+// ArrayTerm is a fully evaluated Array[T], elements are stored contiguously. It only appears in runtime terms, as
+// results of the array builtins. <element_type> is kept to build the 'nil' of 'list_of_array'.
+class ArrayTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::Array;
+
+  ArrayTerm(Location location, SharedTermType element_type)
+    : Term(location, kKind), element_type_(std::move(element_type)) { }
+  ~ArrayTerm() override {
+    for (std::unique_ptr<Term>& element : elements_) {
+      Release(element);
+    }
+  }
+  Term* CloneNode() const override {
+    ArrayTerm* ret = new ArrayTerm(location_, element_type_);
+    ret->reserve(elements_.size());
+    for (size_t i = 0; i < elements_.size(); ++i) {
+      ret->add(nullptr);
+    }
+    return ret;
+  }
+
+  int ast_level() const override { return 5; }
+
+  void add(Term* element) { elements_.emplace_back(element); }
+  void reserve(size_t size) { elements_.reserve(size); }
+
+  const SharedTermType& element_type() const { return element_type_; }
+  size_t size() const { return elements_.size(); }
+  std::unique_ptr<Term>& get(size_t index) { return elements_.at(index); }
+  const std::unique_ptr<Term>& get(size_t index) const { return elements_.at(index); }
+
+ private:
+  const SharedTermType element_type_;
+  std::vector<std::unique_ptr<Term>> elements_;
+};
+
+// MapTerm is a Map[K, V] value, its bindings live in a persistent hash trie shared by all versions of the map.
+// 'map_empty[K, V]' is parsed into an empty MapTerm. <closed> tells whether no bound value has free variables.
+class MapTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::Map;
+
+  MapTerm(Location location, SharedTermType key_type, SharedTermType value_type, std::shared_ptr<const Hamt> hamt,
+          bool closed)
+    : Term(location, kKind), key_type_(std::move(key_type)), value_type_(std::move(value_type)), hamt_(std::move(hamt)),
+      closed_(closed) { }
+  Term* CloneNode() const override { return new MapTerm(location_, key_type_, value_type_, hamt_, closed_); }
+
+  // Same as 'map_empty', or the 'map_insert's building it.
+  int ast_level() const override;
+
+  const SharedTermType& key_type() const { return key_type_; }
+  const SharedTermType& value_type() const { return value_type_; }
+  const std::shared_ptr<const Hamt>& hamt() const { return hamt_; }
+  bool closed() const { return closed_; }
+
+ private:
+  const SharedTermType key_type_, value_type_;
+  const std::shared_ptr<const Hamt> hamt_;
+  const bool closed_;
+};
+
+// RefCell is the mutable heap cell of a Ref[T], shared by all copies of the reference. <value> is open in a context of
+// <context_size> top-level bindings, the size of the context when it was stored.
+struct RefCell {
+  std::unique_ptr<Term> value;
+  size_t context_size;
+};
+
+// RefTerm is a reference created by 'ref', it only appears in runtime terms. Cloning a reference aliases the cell, so
+// an assignment through any copy is observed by all of them. Cells are reference-counted, a cell holding a closure
+// over itself is never released.
+class RefTerm : public Term {
+ public:
+  static constexpr TermKind kKind = TermKind::Ref;
+
+  RefTerm(Location location, SharedTermType value_type, std::shared_ptr<RefCell> cell)
+    : Term(location, kKind), value_type_(std::move(value_type)), cell_(std::move(cell)) { }
+  Term* CloneNode() const override { return new RefTerm(location_, value_type_, cell_); }
+
+  // Same as the 'ref' building it.
+  int ast_level() const override { return 2; }
+
+  const SharedTermType& value_type() const { return value_type_; }
+  const std::shared_ptr<RefCell>& cell() const { return cell_; }
+
+ private:
+  const SharedTermType value_type_;
+  const std::shared_ptr<RefCell> cell_;
+};
+
+// Calls <f> on the slot of every subterm owned by <term> (a Term* or a const Term*), along with the number of
+// variables <term> binds around it. The bindings of a 'letrec' are shared by all copies of it, so they are not owned.
+template<typename T, typename F>
+void ForEachSubterm(T* term, F&& f) {
+  switch (term->kind()) {
+    case TermKind::Unary: {
+      f(cast<UnaryTerm>(term)->term(), 0);
+    } break;
+    case TermKind::Binary: {
+      auto* const binary_term = cast<BinaryTerm>(term);
+      f(binary_term->term1(), 0);
+      f(binary_term->term2(), 0);
+    } break;
+    case TermKind::Ternary: {
+      auto* const ternary_term = cast<TernaryTerm>(term);
+      f(ternary_term->term1(), 0);
+      f(ternary_term->term2(), 0);
+      f(ternary_term->term3(), 0);
+    } break;
+    case TermKind::Record: {
+      auto* const record_term = cast<RecordTerm>(term);
+      for (size_t i = 0; i < record_term->size(); ++i) {
+        f(record_term->get(i).second, 0);
+      }
+    } break;
+    case TermKind::Project: {
+      f(cast<ProjectTerm>(term)->term(), 0);
+    } break;
+    case TermKind::RecordUpdate: {
+      auto* const update_term = cast<RecordUpdateTerm>(term);
+      f(update_term->term(), 0);
+      for (size_t i = 0; i < update_term->size(); ++i) {
+        f(update_term->get(i).term, 0);
+      }
+    } break;
+    case TermKind::Let: {
+      auto* const let_term = cast<LetTerm>(term);
+      f(let_term->bind_term(), 0);
+      f(let_term->body_term(), 1);
+    } break;
+    case TermKind::Abs: {
+      f(cast<AbsTerm>(term)->term(), 1);
+    } break;
+    case TermKind::Ascribe: {
+      f(cast<AscribeTerm>(term)->term(), 0);
+    } break;
+    case TermKind::Variant: {
+      f(cast<VariantTerm>(term)->term(), 0);
+    } break;
+    case TermKind::Case: {
+      auto* const case_term = cast<CaseTerm>(term);
+      f(case_term->term(), 0);
+      for (size_t i = 0; i < case_term->size(); ++i) {
+        f(case_term->get(i).body, 1);
+      }
+    } break;
+    case TermKind::Match: {
+      auto* const match_term = cast<MatchTerm>(term);
+      f(match_term->term(), 0);
+      f(match_term->empty_arm(), 0);
+      f(match_term->cell_arm(), static_cast<int>(match_term->variables().size()));
+    } break;
+    case TermKind::LetRec: {
+      auto* const letrec_term = cast<LetRecTerm>(term);
+      f(letrec_term->body(), static_cast<int>(letrec_term->size()));
+    } break;
+    case TermKind::Array: {
+      auto* const array_term = cast<ArrayTerm>(term);
+      for (size_t i = 0; i < array_term->size(); ++i) {
+        f(array_term->get(i), 0);
+      }
+    } break;
+    default: break;
+  }
+}
+
 // Statement.
 class Stmt : public Locatable {
  public:
-  Stmt(Location location) : Locatable(location) { }
+  Stmt(Location location, StmtKind kind) : Locatable(location), kind_(kind) { }
   virtual ~Stmt() = default;
+
+  StmtKind kind() const { return kind_; }
+
+ private:
+  const StmtKind kind_;
 };
 
 class EvalStmt final : public Stmt {
  public:
+  static constexpr StmtKind kKind = StmtKind::Eval;
+
   EvalStmt(Location location, Term* term)
-    : Stmt(location), term_(term) { }
+    : Stmt(location, kKind), term_(term) { }
 
   const std::unique_ptr<Term>& term() const { return term_; }
   std::unique_ptr<Term>& term() { return term_; }
@@ -539,8 +1368,10 @@ class EvalStmt final : public Stmt {
 
 class BindTermStmt final : public Stmt {
  public:
+  static constexpr StmtKind kKind = StmtKind::BindTerm;
+
   BindTermStmt(Location location, Pattern* pattern, Term* term)
-    : Stmt(location), pattern_(pattern), term_(term) { }
+    : Stmt(location, kKind), pattern_(pattern), term_(term) { }
 
   const std::string& variable() const { return pattern_->variable(); }
   const std::unique_ptr<Term>& term() const { return term_; }
@@ -553,8 +1384,10 @@ class BindTermStmt final : public Stmt {
 
 class BindTypeStmt final : public Stmt {
  public:
+  static constexpr StmtKind kKind = StmtKind::BindType;
+
   BindTypeStmt(Location location, const std::string& type_alias, TermType* type)
-    : Stmt(location), type_alias_(type_alias), type_(type) { }
+    : Stmt(location, kKind), type_alias_(type_alias), type_(type) { }
 
   const std::string& type_alias() const { return type_alias_; }
   const std::unique_ptr<TermType>& type() const { return type_; }
@@ -0,0 +1,598 @@
+#include "compactor.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "evaluator.h"
+#include "hamt.h"
+#include "type-helper.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Calls <f> on every type annotating <term> itself, along with the number of variables <term> binds around it.
+template<typename F>
+void ForEachAnnotation(const Term* term, F&& f) {
+  switch (term->kind()) {
+    case TermKind::Nil: {
+      f(cast<NilTerm>(term)->list_type().get(), 0);
+    } break;
+    case TermKind::Abs: {
+      f(cast<AbsTerm>(term)->variable_type().get(), 0);
+    } break;
+    case TermKind::Ascribe: {
+      f(cast<AscribeTerm>(term)->ascribe_type().get(), 0);
+    } break;
+    case TermKind::Variant: {
+      f(cast<VariantTerm>(term)->variant_type().get(), 0);
+    } break;
+    case TermKind::LetRec: {
+      const LetRecTerm* const letrec_term = cast<LetRecTerm>(term);
+      for (size_t i = 0; i < letrec_term->size(); ++i) {
+        f(letrec_term->get(i).type.get(), static_cast<int>(letrec_term->size()));
+      }
+    } break;
+    case TermKind::Array: {
+      f(cast<ArrayTerm>(term)->element_type().get(), 0);
+    } break;
+    case TermKind::Map: {
+      f(cast<MapTerm>(term)->key_type().get(), 0);
+      f(cast<MapTerm>(term)->value_type().get(), 0);
+    } break;
+    case TermKind::Ref: {
+      f(cast<RefTerm>(term)->value_type().get(), 0);
+    } break;
+    default: break;
+  }
+}
+
+// The node shared by the copies of <term>, i.e. its value, the bindings of its letrec group or the bindings of its
+// map, or nullptr if there is none. The cells of references are left out, they are renumbered on their own.
+const void* SharedNode(const Term* term) {
+  switch (term->kind()) {
+    case TermKind::Shared: return cast<SharedTerm>(term)->value().get();
+    case TermKind::LetRec: return cast<LetRecTerm>(term)->bindings().get();
+    case TermKind::Map: return cast<MapTerm>(term)->hamt().get();
+    default: return nullptr;
+  }
+}
+
+// Calls <f> on the terms in the node shared by the copies of <term>, see SharedNode(), along with the number of
+// variables bound around them.
+template<typename F>
+void ForEachShared(const Term* term, F&& f) {
+  switch (term->kind()) {
+    case TermKind::Shared: {
+      f(cast<SharedTerm>(term)->value().get(), 0);
+    } break;
+    case TermKind::LetRec: {
+      const LetRecTerm* const letrec_term = cast<LetRecTerm>(term);
+      for (size_t i = 0; i < letrec_term->size(); ++i) {
+        f(letrec_term->get(i).term.get(), static_cast<int>(letrec_term->size()));
+      }
+    } break;
+    case TermKind::Map: {
+      // Keys are first-order values, with neither variables nor annotations.
+      cast<MapTerm>(term)->hamt()->ForEach([&f](const Term* key, const Term* value) { f(value, 0); });
+    } break;
+    default: break;
+  }
+}
+
+bool RefersToAlias(const TermType* type) {
+  switch (type->kind()) {
+    case TermTypeKind::List: return RefersToAlias(cast<ListTermType>(type)->type().get());
+    case TermTypeKind::Array: return RefersToAlias(cast<ArrayTermType>(type)->type().get());
+    case TermTypeKind::Ref: return RefersToAlias(cast<RefTermType>(type)->type().get());
+    case TermTypeKind::Map: {
+      const MapTermType* const map_type = cast<MapTermType>(type);
+      return RefersToAlias(map_type->key_type().get()) || RefersToAlias(map_type->value_type().get());
+    }
+    case TermTypeKind::Record: {
+      const RecordTermType* const record_type = cast<RecordTermType>(type);
+      for (size_t i = 0; i < record_type->size(); ++i) {
+        if (RefersToAlias(record_type->get(i).second.get())) {
+          return true;
+        }
+      }
+      return false;
+    }
+    case TermTypeKind::Variant: {
+      const VariantTermType* const variant_type = cast<VariantTermType>(type);
+      for (size_t i = 0; i < variant_type->size(); ++i) {
+        if (RefersToAlias(variant_type->get(i).second.get())) {
+          return true;
+        }
+      }
+      return false;
+    }
+    case TermTypeKind::Arrow: {
+      const ArrowTermType* const arrow_type = cast<ArrowTermType>(type);
+      return RefersToAlias(arrow_type->type1().get()) || RefersToAlias(arrow_type->type2().get());
+    }
+    case TermTypeKind::UserDefined: return true;
+    default: return false;
+  }
+}
+
+// Finds the shared nodes (see SharedNode()) holding terms annotated with types that refer to aliases, so that the
+// other ones are not copied when renumbered. Each node is walked once, with an explicit stack as values can be deep.
+class AliasFinder {
+ public:
+  // Whether the node shared by the copies of <term> holds such terms.
+  bool Holds(const Term* term);
+
+ private:
+  struct Item {
+    const Term* term;
+    const void* node;  // the innermost shared node holding <term>.
+  };
+
+  // Records that <node> and the nodes holding it hold such terms.
+  void Found(const void* node);
+
+  std::unordered_map<const void*, bool> holds_;
+  std::unordered_map<const void*, const void*> holders_;  // of the nodes walked by the last call to Holds().
+};
+
+bool AliasFinder::Holds(const Term* term) {
+  const void* const root = SharedNode(term);
+  const auto it = holds_.find(root);
+  if (it != holds_.end()) {
+    return it->second;
+  }
+
+  // The types of a letrec group are annotations of the group.
+  bool found = false;
+  if (isa<LetRecTerm>(term)) {
+    ForEachAnnotation(term, [&found](const TermType* type, int) { found = found || RefersToAlias(type); });
+  }
+  if (found) {
+    holds_[root] = true;
+    return true;
+  }
+
+  holders_.clear();
+  holders_[root] = nullptr;
+  vector<Item> items;
+  ForEachShared(term, [&items, root](const Term* shared_term, int) { items.push_back({shared_term, root}); });
+  while (!items.empty()) {
+    const Item item = items.back();
+    items.pop_back();
+
+    ForEachAnnotation(item.term, [&found](const TermType* type, int) { found = found || RefersToAlias(type); });
+    const void* const node = SharedNode(item.term);
+    if (node != nullptr && !found) {
+      const auto walked = holds_.find(node);
+      if (walked != holds_.end()) {
+        found = walked->second;
+      } else if (holders_.emplace(node, item.node).second) {
+        ForEachShared(item.term, [&items, node](const Term* shared_term, int) {
+          items.push_back({shared_term, node});
+        });
+      }
+    }
+    if (found) {
+      Found(item.node);
+      return true;
+    }
+    ForEachSubterm(item.term, [&items, &item](const unique_ptr<Term>& subterm, int) {
+      items.push_back({subterm.get(), item.node});
+    });
+  }
+  // None of the nodes walked holds such terms.
+  for (const auto& holder : holders_) {
+    holds_[holder.first] = false;
+  }
+  return false;
+}
+
+void AliasFinder::Found(const void* node) {
+  for (; node != nullptr; node = holders_[node]) {
+    holds_[node] = true;
+  }
+}
+
+// A shared node, in a context of <context_size> bindings, under <depth> variables bound. Values are closed and
+// evaluated at top level, so the types annotating them are open in the context alone, i.e. at depth 0.
+using SharedKey = std::tuple<const void*, size_t, int>;
+
+// The shared nodes renumbered in a compaction. Each one is renumbered once for each context it is found in, so that its
+// copies in that context remain shared, and the ones without aliases are kept as they are.
+struct SharedRenumbered {
+  AliasFinder finder;
+  std::map<SharedKey, std::shared_ptr<Term>> values;
+  std::map<SharedKey, std::shared_ptr<const LetRecTerm::Bindings>> groups;
+  std::map<SharedKey, std::shared_ptr<const Hamt>> hamts;
+};
+
+// Maps the free variables of a term, <var> bindings out of the term, to <renumber(var)>, and the aliases the types
+// annotating it refer to the same way. The term is open in a context of <context_size> bindings.
+class TermRenumberer : public TermMapper {
+ public:
+  TermRenumberer(size_t context_size, std::function<int(int)> renumber, SharedRenumbered* shared)
+    : context_size_(context_size), renumber_(std::move(renumber)), shared_(shared) { }
+  unique_ptr<Term> Renumber(const Term* term) { return Map(term); }
+
+  void Visit(const NilTerm* term) override;
+  void Visit(const AbsTerm* term) override;
+  void Visit(const AscribeTerm* term) override;
+  void Visit(const VariantTerm* term) override;
+  void Visit(const LetRecTerm* term) override;
+  void Visit(const SharedTerm* term) override;
+  void Visit(const ArrayTerm* term) override;
+  void Visit(const RefTerm* term) override;
+  void Visit(const MapTerm* term) override;
+
+ protected:
+  void Expand(const Term* term) override;
+  unique_ptr<Term> VariableMap(Location location, int var) override {
+    return std::make_unique<VariableTerm>(location, renumbered(var, depth()));
+  }
+
+ private:
+  int renumbered(int index, int depth) const { return index >= depth ? depth + renumber_(index - depth) : index; }
+  unique_ptr<TermType> renumbered(const TermType* type, int depth) const;
+  SharedTermType renumbered(const SharedTermType& type, int depth);
+  SharedKey key(const Term* term) const {
+    return {SharedNode(term), context_size_, isa<SharedTerm>(term) ? 0 : depth()};
+  }
+
+  const size_t context_size_;
+  const std::function<int(int)> renumber_;
+  SharedRenumbered* const shared_;
+  // Types are mostly shared by the terms of a value, and renumbered once for each depth they are found at.
+  std::map<std::pair<const TermType*, int>, SharedTermType> types_;
+};
+
+unique_ptr<TermType> TermRenumberer::renumbered(const TermType* type, int depth) const {
+  return TermTypeShifter([this, depth](int index) { return renumbered(index, depth); }).Shift(type);
+}
+
+SharedTermType TermRenumberer::renumbered(const SharedTermType& type, int depth) {
+  if (!RefersToAlias(type.get())) {
+    return type;
+  }
+  SharedTermType& ret = types_[{type.get(), depth}];
+  if (ret == nullptr) {
+    ret = ShareType(renumbered(type.get(), depth).release());
+  }
+  return ret;
+}
+
+void TermRenumberer::Expand(const Term* term) {
+  // The terms in an open group or map are mapped by TermMapper, the ones in a shared node only if they are renumbered.
+  const bool open = (isa<LetRecTerm>(term) && !cast<LetRecTerm>(term)->closed()) ||
+                    (isa<MapTerm>(term) && !cast<MapTerm>(term)->closed());
+  if (SharedNode(term) != nullptr && !open) {
+    const SharedKey shared_key = key(term);
+    const bool mapped = shared_->values.count(shared_key) != 0 || shared_->groups.count(shared_key) != 0 ||
+                        shared_->hamts.count(shared_key) != 0;
+    if (!mapped && shared_->finder.Holds(term)) {
+      const int depth = isa<SharedTerm>(term) ? -this->depth() : 0;
+      ForEachShared(term, [this, depth](const Term* shared_term, int binders) {
+        MapBefore(shared_term, depth + binders);
+      });
+    }
+  }
+  TermMapper::Expand(term);
+}
+
+void TermRenumberer::Visit(const NilTerm* term) {
+  set(term, std::make_unique<NilTerm>(term->location(), renumbered(term->list_type(), depth())));
+}
+
+void TermRenumberer::Visit(const AbsTerm* term) {
+  set(term, std::make_unique<AbsTerm>(term->location(), term->variable(), renumbered(term->variable_type(), depth()),
+                                      get(term->term()).release()));
+}
+
+void TermRenumberer::Visit(const AscribeTerm* term) {
+  set(term, std::make_unique<AscribeTerm>(term->location(), get(term->term()).release(),
+                                          renumbered(term->ascribe_type().get(), depth()).release()));
+}
+
+void TermRenumberer::Visit(const VariantTerm* term) {
+  set(term, std::make_unique<VariantTerm>(term->location(), term->tag(), get(term->term()).release(),
+                                          renumbered(term->variant_type(), depth()), term->index()));
+}
+
+void TermRenumberer::Visit(const LetRecTerm* term) {
+  std::shared_ptr<const LetRecTerm::Bindings> bindings;
+  if (term->closed()) {
+    std::shared_ptr<const LetRecTerm::Bindings>& renumbered_bindings = shared_->groups[key(term)];
+    if (renumbered_bindings == nullptr && !shared_->finder.Holds(term)) {
+      renumbered_bindings = term->bindings();
+    }
+    bindings = renumbered_bindings;
+  }
+  if (bindings == nullptr) {
+    auto renumbered_bindings = std::make_shared<LetRecTerm::Bindings>();
+    renumbered_bindings->reserve(term->size());
+    for (size_t i = 0; i < term->size(); ++i) {
+      const LetRecTerm::Binding& binding = term->get(i);
+      renumbered_bindings->push_back({binding.variable,
+                                      renumbered(binding.type, depth() + static_cast<int>(term->size())),
+                                      get(binding.term)});
+    }
+    bindings = std::move(renumbered_bindings);
+    if (term->closed()) {
+      shared_->groups[key(term)] = bindings;
+    }
+  }
+  // Renumbering free variables leaves them free, so the group is as closed as it was.
+  set(term, std::make_unique<LetRecTerm>(term->location(), std::move(bindings), get(term->body()).release(),
+                                         term->closed()));
+}
+
+void TermRenumberer::Visit(const SharedTerm* term) {
+  std::shared_ptr<Term>& value = shared_->values[key(term)];
+  if (value == nullptr) {
+    value = shared_->finder.Holds(term)
+                ? std::shared_ptr<Term>(get(term->value().get()).release(), CellPool::Recycle)
+                : term->value();
+  }
+  set(term, std::make_unique<SharedTerm>(term->location(), value));
+}
+
+void TermRenumberer::Visit(const ArrayTerm* term) {
+  auto array_term = std::make_unique<ArrayTerm>(term->location(), renumbered(term->element_type(), depth()));
+
+  array_term->reserve(term->size());
+  for (size_t i = 0; i < term->size(); ++i) {
+    array_term->add(get(term->get(i)).release());
+  }
+  set(term, std::move(array_term));
+}
+
+void TermRenumberer::Visit(const RefTerm* term) {
+  // The value in the cell is renumbered on its own, see CompactContext().
+  set(term, std::make_unique<RefTerm>(term->location(), renumbered(term->value_type(), depth()), term->cell()));
+}
+
+void TermRenumberer::Visit(const MapTerm* term) {
+  std::shared_ptr<const Hamt> hamt;
+  if (term->closed()) {
+    std::shared_ptr<const Hamt>& renumbered_hamt = shared_->hamts[key(term)];
+    if (renumbered_hamt == nullptr && !shared_->finder.Holds(term)) {
+      renumbered_hamt = term->hamt();
+    }
+    hamt = renumbered_hamt;
+  }
+  if (hamt == nullptr) {
+    Hamt renumbered_hamt;
+    term->hamt()->ForEach([this, &renumbered_hamt](const Term* key, const Term* value) {
+      renumbered_hamt = renumbered_hamt.Insert(unique_ptr<Term>(key->clone()), get(value));
+    });
+    hamt = std::make_shared<const Hamt>(std::move(renumbered_hamt));
+    if (term->closed()) {
+      shared_->hamts[key(term)] = hamt;
+    }
+  }
+  set(term, std::make_unique<MapTerm>(term->location(), renumbered(term->key_type(), depth()),
+                                      renumbered(term->value_type(), depth()), std::move(hamt), term->closed()));
+}
+
+// Marks the bindings of a context reachable from the ones marked. Values are walked with an explicit stack as they can
+// be deep, and the nodes shared by values are walked once for each context they are found in, as TermRenumberer
+// renumbers them (reference cells once, in the context they were stored in).
+class Marker {
+ public:
+  explicit Marker(const Context* ctx) : ctx_(ctx), marked_(ctx->size(), false) { }
+
+  // Marks the binding at <position> from the outermost one, and the bindings it refers to.
+  void Mark(size_t position);
+  bool marked(size_t position) const { return marked_[position]; }
+
+  // Cells of the references in the values of the bindings marked.
+  const vector<RefCell*>& cells() const { return cells_; }
+
+ private:
+  struct Item {
+    const Term* term;
+    int depth;
+    size_t context_size;  // of the context the term is open in.
+  };
+
+  // Marks the binding <index> bindings out of a context of <context_size> bindings.
+  void MarkIndex(size_t context_size, int index);
+  // Marks the aliases <type> refers to, under <depth> variables bound in a context of <context_size> bindings.
+  void MarkType(const TermType* type, size_t context_size, int depth = 0);
+  void MarkTerm(const Term* term, size_t context_size);
+
+  const Context* const ctx_;
+  vector<bool> marked_;
+  vector<size_t> pending_;  // positions of the bindings marked but not walked yet.
+  vector<Item> items_;
+  std::set<SharedKey> walked_;
+  std::unordered_set<const RefCell*> walked_cells_;
+  vector<RefCell*> cells_;
+};
+
+void Marker::Mark(size_t position) {
+  MarkIndex(position + 1, 0);
+  while (!pending_.empty()) {
+    const size_t next = pending_.back();
+    pending_.pop_back();
+
+    const Binding* const binding = ctx_->get(ctx_->size() - 1 - next).second.get();
+    if (binding == nullptr) {
+      continue;
+    }
+    if (binding->type() != nullptr) {
+      MarkType(binding->type(), next);
+    }
+    if (binding->term() != nullptr) {
+      MarkTerm(binding->term(), next);
+    }
+    if (!binding->forced()) {
+      MarkTerm(binding->unforced(), next);
+    }
+  }
+}
+
+void Marker::MarkIndex(size_t context_size, int index) {
+  if (index < 0 || static_cast<size_t>(index) >= context_size) {
+    return;
+  }
+  const size_t position = context_size - 1 - index;
+  if (!marked_[position]) {
+    marked_[position] = true;
+    pending_.push_back(position);
+  }
+}
+
+void Marker::MarkType(const TermType* type, size_t context_size, int depth) {
+  // Types are shallow, so they are walked recursively.
+  switch (type->kind()) {
+    case TermTypeKind::List: {
+      MarkType(cast<ListTermType>(type)->type().get(), context_size, depth);
+    } break;
+    case TermTypeKind::Array: {
+      MarkType(cast<ArrayTermType>(type)->type().get(), context_size, depth);
+    } break;
+    case TermTypeKind::Ref: {
+      MarkType(cast<RefTermType>(type)->type().get(), context_size, depth);
+    } break;
+    case TermTypeKind::Map: {
+      MarkType(cast<MapTermType>(type)->key_type().get(), context_size, depth);
+      MarkType(cast<MapTermType>(type)->value_type().get(), context_size, depth);
+    } break;
+    case TermTypeKind::Record: {
+      const RecordTermType* const record_type = cast<RecordTermType>(type);
+      for (size_t i = 0; i < record_type->size(); ++i) {
+        MarkType(record_type->get(i).second.get(), context_size, depth);
+      }
+    } break;
+    case TermTypeKind::Variant: {
+      const VariantTermType* const variant_type = cast<VariantTermType>(type);
+      for (size_t i = 0; i < variant_type->size(); ++i) {
+        MarkType(variant_type->get(i).second.get(), context_size, depth);
+      }
+    } break;
+    case TermTypeKind::Arrow: {
+      MarkType(cast<ArrowTermType>(type)->type1().get(), context_size, depth);
+      MarkType(cast<ArrowTermType>(type)->type2().get(), context_size, depth);
+    } break;
+    case TermTypeKind::UserDefined: {
+      MarkIndex(context_size, cast<UserDefinedTermType>(type)->index() - depth);
+    } break;
+    default: break;
+  }
+}
+
+void Marker::MarkTerm(const Term* term, size_t context_size) {
+  items_.push_back({term, 0, context_size});
+  while (!items_.empty()) {
+    const Item item = items_.back();
+    items_.pop_back();
+
+    ForEachAnnotation(item.term, [this, &item](const TermType* type, int binders) {
+      MarkType(type, item.context_size, item.depth + binders);
+    });
+    if (item.term->kind() == TermKind::Variable) {
+      MarkIndex(item.context_size, cast<VariableTerm>(item.term)->index() - item.depth);
+    } else if (item.term->kind() == TermKind::Ref) {
+      // The value in a cell is open in the context it was stored in.
+      RefCell* const cell = cast<RefTerm>(item.term)->cell().get();
+      if (walked_cells_.insert(cell).second) {
+        cells_.push_back(cell);
+        items_.push_back({cell->value.get(), 0, cell->context_size});
+      }
+    } else if (SharedNode(item.term) != nullptr) {
+      const int depth = isa<SharedTerm>(item.term) ? 0 : item.depth;
+      if (walked_.insert({SharedNode(item.term), item.context_size, depth}).second) {
+        ForEachShared(item.term, [this, &item, depth](const Term* shared_term, int binders) {
+          items_.push_back({shared_term, depth + binders, item.context_size});
+        });
+      }
+    }
+    ForEachSubterm(item.term, [this, &item](const unique_ptr<Term>& subterm, int binders) {
+      items_.push_back({subterm.get(), item.depth + binders, item.context_size});
+    });
+  }
+}
+
+Binding* renumbered(const Binding* binding, size_t context_size, const std::function<int(int)>& renumber,
+                    SharedRenumbered* shared) {
+  TermType* const type =
+      binding->type() != nullptr ? TermTypeShifter(renumber).Shift(binding->type()).release() : nullptr;
+  if (!binding->forced()) {
+    return Binding::Deferred(TermRenumberer(context_size, renumber, shared).Renumber(binding->unforced()).release(),
+                             type);
+  }
+  Term* const term = binding->term() != nullptr
+                         ? TermRenumberer(context_size, renumber, shared).Renumber(binding->term()).release()
+                         : nullptr;
+  return new Binding(term, type);
+}
+
+}  // namespace
+
+size_t CompactContext(Context* ctx) {
+  const size_t size = ctx->size();
+  Marker marker(ctx);
+  std::unordered_set<string> visible;
+  for (size_t i = size; i > 0; --i) {
+    if (visible.insert(ctx->get(size - i).first).second) {
+      marker.Mark(i - 1);
+    }
+  }
+
+  // The number of bindings kept before each position, i.e. the position of a binding kept in the compacted context.
+  vector<size_t> kept_before(size + 1, 0);
+  for (size_t i = 0; i < size; ++i) {
+    kept_before[i + 1] = kept_before[i] + (marker.marked(i) ? 1 : 0);
+  }
+  if (kept_before[size] == size) {
+    return 0;
+  }
+  // Maps the index of a binding kept, in a context of <context_size> bindings, to its index in the compacted context.
+  // Types annotating values are not shifted along with them, so they could refer past the context, and are moved by
+  // the number of bindings dropped from it.
+  const auto renumber = [&kept_before](size_t context_size) {
+    return [&kept_before, context_size](int index) {
+      if (static_cast<size_t>(index) >= context_size) {
+        return static_cast<int>(kept_before[context_size] + index - context_size);
+      }
+      return static_cast<int>(kept_before[context_size] - 1 - kept_before[context_size - 1 - index]);
+    };
+  };
+
+  // The values and bindings replaced are released at the end, so that the nodes renumbered are not freed and
+  // reallocated while <shared> refers to them.
+  SharedRenumbered shared;
+  vector<unique_ptr<Term>> replaced;
+  for (RefCell* cell : marker.cells()) {
+    unique_ptr<Term> value =
+        TermRenumberer(cell->context_size, renumber(cell->context_size), &shared).Renumber(cell->value.get());
+    replaced.push_back(std::move(cell->value));
+    cell->value = std::move(value);
+    cell->context_size = kept_before[cell->context_size];
+  }
+
+  vector<std::pair<string, unique_ptr<Binding>>> bindings = ctx->TakeBindings();
+  for (size_t i = 0; i < size; ++i) {
+    if (!marker.marked(i)) {
+      continue;
+    }
+    unique_ptr<Binding>& binding = bindings[i].second;
+    // Bindings before the first one dropped are left as they are.
+    const bool moved = binding != nullptr && kept_before[i] != i;
+    ctx->AddBinding(bindings[i].first, moved ? renumbered(binding.get(), i, renumber(i), &shared) : binding.release());
+  }
+  return size - kept_before[size];
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+class Context;
+
+// Compacts the top-level bindings of <ctx>, e.g. after a long session that rebinds the same names. A binding is kept if
+// it is visible, i.e. not shadowed by a later binding of the same name, or if a binding kept refers to it through its
+// value, its type or the cells of references in its value. The other bindings are dropped along with their values, and
+// the indices in the bindings kept and in the reference cells are renumbered to the compacted context, along with the
+// aliases referred to by the types annotating terms inside of them (e.g. of lambdas), which are kept as well. A value
+// shared by several terms is renumbered once for each context it is found in, and copied only if it holds such types.
+//
+// Returns the number of bindings dropped.
+size_t CompactContext(Context* ctx);
@@ -1,9 +1,7 @@
 #include "context.h"
 
-#include <experimental/string_view>
-#include <algorithm>
+#include <cctype>
 
-using std::experimental::string_view;
 using std::pair;
 using std::string;
 using std::unique_ptr;
@@ -11,32 +9,22 @@ using std::vector;
 
 namespace {
 
-int to_integer(const string_view& view) {
-  if (view.empty()) {
+// Returns the number of an alias of the form <base>_<number>, where <base> is <base_length> long, or -1.
+int alias_number(const string& name, size_t* base_length) {
+  const size_t underscore = name.rfind('_');
+  // Numbers of fresh aliases fit in an int.
+  if (underscore == string::npos || underscore == 0 || name.length() - underscore - 1 > 9) {
     return -1;
   }
-  int ret = 0;
-  for (size_t i = 0; i < view.length(); ++i) {
-    if (!isdigit(view[i])) {
+  int number = 0;
+  for (size_t i = underscore + 1; i < name.length(); ++i) {
+    if (!isdigit(name[i])) {
       return -1;
     }
-    ret = ret * 10 + view[i] - '0';
+    number = number * 10 + name[i] - '0';
   }
-  return ret;
-}
-
-// Returns the minimal positive number that doesn't appear in <vec>.
-int mex(vector<int> vec) {
-  std::sort(vec.begin(), vec.end());
-  int expect = 1;
-  for (int num : vec) {
-    if (num > expect) {
-      return expect;
-    } else if (num == expect) {
-      ++expect;
-    }
-  }
-  return expect;
+  *base_length = underscore;
+  return underscore + 1 < name.length() ? number : -1;
 }
 
 }  // namespace
@@ -45,6 +33,13 @@ void Context::AddBinding(const string& name, Binding* binding) {
   const size_t count = size();
   index_map_[name].push_back(count);
   bindings_.push_back({name, unique_ptr<Binding>(binding)});
+
+  // Keeps the counter past a fresh alias bound again, e.g. by the pretty printer.
+  int number;
+  int* const counter = FreshCounter(name, &number);
+  if (counter != nullptr && *counter == number) {
+    ++*counter;
+  }
 }
 
 void Context::AddName(const string& name) {
@@ -55,39 +50,38 @@ void Context::DropBindings(size_t n) {
   assert(n <= size());
 
   for (size_t i = 0; i < n; ++i) {
-    const bindings_iterator iter = index_map_.find(bindings_.back().first);
+    const string& name = bindings_.back().first;
+    const bindings_iterator iter = index_map_.find(name);
     iter->second.pop_back();
     if (iter->second.empty()) {
       index_map_.erase(iter);
+      // The alias is free again, so the counter goes back to it.
+      int number;
+      int* const counter = FreshCounter(name, &number);
+      if (counter != nullptr && number > 0 && number < *counter) {
+        *counter = number;
+      }
     }
     bindings_.pop_back();
   }
 }
 
+vector<pair<string, unique_ptr<Binding>>> Context::TakeBindings() {
+  vector<pair<string, unique_ptr<Binding>>> bindings = std::move(bindings_);
+  bindings_.clear();
+  index_map_.clear();
+  fresh_numbers_.clear();
+  return bindings;
+}
+
 string Context::PickFreshName(const string& name) {
-  string fresh;
-  bindings_const_iterator iter = index_map_.find(name);
-
-  if (iter == index_map_.end()) {
-    fresh = name;
-  } else {
-    vector<int> occupied_slots;
-    while (++iter != index_map_.end()) {
-      string_view view(iter->first);
-      if (view.substr(0, name.length()) == name) {
-        if (iter->first.length() >= name.length() + 2 && iter->first[name.length()] == '_') {
-          view = view.substr(name.length() + 1);
-          int number = to_integer(view);
-          if (number != -1) {
-            occupied_slots.push_back(number);
-          }
-        }
-      } else {
-        break;
-      }
-    }
-    const int free = mex(std::move(occupied_slots));
-    fresh = name + "_" + std::to_string(free);
+  string fresh = name;
+
+  if (index_map_.find(name) != index_map_.end()) {
+    int& counter = fresh_numbers_.emplace(name, 1).first->second;
+    do {
+      fresh = name + "_" + std::to_string(counter++);
+    } while (index_map_.find(fresh) != index_map_.end());
   }
 
   AddName(fresh);
@@ -99,3 +93,16 @@ int Context::ToIndex(const string& name) const {
   const bindings_const_iterator iter = index_map_.find(name);
   return iter == index_map_.end() ? -1 : size() - 1 - iter->second.back();
 }
+
+int* Context::FreshCounter(const string& name, int* number) {
+  if (fresh_numbers_.empty()) {
+    return nullptr;
+  }
+  size_t base_length;
+  *number = alias_number(name, &base_length);
+  if (*number < 0) {
+    return nullptr;
+  }
+  const auto iter = fresh_numbers_.find(name.substr(0, base_length));
+  return iter != fresh_numbers_.end() ? &iter->second : nullptr;
+}
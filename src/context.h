@@ -3,7 +3,7 @@
 #include <cassert>
 #include <memory>
 #include <string>
-#include <map>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -13,11 +13,30 @@ class Binding {
  public:
   Binding(const Term* term, const TermType* type) : term_(term), type_(type) { }
 
+  // A binding of a type checked term that is not evaluated until its value is first looked up, see Force().
+  static Binding* Deferred(const Term* unforced, const TermType* type) {
+    Binding* binding = new Binding(nullptr, type);
+    binding->unforced_.reset(unforced);
+    return binding;
+  }
+
+  // The value, nullptr for type aliases and unforced bindings.
   const Term* term() const { return term_.get(); }
   const TermType* type() const { return type_.get(); }
 
+  // The term to evaluate, until the binding is forced once.
+  const Term* unforced() const { return unforced_.get(); }
+  bool forced() const { return unforced_ == nullptr; }
+  // Caches the value of a deferred binding, in place of its term.
+  void Force(const Term* value) {
+    assert(!forced());
+    term_.reset(value);
+    unforced_.reset();
+  }
+
  private:
-  const std::unique_ptr<const Term> term_;  // nullable.
+  std::unique_ptr<const Term> term_;  // nullable.
+  std::unique_ptr<const Term> unforced_;  // nullable.
   const std::unique_ptr<const TermType> type_;  // nullable.
 };
 
@@ -34,8 +53,11 @@ class Context final {
   void AddName(const std::string& name);
   void DropBindings(size_t n);
   void DropBindingsTo(size_t new_size) { DropBindings(size() - new_size); }
+  // Takes all bindings out, the outermost one first, leaving the context empty, e.g. to rebuild it compacted.
+  std::vector<std::pair<std::string, std::unique_ptr<Binding>>> TakeBindings();
 
-  // Picks one fresh alias of <name> that does not appear in <bindings_>.
+  // Picks one fresh alias of <name> that does not appear in <bindings_>, i.e. <name> itself or <name>_<k> with the least
+  // such k >= 1.
   std::string PickFreshName(const std::string& name);
 
   // Returns the smallest index (logical index), "-1" if not found.
@@ -50,8 +72,14 @@ class Context final {
   }
 
  private:
+  // The counter of fresh aliases of the base of <name>, if <name> is of the form <base>_<number>, else nullptr.
+  int* FreshCounter(const std::string& name, int* number);
+
   // Stores deBruijn index in reverse order.
-  std::map<std::string, std::vector<int>> index_map_;
+  std::unordered_map<std::string, std::vector<int>> index_map_;
+  // For the names fresh aliases were picked for, a number k such that <name>_1 .. <name>_<k-1> are all bound, where
+  // PickFreshName() starts to look for a free alias.
+  std::unordered_map<std::string, int> fresh_numbers_;
   std::vector<std::pair<std::string, std::unique_ptr<Binding>>> bindings_;
 
   typedef decltype(index_map_)::iterator bindings_iterator;
@@ -1,49 +1,127 @@
 #include "evaluator.h"
 
+#include <algorithm>
 #include <memory>
+#include <numeric>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include "arena.h"
 #include "error.h"
 #include "context.h"
+#include "hamt.h"
+#include "hash-cons.h"
+#include "location.h"
+#include "packed-list.h"
+#include "type-helper.h"
+#include "value-hash.h"
 
 using std::unique_ptr;
 
+namespace {
+
+bool IsClosedGroup(const LetRecTerm::Bindings& bindings);
+unique_ptr<Term> stored(unique_ptr<Term> value);
+
+}  // namespace
+
+thread_local std::vector<TermMapper::Frame> TermMapper::frames_;
+
 unique_ptr<Term> TermMapper::Map(const Term* term) {
-  term->Accept(this);
+  MapBefore(term);
   unique_ptr<Term> ret = get(term);
   result_.clear();
   return ret;
 }
 
+void TermMapper::MapNested(const Term* term) {
+  // Mapping a term could map other terms on the way (e.g. TermSubstituter shifts the term substituted), which use the
+  // frames above the ones of this term.
+  const size_t base = frames_.size();
+  const int depth = depth_;
+  nested_ = true;
+  frames_.push_back({term, depth_, false});
+  while (frames_.size() > base) {
+    Frame& frame = frames_.back();
+    const Term* const next = frame.term;
+    depth_ = frame.depth;
+    if (!frame.expanded) {
+      frame.expanded = true;
+      const size_t size = frames_.size();
+      Expand(next);
+      if (frames_.size() > size) {
+        continue;
+      }
+    }
+    frames_.pop_back();
+    next->Accept(this);
+  }
+  nested_ = false;
+  depth_ = depth;
+}
+
+void TermMapper::Expand(const Term* term) {
+  ForEachSubterm(term, [this](const unique_ptr<Term>& subterm, int binders) {
+    MapBefore(subterm.get(), binders);
+  });
+
+  // A closed group is left unchanged, see Visit(const LetRecTerm*).
+  const LetRecTerm* const letrec_term = dyn_cast<LetRecTerm>(term);
+  if (letrec_term != nullptr && !letrec_term->closed()) {
+    for (size_t i = 0; i < letrec_term->size(); ++i) {
+      MapBefore(letrec_term->get(i).term.get(), letrec_term->size());
+    }
+  }
+  const MapTerm* const map_term = dyn_cast<MapTerm>(term);
+  if (map_term != nullptr && !map_term->closed()) {
+    map_term->hamt()->ForEach([this](const Term* key, const Term* value) { MapBefore(value); });
+  }
+}
+
+void TermMapper::MapBefore(const Term* subterm, int binders) {
+  if (nested_) {
+    frames_.push_back({subterm, depth_ + binders, false});
+    return;
+  }
+  const int depth = depth_;
+  depth_ += binders;
+  if (++nesting_ < kMaxNesting) {
+    Expand(subterm);
+    subterm->Accept(this);
+  } else {
+    MapNested(subterm);
+  }
+  --nesting_;
+  depth_ = depth;
+}
+
 void TermMapper::Visit(const NullaryTerm* term) {
   result_[term] = std::make_unique<NullaryTerm>(term->location(), term->type());
 }
 
-void TermMapper::Visit(const UnaryTerm* term) {
-  term->term()->Accept(this);
+void TermMapper::Visit(const NatTerm* term) {
+  result_[term] = unique_ptr<Term>(term->clone());
+}
 
-  result_[term] = std::make_unique<UnaryTerm>(term->location(), term->type(), get(term->term()).release());
+void TermMapper::Visit(const UnaryTerm* term) {
+  result_[term] = std::make_unique<UnaryTerm>(term->location(), term->type(), get(term->term()).release(),
+                                              term->value_type());
 }
 
 void TermMapper::Visit(const BinaryTerm* term) {
-  term->term1()->Accept(this);
-  term->term2()->Accept(this);
-
   result_[term] = std::make_unique<BinaryTerm>(term->location(), term->type(), get(term->term1()).release(),
-                                               get(term->term2()).release());
+                                               get(term->term2()).release(), term->element_type());
 }
 
 void TermMapper::Visit(const TernaryTerm* term) {
-  term->term1()->Accept(this);
-  term->term2()->Accept(this);
-  term->term3()->Accept(this);
-
   result_[term] = std::make_unique<TernaryTerm>(term->location(), term->type(), get(term->term1()).release(),
-                                                get(term->term2()).release(), get(term->term3()).release());
+                                                get(term->term2()).release(), get(term->term3()).release(),
+                                                term->map_type());
 }
 
 void TermMapper::Visit(const NilTerm* term) {
-  result_[term] = std::make_unique<NilTerm>(term->location(), term->list_type()->clone());
+  result_[term] = std::make_unique<NilTerm>(term->location(), term->list_type());
 }
 
 void TermMapper::Visit(const VariableTerm* term) {
@@ -54,39 +132,120 @@ void TermMapper::Visit(const RecordTerm* term) {
   auto record_term = std::make_unique<RecordTerm>(term->location());
 
   for (size_t i = 0; i < term->size(); ++i) {
-    term->get(i).second->Accept(this);
     record_term->add(term->get(i).first, get(term->get(i).second).release());
   }
   result_[term] = std::move(record_term);
 }
 
 void TermMapper::Visit(const ProjectTerm* term) {
-  term->term()->Accept(this);
-  result_[term] = std::make_unique<ProjectTerm>(term->location(), get(term->term()).release(), term->field());
+  result_[term] = std::make_unique<ProjectTerm>(term->location(), get(term->term()).release(), term->field(),
+                                                term->slot());
 }
 
-void TermMapper::Visit(const LetTerm* term) {
-  term->bind_term()->Accept(this);
-  ++depth_; term->body_term()->Accept(this); --depth_;
+void TermMapper::Visit(const RecordUpdateTerm* term) {
+  auto update_term = std::make_unique<RecordUpdateTerm>(term->location(), get(term->term()).release());
+
+  for (size_t i = 0; i < term->size(); ++i) {
+    const RecordUpdateTerm::Update& update = term->get(i);
+    update_term->add(update.field, get(update.term).release(), update.slot);
+  }
+  result_[term] = std::move(update_term);
+}
 
+void TermMapper::Visit(const LetTerm* term) {
   result_[term] = std::make_unique<LetTerm>(term->location(), term->variable(),
                                             get(term->bind_term()).release(), get(term->body_term()).release());
 }
 
 void TermMapper::Visit(const AbsTerm* term) {
-  ++depth_; term->term()->Accept(this); --depth_;
-
-  result_[term] = std::make_unique<AbsTerm>(term->location(), term->variable(), term->variable_type()->clone(),
+  result_[term] = std::make_unique<AbsTerm>(term->location(), term->variable(), term->variable_type(),
                                             get(term->term()).release());
 }
 
 void TermMapper::Visit(const AscribeTerm* term) {
-  term->term()->Accept(this);
-
   result_[term] = std::make_unique<AscribeTerm>(term->location(), get(term->term()).release(),
                                                 term->ascribe_type()->clone());
 }
 
+void TermMapper::Visit(const VariantTerm* term) {
+  result_[term] = std::make_unique<VariantTerm>(term->location(), term->tag(), get(term->term()).release(),
+                                                term->variant_type(), term->index());
+}
+
+void TermMapper::Visit(const CaseTerm* term) {
+  auto case_term = std::make_unique<CaseTerm>(term->location(), get(term->term()).release());
+
+  for (size_t i = 0; i < term->size(); ++i) {
+    const CaseTerm::Branch& branch = term->get(i);
+    case_term->add(branch.tag, branch.variable, get(branch.body).release());
+  }
+  result_[term] = std::move(case_term);
+}
+
+void TermMapper::Visit(const MatchTerm* term) {
+  result_[term] = std::make_unique<MatchTerm>(term->location(), term->type(), get(term->term()).release(),
+                                              get(term->empty_arm()).release(), term->variables(),
+                                              get(term->cell_arm()).release());
+}
+
+void TermMapper::Visit(const LetRecTerm* term) {
+  std::shared_ptr<const LetRecTerm::Bindings> bindings = term->bindings();
+  bool closed = term->closed();
+
+  // A closed group is left unchanged, so all copies of the term share it.
+  if (!closed) {
+    auto mapped_bindings = std::make_shared<LetRecTerm::Bindings>();
+    mapped_bindings->reserve(term->size());
+    for (size_t i = 0; i < term->size(); ++i) {
+      const LetRecTerm::Binding& binding = term->get(i);
+      mapped_bindings->push_back({binding.variable, binding.type, get(binding.term)});
+    }
+    closed = IsClosedGroup(*mapped_bindings);
+    bindings = std::move(mapped_bindings);
+  }
+
+  result_[term] = std::make_unique<LetRecTerm>(term->location(), std::move(bindings), get(term->body()).release(),
+                                               closed, term->closed() ? term->first() : 0);
+}
+
+void TermMapper::Visit(const SharedTerm* term) {
+  // A shared value has no free variable, so the handle is left as it is.
+  result_[term] = std::make_unique<SharedTerm>(term->location(), term->value());
+}
+
+void TermMapper::Visit(const PackedListTerm* term) {
+  result_[term] = unique_ptr<Term>(term->clone());
+}
+
+void TermMapper::Visit(const ArrayTerm* term) {
+  auto array_term = std::make_unique<ArrayTerm>(term->location(), term->element_type());
+
+  array_term->reserve(term->size());
+  for (size_t i = 0; i < term->size(); ++i) {
+    array_term->add(get(term->get(i)).release());
+  }
+  result_[term] = std::move(array_term);
+}
+
+void TermMapper::Visit(const RefTerm* term) {
+  // The value in the cell is shifted when it is read, see 'RefCell'.
+  result_[term] = unique_ptr<Term>(term->clone());
+}
+
+void TermMapper::Visit(const MapTerm* term) {
+  if (term->closed()) {
+    result_[term] = unique_ptr<Term>(term->clone());
+    return;
+  }
+  // Rebuilds the map, which is rare as closed maps are mostly shared before being mapped.
+  Hamt hamt;
+  term->hamt()->ForEach([this, &hamt](const Term* key, const Term* value) {
+    hamt = hamt.Insert(stored(unique_ptr<Term>(key->clone())), stored(get(value)));
+  });
+  result_[term] = std::make_unique<MapTerm>(term->location(), term->key_type(), term->value_type(),
+                                            std::make_shared<const Hamt>(std::move(hamt)), false);
+}
+
 unique_ptr<Term> TermShifter::VariableMap(Location location, int var) {
   // <var> >= <depth> means this variable is a free variable.
   return std::make_unique<VariableTerm>(location, var >= depth() ? var + delta_ : var);
@@ -102,10 +261,519 @@ unique_ptr<Term> TermSubstituter::VariableMap(Location location, int var) {
   return std::make_unique<VariableTerm>(location, var);
 }
 
+void TermEraser::Visit(const AscribeTerm* term) {
+  set(term, get(term->term()));
+}
+
+unique_ptr<Term> TermEraser::VariableMap(Location location, int var) {
+  return std::make_unique<VariableTerm>(location, var);
+}
+
+unique_ptr<Term> TermExtractor::Extract(const Term* term) {
+  Arena::HeapScope heap_scope;
+  unique_ptr<Term> ret = Map(term);
+  extracted_.clear();
+  return ret;
+}
+
+void TermExtractor::Visit(const SharedTerm* term) {
+  const Term* const value = term->value().get();
+  if (!Arena::Owns(value)) {
+    TermMapper::Visit(term);
+    return;
+  }
+  // The value is mapped before the first handle of it, see Expand().
+  std::shared_ptr<Term>& extracted = extracted_[value];
+  if (extracted == nullptr) {
+    extracted = std::shared_ptr<Term>(get(value).release(), CellPool::Recycle);
+  }
+  set(term, std::make_unique<SharedTerm>(term->location(), extracted));
+}
+
+void TermExtractor::Visit(const LetRecTerm* term) {
+  // A closed group is shared by the copies of the term rather than mapped, so it is only copied here.
+  if (!term->closed() || !Arena::Owns(term->get(0).term.get())) {
+    TermMapper::Visit(term);
+    return;
+  }
+  auto bindings = std::make_shared<LetRecTerm::Bindings>();
+  bindings->reserve(term->size());
+  for (size_t i = 0; i < term->size(); ++i) {
+    const LetRecTerm::Binding& binding = term->get(i);
+    bindings->push_back({binding.variable, binding.type, get(binding.term)});
+  }
+  set(term, std::make_unique<LetRecTerm>(term->location(), std::move(bindings), get(term->body()).release(), true));
+}
+
+void TermExtractor::Expand(const Term* term) {
+  const SharedTerm* const shared_term = dyn_cast<SharedTerm>(term);
+  if (shared_term != nullptr) {
+    const Term* const value = shared_term->value().get();
+    if (Arena::Owns(value) && extracted_.find(value) == extracted_.end()) {
+      MapBefore(value);
+    }
+    return;
+  }
+  const LetRecTerm* const letrec_term = dyn_cast<LetRecTerm>(term);
+  if (letrec_term != nullptr && letrec_term->closed() && Arena::Owns(letrec_term->get(0).term.get())) {
+    for (size_t i = 0; i < letrec_term->size(); ++i) {
+      MapBefore(letrec_term->get(i).term.get(), letrec_term->size());
+    }
+  }
+  TermMapper::Expand(term);
+}
+
+unique_ptr<Term> TermExtractor::VariableMap(Location location, int var) {
+  return std::make_unique<VariableTerm>(location, var);
+}
+
 namespace {
 
+struct Pool {
+  std::vector<Term*> cons_cells;
+  std::vector<Term*> record_cells;
+  CellPool::Stats stats;
+};
+
+const size_t kMaxPoolSize = 4096;
+
+// Intentionally leaked, shared values released during static destruction still get recycled here.
+Pool* pool() {
+  static Pool* const pool = new Pool();
+  return pool;
+}
+
 template <typename T>
-T* term_cast(Term* ptr) { return dynamic_cast<T*>(ptr); }
+T* pop_cell(std::vector<Term*>* cells) {
+  // Pooled cells are on the heap, and a cell built in an arena could refer to the arena. Cells of an arena are reused
+  // through its free lists instead, see Recycle().
+  if (cells->empty() || Arena::current() != nullptr) {
+    ++pool()->stats.allocated;
+    return nullptr;
+  }
+  T* const cell = static_cast<T*>(cells->back());
+  cells->pop_back();
+  ++pool()->stats.reused;
+  return cell;
+}
+
+}  // namespace
+
+unique_ptr<Term> CellPool::NewCons(Location location, Term* head, Term* tail) {
+  BinaryTerm* const cell = pop_cell<BinaryTerm>(&pool()->cons_cells);
+  if (cell == nullptr) {
+    return std::make_unique<BinaryTerm>(location, BinaryTermToken::Cons, head, tail);
+  }
+  cell->relocate(location);
+  cell->term1().reset(head);
+  cell->term2().reset(tail);
+  cell->set_cached_hash(0);
+  return unique_ptr<Term>(cell);
+}
+
+unique_ptr<RecordTerm> CellPool::NewRecord(Location location) {
+  RecordTerm* const cell = pop_cell<RecordTerm>(&pool()->record_cells);
+  if (cell == nullptr) {
+    return std::make_unique<RecordTerm>(location);
+  }
+  cell->relocate(location);
+  return unique_ptr<RecordTerm>(cell);
+}
+
+void CellPool::Recycle(Term* cell) {
+  std::vector<Term*>* cells = nullptr;
+
+  BinaryTerm* const binary_term = dyn_cast<BinaryTerm>(cell);
+  RecordTerm* const record_term = dyn_cast<RecordTerm>(cell);
+  if (binary_term != nullptr && binary_term->type() == BinaryTermToken::Cons) {
+    Term::Release(binary_term->term1());
+    Term::Release(binary_term->term2());
+    cells = &pool()->cons_cells;
+  } else if (record_term != nullptr) {
+    record_term->clear();
+    cells = &pool()->record_cells;
+  }
+
+  // A cell of the arena goes back to its free list, where the next term of its size picks it up.
+  if (cells == nullptr || cells->size() >= kMaxPoolSize || Arena::Owns(cell)) {
+    delete cell;
+  } else {
+    cells->push_back(cell);
+  }
+}
+
+const CellPool::Stats& CellPool::stats() {
+  return pool()->stats;
+}
+
+void CellPool::ResetStats() {
+  pool()->stats = Stats();
+}
+
+namespace {
+
+// The most elements a builtin builds a list or an array of at once, e.g. 'range', so that a huge size is a runtime
+// error rather than an allocation failure.
+const uint64_t kMaxBuiltinSize = uint64_t{1} << 28;
+
+// Checks whether a term has no free variable.
+class ClosedTermChecker : public Visitor<Term> {
+ public:
+  // Variables with deBruijn index less than <depth> are bound outside of the checked term.
+  explicit ClosedTermChecker(int depth = 0) : depth_(depth) { }
+  TermVisitorOverrides;
+
+  bool IsClosed(const Term* term) {
+    term->Accept(this);
+    return closed_;
+  }
+
+ private:
+  int depth_;
+  bool closed_ = true;
+};
+
+void ClosedTermChecker::Visit(const NullaryTerm* term) { }
+
+void ClosedTermChecker::Visit(const NatTerm* term) { }
+
+void ClosedTermChecker::Visit(const UnaryTerm* term) {
+  term->term()->Accept(this);
+}
+
+void ClosedTermChecker::Visit(const BinaryTerm* term) {
+  term->term1()->Accept(this);
+  term->term2()->Accept(this);
+}
+
+void ClosedTermChecker::Visit(const TernaryTerm* term) {
+  term->term1()->Accept(this);
+  term->term2()->Accept(this);
+  term->term3()->Accept(this);
+}
+
+void ClosedTermChecker::Visit(const NilTerm* term) { }
+
+void ClosedTermChecker::Visit(const VariableTerm* term) {
+  if (term->index() >= depth_) {
+    closed_ = false;
+  }
+}
+
+void ClosedTermChecker::Visit(const RecordTerm* term) {
+  for (size_t i = 0; i < term->size(); ++i) {
+    term->get(i).second->Accept(this);
+  }
+}
+
+void ClosedTermChecker::Visit(const ProjectTerm* term) {
+  term->term()->Accept(this);
+}
+
+void ClosedTermChecker::Visit(const RecordUpdateTerm* term) {
+  term->term()->Accept(this);
+  for (size_t i = 0; i < term->size(); ++i) {
+    term->get(i).term->Accept(this);
+  }
+}
+
+void ClosedTermChecker::Visit(const LetTerm* term) {
+  term->bind_term()->Accept(this);
+  ++depth_; term->body_term()->Accept(this); --depth_;
+}
+
+void ClosedTermChecker::Visit(const AbsTerm* term) {
+  ++depth_; term->term()->Accept(this); --depth_;
+}
+
+void ClosedTermChecker::Visit(const AscribeTerm* term) {
+  term->term()->Accept(this);
+}
+
+void ClosedTermChecker::Visit(const VariantTerm* term) {
+  term->term()->Accept(this);
+}
+
+void ClosedTermChecker::Visit(const CaseTerm* term) {
+  term->term()->Accept(this);
+  for (size_t i = 0; i < term->size(); ++i) {
+    ++depth_; term->get(i).body->Accept(this); --depth_;
+  }
+}
+
+void ClosedTermChecker::Visit(const MatchTerm* term) {
+  term->term()->Accept(this);
+  term->empty_arm()->Accept(this);
+  depth_ += term->variables().size(); term->cell_arm()->Accept(this); depth_ -= term->variables().size();
+}
+
+void ClosedTermChecker::Visit(const LetRecTerm* term) {
+  depth_ += term->size();
+  if (!term->closed()) {
+    for (size_t i = 0; i < term->size(); ++i) {
+      term->get(i).term->Accept(this);
+    }
+  }
+  term->body()->Accept(this);
+  depth_ -= term->size();
+}
+
+void ClosedTermChecker::Visit(const SharedTerm* term) { }
+
+void ClosedTermChecker::Visit(const PackedListTerm* term) { }
+
+void ClosedTermChecker::Visit(const RefTerm* term) { }
+
+void ClosedTermChecker::Visit(const MapTerm* term) {
+  if (!term->closed()) {
+    closed_ = false;
+  }
+}
+
+void ClosedTermChecker::Visit(const ArrayTerm* term) {
+  for (size_t i = 0; i < term->size(); ++i) {
+    term->get(i)->Accept(this);
+  }
+}
+
+bool IsClosedGroup(const LetRecTerm::Bindings& bindings) {
+  for (const LetRecTerm::Binding& binding : bindings) {
+    if (!ClosedTermChecker(bindings.size()).IsClosed(binding.term.get())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the value behind a shared handle, or <value> itself if it is not shared.
+Term* deref(const unique_ptr<Term>& value) {
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(value.get());
+  return shared_term != nullptr ? shared_term->value().get() : value.get();
+}
+
+// Wraps a closed value into a shared handle, open values are left unchanged.
+unique_ptr<Term> share(unique_ptr<Term> value) {
+  if (dyn_cast<SharedTerm>(value.get()) != nullptr || !ClosedTermChecker().IsClosed(value.get())) {
+    return value;
+  }
+  const Location location = value->location();
+  return std::make_unique<SharedTerm>(location, std::shared_ptr<Term>(value.release(), CellPool::Recycle));
+}
+
+// Returns <value> in a form that outlives the arena of the current statement, for values kept beyond the statement,
+// e.g. in a reference cell. Values from outside of the arena are returned unchanged.
+unique_ptr<Term> stored(unique_ptr<Term> value) {
+  if (!Arena::Owns(value.get())) {
+    return value;
+  }
+  return TermExtractor().Extract(value.get());
+}
+
+// Shares a stored closed value of <type> with the equal ones if hash-consing is enabled.
+unique_ptr<Term> interned(Context* ctx, unique_ptr<Term> value, const TermType* type) {
+  return HashCons::enabled() ? HashCons::Value(ctx, std::move(value), type) : std::move(value);
+}
+
+// Whether the evaluator holds the only reference of a shared value, so that the value could be taken apart or updated
+// in place. Values from before the arena of the current statement outlive it, and must not refer to the arena.
+bool unique(const SharedTerm* shared_term) {
+  return shared_term->unique() && (Arena::current() == nullptr || Arena::Owns(shared_term->value().get()));
+}
+
+// Takes the subterm <child> out of the cell <value> refers to. If <value> holds the only reference of the cell, the
+// subterm is moved out and the cell is recycled, otherwise a handle sharing the subterm is returned, so that taking a
+// subterm never copies.
+unique_ptr<Term> take(unique_ptr<Term> value, unique_ptr<Term>* child) {
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(value.get());
+
+  if (shared_term == nullptr) {
+    unique_ptr<Term> ret = std::move(*child);
+    CellPool::Recycle(value.release());
+    return ret;
+  }
+  if (unique(shared_term)) {
+    // The cell is recycled by the deleter of the handle when <value> goes out of scope.
+    return std::move(*child);
+  }
+  SharedTerm* const shared_child = dyn_cast<SharedTerm>(child->get());
+  if (shared_child != nullptr) {
+    return std::make_unique<SharedTerm>(shared_child->location(), shared_child->value());
+  }
+  // The handle to the subterm keeps the whole cell alive.
+  return std::make_unique<SharedTerm>((*child)->location(), std::shared_ptr<Term>(shared_term->value(), child->get()));
+}
+
+// Same as <take>, but leaves the cell to <value>, so that several subterms could be taken out of it one by one.
+unique_ptr<Term> share_child(const unique_ptr<Term>& value, unique_ptr<Term>* child) {
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(value.get());
+
+  if (shared_term == nullptr || unique(shared_term)) {
+    return std::move(*child);
+  }
+  SharedTerm* const shared_child = dyn_cast<SharedTerm>(child->get());
+  if (shared_child != nullptr) {
+    return std::make_unique<SharedTerm>(shared_child->location(), shared_child->value());
+  }
+  return std::make_unique<SharedTerm>((*child)->location(), std::shared_ptr<Term>(shared_term->value(), child->get()));
+}
+
+// Takes both subterms out of the cell <value> refers to, see <take>.
+std::pair<unique_ptr<Term>, unique_ptr<Term>> take_both(unique_ptr<Term> value, unique_ptr<Term>* child1,
+                                                        unique_ptr<Term>* child2) {
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(value.get());
+
+  if (shared_term != nullptr && !unique(shared_term)) {
+    unique_ptr<Term> other = std::make_unique<SharedTerm>(shared_term->location(), shared_term->value());
+    unique_ptr<Term> first = take(std::move(value), child1);
+    return {std::move(first), take(std::move(other), child2)};
+  }
+  unique_ptr<Term> first = std::move(*child1);
+  return {std::move(first), take(std::move(value), child2)};
+}
+
+const Term* deref(const Term* value) {
+  const SharedTerm* const shared_term = dyn_cast<SharedTerm>(value);
+  return shared_term != nullptr ? shared_term->value().get() : value;
+}
+
+uint64_t nat_of(const Term* value) {
+  return cast<NatTerm>(deref(value))->value();
+}
+
+// Returns the Nat <n>, reusing the cell of <value> if no one else refers to it.
+unique_ptr<Term> set_nat(unique_ptr<Term> value, Location location, uint64_t n) {
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(value.get());
+
+  if (shared_term == nullptr) {
+    cast<NatTerm>(value.get())->set_value(n);
+    value->relocate(location);
+    return value;
+  }
+  if (shared_term->unique()) {
+    cast<NatTerm>(shared_term->value().get())->set_value(n);
+    return value;
+  }
+  return std::make_unique<NatTerm>(location, n);
+}
+
+// Element of a packed list as a term.
+unique_ptr<Term> element_of(const PackedCells& cells, size_t i, Location location) {
+  if (cells.kind == PackedCells::Kind::Nat) {
+    return std::make_unique<NatTerm>(location, cells.values[i]);
+  }
+  return std::make_unique<NullaryTerm>(location, cells.values[i] ? NullaryTermToken::True : NullaryTermToken::False);
+}
+
+const uint64_t* data_of(const PackedListTerm* packed_term) {
+  return packed_term->cells()->values.data() + packed_term->begin();
+}
+
+// Walks a list value in order, <cell> is called with the head of each cons cell and <run> with the packed tail if
+// there is one. Returns the end of the list, i.e. the nil or the packed tail. Runs in a loop, so long lists do not
+// grow the stack.
+template <typename CellFn, typename RunFn>
+const Term* walk_list(const Term* list, CellFn cell, RunFn run) {
+  for (;;) {
+    list = deref(list);
+    const BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(list);
+    if (cons_term == nullptr) {
+      break;
+    }
+    cell(cons_term->term1().get());
+    list = cons_term->term2().get();
+  }
+  const PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(list);
+  if (packed_term != nullptr) {
+    run(packed_term);
+  }
+  return list;
+}
+
+// Calls <fn> with a copy of each element of a list value in order. Returns the end of the list like <walk_list>.
+template <typename Fn>
+const Term* for_each_element(const Term* list, Location location, Fn fn) {
+  return walk_list(list,
+                   [&](const Term* head) { fn(unique_ptr<Term>(head->clone())); },
+                   [&](const PackedListTerm* run) {
+                     for (size_t i = run->begin(); i < run->end(); ++i) {
+                       fn(element_of(*run->cells(), i, location));
+                     }
+                   });
+}
+
+// Element type of the list ending with <end>, i.e. the type of its nil.
+const SharedTermType& element_type_of(const Term* end) {
+  const PackedListTerm* const packed_end = dyn_cast<PackedListTerm>(end);
+  return packed_end != nullptr ? packed_end->cells()->list_type : cast<NilTerm>(end)->list_type();
+}
+
+// Elements of a List[Nat] value, they are copied into <storage> unless the list is packed as a whole.
+std::pair<const uint64_t*, size_t> nat_elements(const Term* list, std::vector<uint64_t>* storage) {
+  const PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(deref(list));
+  if (packed_term != nullptr) {
+    return {data_of(packed_term), packed_term->size()};
+  }
+  walk_list(list,
+            [&](const Term* head) { storage->push_back(nat_of(head)); },
+            [&](const PackedListTerm* run) {
+              storage->insert(storage->end(), data_of(run), data_of(run) + run->size());
+            });
+  return {storage->data(), storage->size()};
+}
+
+// Returns an array that can be updated in place, <value> itself if no one else refers to it, or a copy otherwise.
+// Elements are mostly shared handles, so the copy does not go deeper than the array.
+unique_ptr<Term> writable(unique_ptr<Term> value) {
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(value.get());
+  if (shared_term == nullptr || unique(shared_term)) {
+    return value;
+  }
+  return unique_ptr<Term>(shared_term->value()->clone());
+}
+
+// Lists shorter than this are left as cons cells, the kernels gain nothing on them.
+const size_t kMinPackedLength = 8;
+
+// Packs a list of Nats or Bools of at least kMinPackedLength cons cells, other values are returned unchanged. A list
+// ending with a packed tail is also left unchanged: the tail is shared rather than copied, so 'cons' stays constant
+// time.
+unique_ptr<Term> pack(unique_ptr<Term> value) {
+  const BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(value.get());
+  if (cons_term == nullptr || cons_term->type() != BinaryTermToken::Cons) {
+    return value;
+  }
+
+  PackedCells::Kind kind;
+  const Term* const head = deref(cons_term->term1().get());
+  const NullaryTerm* const bool_term = dyn_cast<NullaryTerm>(head);
+  if (dyn_cast<NatTerm>(head) != nullptr) {
+    kind = PackedCells::Kind::Nat;
+  } else if (bool_term != nullptr && bool_term->type() != NullaryTermToken::Unit) {
+    kind = PackedCells::Kind::Bool;
+  } else {
+    return value;
+  }
+
+  std::vector<uint64_t> values;
+  bool packed_tail = false;
+  const Term* const end = walk_list(
+      value.get(),
+      [&](const Term* head) {
+        if (kind == PackedCells::Kind::Nat) {
+          values.push_back(nat_of(head));
+        } else {
+          values.push_back(cast<NullaryTerm>(deref(head))->type() == NullaryTermToken::True);
+        }
+      },
+      [&](const PackedListTerm* run) { packed_tail = true; });
+  if (packed_tail || values.size() < kMinPackedLength) {
+    return value;
+  }
+
+  const size_t size = values.size();
+  auto cells = std::make_shared<const PackedCells>(kind, std::move(values), element_type_of(end));
+  return std::make_unique<PackedListTerm>(value->location(), std::move(cells), 0, size);
+}
 
 }  // namespace
 
@@ -113,77 +781,210 @@ T* term_cast(Term* ptr) { return dynamic_cast<T*>(ptr); }
 #define DieGuardedByTypeChecker() assert(false && "death guarded by type-checker")
 
 unique_ptr<Term> TermEvaluator::Evaluate(const Term* term) {
-  term->Accept(this);
+  const unique_ptr<Term> erased = TermEraser().Erase(term);
+  // Closed values are handed out as handles, so later references to them (e.g. from context) share the value.
+  return share(pack(Run(erased.get())));
+}
+
+unique_ptr<Term> TermEvaluator::Run(const Term* term) {
+  try {
+    term->Accept(this);
+  } catch (...) {
+    // Values left behind could be allocated from an arena, which is released right after the failed statement.
+    result_.clear();
+    throw;
+  }
   unique_ptr<Term> ret = eval(term);
   result_.clear();
   return ret;
 }
 
 void TermEvaluator::Visit(const NullaryTerm* term) {
+  if (term->type() == NullaryTermToken::Zero) {
+    result_[term] = std::make_unique<NatTerm>(term->location(), 0);
+  } else {
+    result_[term] = std::unique_ptr<Term>(term->clone());
+  }
+}
+
+void TermEvaluator::Visit(const NatTerm* term) {
   result_[term] = std::unique_ptr<Term>(term->clone());
 }
 
 void TermEvaluator::Visit(const UnaryTerm* term) {
   term->term()->Accept(this);
   unique_ptr<Term> subterm = eval(term->term());
+  Term* const value = deref(subterm);
 
   switch (term->type()) {
     case UnaryTermToken::Pred: {
-      NullaryTerm* const zero_term = term_cast<NullaryTerm>(subterm.get());
-      UnaryTerm* const succ_term = term_cast<UnaryTerm>(subterm.get());
-      if (zero_term != nullptr && zero_term->type() == NullaryTermToken::Zero) {
-        result_[term] = std::make_unique<NullaryTerm>(term->location(), NullaryTermToken::Zero);
-      } else if (succ_term != nullptr && succ_term->type() == UnaryTermToken::Succ) {
-        result_[term] = std::move(succ_term->term());
-      } else {
-        DieGuardedByTypeChecker();
-      }
+      const uint64_t nat = nat_of(value);
+      result_[term] = set_nat(std::move(subterm), term->location(), nat == 0 ? 0 : nat - 1);
     } break;
     case UnaryTermToken::Succ: {
-      result_[term] = std::make_unique<UnaryTerm>(term->location(), UnaryTermToken::Succ, subterm.release());
+      const uint64_t nat = nat_of(value);
+      result_[term] = set_nat(std::move(subterm), term->location(), nat + 1);
     } break;
     case UnaryTermToken::IsZero: {
-      NullaryTerm* const zero_term = term_cast<NullaryTerm>(subterm.get());
-      UnaryTerm* const succ_term = term_cast<UnaryTerm>(subterm.get());
-      if (zero_term != nullptr && zero_term->type() == NullaryTermToken::Zero) {
-        result_[term] = std::make_unique<NullaryTerm>(term->location(), NullaryTermToken::True);
-      } else if (succ_term != nullptr && succ_term->type() == UnaryTermToken::Succ) {
-        result_[term] = std::make_unique<NullaryTerm>(term->location(), NullaryTermToken::False);
-      } else {
-        DieGuardedByTypeChecker();
-      }
+      const bool is_zero = nat_of(value) == 0;
+      result_[term] = std::make_unique<NullaryTerm>(term->location(),
+                                                    is_zero ? NullaryTermToken::True : NullaryTermToken::False);
     } break;
     case UnaryTermToken::Head: {
-      NilTerm* const nil_term = term_cast<NilTerm>(subterm.get());
-      BinaryTerm* const cons_term = term_cast<BinaryTerm>(subterm.get());
-      if (nil_term != nullptr) {
+      NilTerm* const nil_term = dyn_cast<NilTerm>(value);
+      BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(value);
+      PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(value);
+      if (nil_term != nullptr || (packed_term != nullptr && packed_term->size() == 0)) {
         throw runtime_exception(term->location(), "<head> on an empty list");
       } else if (cons_term != nullptr && cons_term->type() == BinaryTermToken::Cons) {
-        result_[term] = std::move(cons_term->term1());
+        result_[term] = take(std::move(subterm), &cons_term->term1());
+      } else if (packed_term != nullptr) {
+        result_[term] = element_of(*packed_term->cells(), packed_term->begin(), term->location());
       } else {
         DieGuardedByTypeChecker();
       }
     } break;
     case UnaryTermToken::Tail: {
-      NilTerm* const nil_term = term_cast<NilTerm>(subterm.get());
-      BinaryTerm* const cons_term = term_cast<BinaryTerm>(subterm.get());
-      if (nil_term != nullptr) {
+      NilTerm* const nil_term = dyn_cast<NilTerm>(value);
+      BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(value);
+      PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(value);
+      if (nil_term != nullptr || (packed_term != nullptr && packed_term->size() == 0)) {
         throw runtime_exception(term->location(), "<tail> on an empty list");
       } else if (cons_term != nullptr && cons_term->type() == BinaryTermToken::Cons) {
-        result_[term] = std::move(cons_term->term2());
+        result_[term] = take(std::move(subterm), &cons_term->term2());
+      } else if (packed_term != nullptr) {
+        result_[term] = std::make_unique<PackedListTerm>(term->location(), packed_term->cells(),
+                                                         packed_term->begin() + 1, packed_term->end());
       } else {
         DieGuardedByTypeChecker();
       }
     } break;
     case UnaryTermToken::IsNil: {
-      NilTerm* const nil_term = term_cast<NilTerm>(subterm.get());
+      NilTerm* const nil_term = dyn_cast<NilTerm>(value);
+      PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(value);
+      const bool is_nil = nil_term != nullptr || (packed_term != nullptr && packed_term->size() == 0);
       result_[term] = std::make_unique<NullaryTerm>(term->location(),
-                                                    nil_term ? NullaryTermToken::True : NullaryTermToken::False);
+                                                    is_nil ? NullaryTermToken::True : NullaryTermToken::False);
+    } break;
+    case UnaryTermToken::Sum: {
+      uint64_t sum = 0;
+      walk_list(value,
+                [&](const Term* head) { sum += nat_of(head); },
+                [&](const PackedListTerm* run) { sum += packed::Sum(data_of(run), run->size()); });
+      result_[term] = std::make_unique<NatTerm>(term->location(), sum);
+    } break;
+    case UnaryTermToken::Maximum: {
+      uint64_t maximum = 0;
+      size_t length = 0;
+      walk_list(value,
+                [&](const Term* head) {
+                  maximum = std::max(maximum, nat_of(head));
+                  ++length;
+                },
+                [&](const PackedListTerm* run) {
+                  if (run->size() != 0) {
+                    maximum = std::max(maximum, packed::Maximum(data_of(run), run->size()));
+                    length += run->size();
+                  }
+                });
+      if (length == 0) {
+        throw runtime_exception(term->location(), "<maximum> on an empty list");
+      }
+      result_[term] = std::make_unique<NatTerm>(term->location(), maximum);
+    } break;
+    case UnaryTermToken::Length: {
+      size_t length = 0;
+      walk_list(value,
+                [&](const Term* head) { ++length; },
+                [&](const PackedListTerm* run) { length += run->size(); });
+      result_[term] = std::make_unique<NatTerm>(term->location(), length);
+    } break;
+    case UnaryTermToken::Reverse: {
+      PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(value);
+      if (packed_term != nullptr) {
+        // Stays packed.
+        std::vector<uint64_t> values(data_of(packed_term), data_of(packed_term) + packed_term->size());
+        std::reverse(values.begin(), values.end());
+        const size_t size = values.size();
+        auto cells = std::make_shared<const PackedCells>(packed_term->cells()->kind, std::move(values),
+                                                         packed_term->cells()->list_type);
+        result_[term] = std::make_unique<PackedListTerm>(term->location(), std::move(cells), 0, size);
+        break;
+      }
+      std::vector<unique_ptr<Term>> elements;
+      const Term* const end = for_each_element(value, term->location(), [&](unique_ptr<Term> element) {
+        elements.push_back(std::move(element));
+      });
+      // Consing the elements in order builds the list backwards.
+      unique_ptr<Term> list = std::make_unique<NilTerm>(term->location(), element_type_of(end));
+      for (unique_ptr<Term>& element : elements) {
+        list = CellPool::NewCons(term->location(), element.release(), list.release());
+      }
+      result_[term] = std::move(list);
+    } break;
+    case UnaryTermToken::ArrayLength: {
+      ArrayTerm* const array_term = dyn_cast<ArrayTerm>(value);
+      if (array_term != nullptr) {
+        result_[term] = std::make_unique<NatTerm>(term->location(), array_term->size());
+      } else {
+        DieGuardedByTypeChecker();
+      }
+    } break;
+    case UnaryTermToken::ArrayOfList: {
+      std::vector<unique_ptr<Term>> elements;
+      const Term* const end = for_each_element(value, term->location(), [&](unique_ptr<Term> element) {
+        elements.push_back(share(std::move(element)));
+      });
+
+      auto array_term = std::make_unique<ArrayTerm>(term->location(), element_type_of(end));
+      array_term->reserve(elements.size());
+      for (unique_ptr<Term>& element : elements) {
+        array_term->add(element.release());
+      }
+      result_[term] = std::move(array_term);
+    } break;
+    case UnaryTermToken::ListOfArray: {
+      ArrayTerm* const array_term = dyn_cast<ArrayTerm>(value);
+      if (array_term != nullptr) {
+        unique_ptr<Term> list = std::make_unique<NilTerm>(term->location(), array_term->element_type());
+        for (size_t i = array_term->size(); i > 0; --i) {
+          list = CellPool::NewCons(term->location(), array_term->get(i - 1)->clone(), list.release());
+        }
+        result_[term] = std::move(list);
+      } else {
+        DieGuardedByTypeChecker();
+      }
     } break;
     case UnaryTermToken::Fix: {
-      AbsTerm* const abs_term = term_cast<AbsTerm>(subterm.get());
+      AbsTerm* const abs_term = dyn_cast<AbsTerm>(value);
       if (abs_term != nullptr) {
-        result_[term] = Substitute(abs_term->term().get(), term);
+        // Unfolds with the evaluated body instead of <term>, as shared values in <term> may have been consumed.
+        const UnaryTerm fix_term(term->location(), UnaryTermToken::Fix, subterm.release());
+        result_[term] = Substitute(abs_term->term().get(), &fix_term);
+      } else {
+        DieGuardedByTypeChecker();
+      }
+    } break;
+    case UnaryTermToken::MapSize: {
+      MapTerm* const map_term = dyn_cast<MapTerm>(value);
+      if (map_term != nullptr) {
+        result_[term] = std::make_unique<NatTerm>(term->location(), map_term->hamt()->size());
+      } else {
+        DieGuardedByTypeChecker();
+      }
+    } break;
+    case UnaryTermToken::Ref: {
+      unique_ptr<Term> content = stored(share(std::move(subterm)));
+      content = HashCons::Value(ctx_, std::move(content), term->value_type().get());
+      auto cell = std::make_shared<RefCell>(RefCell{std::move(content), ctx_->size()});
+      result_[term] = std::make_unique<RefTerm>(term->location(), term->value_type(), std::move(cell));
+    } break;
+    case UnaryTermToken::Deref: {
+      RefTerm* const ref_term = dyn_cast<RefTerm>(value);
+      if (ref_term != nullptr) {
+        // Closed values are shared with the cell, open ones are shifted over the bindings added since stored.
+        const RefCell& cell = *ref_term->cell();
+        result_[term] = TermShifter(static_cast<int>(ctx_->size() - cell.context_size)).TermShift(cell.value.get());
       } else {
         DieGuardedByTypeChecker();
       }
@@ -199,17 +1000,143 @@ void TermEvaluator::Visit(const BinaryTerm* term) {
 
   switch (term->type()) {
     case BinaryTermToken::Cons: {
-      result_[term] = std::make_unique<BinaryTerm>(term->location(), BinaryTermToken::Cons,
-                                                   subterm1.release(), subterm2.release());
+      result_[term] = CellPool::NewCons(term->location(), subterm1.release(), subterm2.release());
     } break;
     case BinaryTermToken::App: {
-      AbsTerm* const abs_term = term_cast<AbsTerm>(subterm1.get());
-      if (abs_term != nullptr) {
-        result_[term] = Substitute(abs_term->term().get(), subterm2.get());
+      if (dyn_cast<AbsTerm>(deref(subterm1)) != nullptr) {
+        result_[term] = Apply(std::move(subterm1), std::move(subterm2));
+      } else {
+        DieGuardedByTypeChecker();
+      }
+    } break;
+    case BinaryTermToken::Equal: {
+      const bool equal = EqualValues(subterm1.get(), subterm2.get());
+      result_[term] = std::make_unique<NullaryTerm>(term->location(),
+                                                    equal ? NullaryTermToken::True : NullaryTermToken::False);
+    } break;
+    case BinaryTermToken::Append: {
+      std::vector<unique_ptr<Term>> elements;
+      for_each_element(subterm1.get(), term->location(), [&](unique_ptr<Term> element) {
+        elements.push_back(std::move(element));
+      });
+      // The second list is shared as the tail of the result, only the first one is copied.
+      unique_ptr<Term> list = std::move(subterm2);
+      for (size_t i = elements.size(); i > 0; --i) {
+        list = CellPool::NewCons(term->location(), elements[i - 1].release(), list.release());
+      }
+      result_[term] = std::move(list);
+    } break;
+    case BinaryTermToken::Nth: {
+      uint64_t index = nat_of(subterm2.get());
+      const Term* list = subterm1.get();
+      for (;;) {
+        list = deref(list);
+        const BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(list);
+        if (cons_term == nullptr) {
+          break;
+        }
+        if (index == 0) {
+          result_[term] = unique_ptr<Term>(cons_term->term1()->clone());
+          return;
+        }
+        --index;
+        list = cons_term->term2().get();
+      }
+      const PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(list);
+      if (packed_term != nullptr && index < packed_term->size()) {
+        result_[term] = element_of(*packed_term->cells(), packed_term->begin() + index, term->location());
+        return;
+      }
+      throw runtime_exception(term->location(), "<nth> index out of bounds");
+    } break;
+    case BinaryTermToken::Range: {
+      // Builds [a, b) in one pass, packed.
+      const uint64_t begin = nat_of(subterm1.get());
+      const uint64_t end = nat_of(subterm2.get());
+      if (begin >= end) {
+        result_[term] = std::make_unique<NilTerm>(term->location(), std::make_shared<NatTermType>(term->location()));
+        break;
+      }
+      if (end - begin > kMaxBuiltinSize) {
+        throw runtime_exception(term->location(), "<range> of more than " + std::to_string(kMaxBuiltinSize) +
+                                                  " elements");
+      }
+      std::vector<uint64_t> values(end - begin);
+      std::iota(values.begin(), values.end(), begin);
+      const size_t size = values.size();
+      auto cells = std::make_shared<const PackedCells>(PackedCells::Kind::Nat, std::move(values),
+                                                       std::make_shared<NatTermType>(term->location()));
+      result_[term] = std::make_unique<PackedListTerm>(term->location(), std::move(cells), 0, size);
+    } break;
+    case BinaryTermToken::Less: {
+      std::vector<uint64_t> storage1, storage2;
+      const auto lhs = nat_elements(subterm1.get(), &storage1);
+      const auto rhs = nat_elements(subterm2.get(), &storage2);
+      std::vector<uint64_t> less(std::min(lhs.second, rhs.second));
+      packed::Less(lhs.first, rhs.first, less.size(), less.data());
+
+      const size_t size = less.size();
+      auto cells = std::make_shared<const PackedCells>(PackedCells::Kind::Bool, std::move(less),
+                                                       std::make_shared<BoolTermType>(term->location()));
+      result_[term] = std::make_unique<PackedListTerm>(term->location(), std::move(cells), 0, size);
+    } break;
+    case BinaryTermToken::ArrayMake: {
+      const uint64_t size = nat_of(subterm1.get());
+      if (size > kMaxBuiltinSize) {
+        throw runtime_exception(term->location(), "<array_make> of more than " + std::to_string(kMaxBuiltinSize) +
+                                                  " elements");
+      }
+      const unique_ptr<Term> element = share(std::move(subterm2));
+
+      auto array_term = std::make_unique<ArrayTerm>(term->location(), term->element_type());
+      array_term->reserve(size);
+      for (uint64_t i = 0; i < size; ++i) {
+        array_term->add(element->clone());
+      }
+      result_[term] = std::move(array_term);
+    } break;
+    case BinaryTermToken::ArrayGet: {
+      ArrayTerm* const array_term = dyn_cast<ArrayTerm>(deref(subterm1));
+      const uint64_t index = nat_of(subterm2.get());
+      if (array_term == nullptr) {
+        DieGuardedByTypeChecker();
+      } else if (index >= array_term->size()) {
+        throw runtime_exception(term->location(), "<array_get> index out of bounds");
+      } else {
+        result_[term] = take(std::move(subterm1), &array_term->get(index));
+      }
+    } break;
+    case BinaryTermToken::MapLookup: {
+      MapTerm* const map_term = dyn_cast<MapTerm>(deref(subterm1));
+      if (map_term != nullptr) {
+        // Returns a list of zero or one element.
+        unique_ptr<Term> list = std::make_unique<NilTerm>(term->location(), map_term->value_type());
+        const Term* const value = map_term->hamt()->Find(subterm2.get());
+        if (value != nullptr) {
+          list = CellPool::NewCons(term->location(), value->clone(), list.release());
+        }
+        result_[term] = std::move(list);
       } else {
         DieGuardedByTypeChecker();
       }
     } break;
+    case BinaryTermToken::Assign: {
+      RefTerm* const ref_term = dyn_cast<RefTerm>(deref(subterm1));
+      if (ref_term != nullptr) {
+        RefCell* const cell = ref_term->cell().get();
+        cell->value = interned(ctx_, stored(share(std::move(subterm2))), ref_term->value_type().get());
+        cell->context_size = ctx_->size();
+        // The value outlives the statement, and may carry spans of the input being interpreted.
+        LocationTable::PinCurrent();
+        result_[term] = std::make_unique<NullaryTerm>(term->location(), NullaryTermToken::Unit);
+      } else {
+        DieGuardedByTypeChecker();
+      }
+    } break;
+    case BinaryTermToken::Seq: {
+      // Both terms are evaluated in order, only the value of the second one is kept.
+      result_[term] = std::move(subterm2);
+    } break;
   }
 }
 
@@ -218,31 +1145,101 @@ void TermEvaluator::Visit(const TernaryTerm* term) {
     case TernaryTermToken::If: {
       term->term1()->Accept(this);
       unique_ptr<Term> predicate = eval(term->term1());
-      NullaryTerm* const bool_term = term_cast<NullaryTerm>(predicate.get());
+      NullaryTerm* const bool_term = dyn_cast<NullaryTerm>(deref(predicate));
 
       if (bool_term != nullptr && bool_term->type() == NullaryTermToken::True) {
+        // The other arm is never evaluated, dropping it now releases its references of shared values, so that
+        // values used in both arms could still be found unique (e.g. by <array_set>).
+        const_cast<TernaryTerm*>(term)->term3().reset();
         term->term2()->Accept(this);
         result_[term] = eval(term->term2());
       } else if (bool_term != nullptr && bool_term->type() == NullaryTermToken::False) {
+        const_cast<TernaryTerm*>(term)->term2().reset();
         term->term3()->Accept(this);
         result_[term] = eval(term->term3());
       } else {
         DieGuardedByTypeChecker();
       }
     } break;
+    case TernaryTermToken::Foldl: {
+      term->term1()->Accept(this);
+      term->term2()->Accept(this);
+      term->term3()->Accept(this);
+      // The function is shared, so that each step only copies a handle of it.
+      const unique_ptr<Term> function = share(eval(term->term1()));
+      unique_ptr<Term> accumulator = eval(term->term2());
+      const unique_ptr<Term> list = eval(term->term3());
+
+      for_each_element(list.get(), term->location(), [&](unique_ptr<Term> element) {
+        unique_ptr<Term> step = Apply(unique_ptr<Term>(function->clone()), std::move(accumulator));
+        accumulator = Apply(std::move(step), std::move(element));
+      });
+      result_[term] = std::move(accumulator);
+    } break;
+    case TernaryTermToken::ArraySet: {
+      term->term1()->Accept(this);
+      term->term2()->Accept(this);
+      term->term3()->Accept(this);
+      unique_ptr<Term> array = writable(eval(term->term1()));
+      const uint64_t index = nat_of(eval(term->term2()).get());
+      ArrayTerm* const array_term = dyn_cast<ArrayTerm>(deref(array));
+
+      if (array_term == nullptr) {
+        DieGuardedByTypeChecker();
+      } else if (index >= array_term->size()) {
+        throw runtime_exception(term->location(), "<array_set> index out of bounds");
+      } else {
+        array_term->get(index) = share(eval(term->term3()));
+        result_[term] = std::move(array);
+      }
+    } break;
+    case TernaryTermToken::MapInsert: {
+      term->term1()->Accept(this);
+      term->term2()->Accept(this);
+      term->term3()->Accept(this);
+      unique_ptr<Term> map = eval(term->term1());
+      const MapTermType* const map_type = cast<MapTermType>(term->map_type().get());
+      unique_ptr<Term> value = interned(ctx_, stored(share(eval(term->term3()))), map_type->value_type().get());
+      MapTerm* const map_term = dyn_cast<MapTerm>(deref(map));
+
+      if (map_term != nullptr) {
+        // Bound values are mostly shared handles, so the copies on the updated path are cheap.
+        const bool closed = map_term->closed() && dyn_cast<SharedTerm>(value.get()) != nullptr;
+        Hamt hamt = map_term->hamt()->Insert(
+            interned(ctx_, stored(share(eval(term->term2()))), map_type->key_type().get()), std::move(value));
+        result_[term] = std::make_unique<MapTerm>(term->location(), map_term->key_type(), map_term->value_type(),
+                                                  std::make_shared<const Hamt>(std::move(hamt)), closed);
+      } else {
+        DieGuardedByTypeChecker();
+      }
+    } break;
   }
 }
 
 void TermEvaluator::Visit(const NilTerm* term) {
-  result_[term] = std::make_unique<NilTerm>(term->location(), term->list_type()->clone());
+  result_[term] = std::make_unique<NilTerm>(term->location(), term->list_type());
 }
 
 void TermEvaluator::Visit(const VariableTerm* term) {
-  result_[term] = TermShifter(term->index() + 1).TermShift(ctx_->get(term->index()).second->term());
+  Binding* const binding = ctx_->get(term->index()).second.get();
+
+  if (!binding->forced()) {
+    // The term of the binding is under the bindings before it, so it is shifted over the ones after it to be evaluated
+    // here, and its value is shifted back to be cached.
+    unique_ptr<Term> unforced = TermShifter(term->index() + 1).TermShift(binding->unforced());
+    unique_ptr<Term> value = TermEvaluator(ctx_).Evaluate(unforced.get());
+    // The type of the binding is under the bindings before it as well.
+    const unique_ptr<TermType> type = TermTypeShifter(term->index() + 1).Shift(binding->type());
+    unique_ptr<Term> stored_value = stored(TermShifter(-term->index() - 1).TermShift(value.get()));
+    binding->Force(interned(ctx_, std::move(stored_value), type.get()).release());
+    result_[term] = std::move(value);
+    return;
+  }
+  result_[term] = TermShifter(term->index() + 1).TermShift(binding->term());
 }
 
 void TermEvaluator::Visit(const RecordTerm* term) {
-  auto record_term = std::make_unique<RecordTerm>(term->location());
+  unique_ptr<RecordTerm> record_term = CellPool::NewRecord(term->location());
 
   for (size_t i = 0; i < term->size(); ++i) {
     term->get(i).second->Accept(this);
@@ -255,21 +1252,60 @@ void TermEvaluator::Visit(const ProjectTerm* term) {
   term->term()->Accept(this);
   unique_ptr<Term> subterm = eval(term->term());
 
-  RecordTerm* const record_term = term_cast<RecordTerm>(subterm.get());
-  if (record_term != nullptr) {
-    for (size_t i = 0; i < record_term->size(); ++i) {
-      if (record_term->get(i).first == term->field()) {
-        result_[term] = std::move(record_term->get(i).second);
-        return;
-      }
+  RecordTerm* const record_term = dyn_cast<RecordTerm>(deref(subterm));
+  if (record_term != nullptr && term->slot() >= 0) {
+    result_[term] = take(std::move(subterm), &record_term->get(term->slot()).second);
+  } else {
+    DieGuardedByTypeChecker();
+  }
+}
+
+void TermEvaluator::Visit(const RecordUpdateTerm* term) {
+  term->term()->Accept(this);
+  unique_ptr<Term> subterm = eval(term->term());
+  std::vector<unique_ptr<Term>> values;
+  bool closed = true;
+
+  values.reserve(term->size());
+  for (size_t i = 0; i < term->size(); ++i) {
+    term->get(i).term->Accept(this);
+    values.push_back(eval(term->get(i).term));
+    closed = closed && ClosedTermChecker().IsClosed(values.back().get());
+  }
+
+  RecordTerm* const record_term = dyn_cast<RecordTerm>(deref(subterm));
+  if (record_term == nullptr) {
+    DieGuardedByTypeChecker();
+    return;
+  }
+  // The updated values are evaluated first, so that references to the record they hold are dropped by now. A record
+  // referred to only here is updated in place, unless a shared value would get free variables.
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(subterm.get());
+  if (shared_term == nullptr || (unique(shared_term) && closed)) {
+    for (size_t i = 0; i < term->size(); ++i) {
+      record_term->get(term->get(i).slot).second = std::move(values[i]);
     }
+    result_[term] = std::move(subterm);
+    return;
   }
-  DieGuardedByTypeChecker();
+  // Otherwise the unchanged fields are shared with the original record, which is never copied.
+  std::vector<unique_ptr<Term>> fields(record_term->size());
+  for (size_t i = 0; i < term->size(); ++i) {
+    fields[term->get(i).slot] = std::move(values[i]);
+  }
+  unique_ptr<RecordTerm> update_term = CellPool::NewRecord(term->location());
+  for (size_t i = 0; i < record_term->size(); ++i) {
+    if (fields[i] == nullptr) {
+      fields[i] = share_child(subterm, &record_term->get(i).second);
+    }
+    update_term->add(record_term->get(i).first, fields[i].release());
+  }
+  result_[term] = std::move(update_term);
 }
 
 void TermEvaluator::Visit(const LetTerm* term) {
   term->bind_term()->Accept(this);
-  result_[term] = Substitute(term->body_term().get(), eval(term->bind_term()).release());
+  result_[term] = Substitute(term->body_term().get(), eval(term->bind_term()));
 }
 
 void TermEvaluator::Visit(const AbsTerm* term) {
@@ -277,8 +1313,98 @@ void TermEvaluator::Visit(const AbsTerm* term) {
 }
 
 void TermEvaluator::Visit(const AscribeTerm* term) {
+  // Ascriptions are erased before evaluation.
+  DieGuardedByTypeChecker();
+}
+
+void TermEvaluator::Visit(const VariantTerm* term) {
   term->term()->Accept(this);
-  result_[term] = eval(term->term());
+  result_[term] = std::make_unique<VariantTerm>(term->location(), term->tag(), eval(term->term()).release(),
+                                                term->variant_type(), term->index());
+}
+
+void TermEvaluator::Visit(const CaseTerm* term) {
+  term->term()->Accept(this);
+  unique_ptr<Term> subterm = eval(term->term());
+
+  VariantTerm* const variant_term = dyn_cast<VariantTerm>(deref(subterm));
+  if (variant_term != nullptr && variant_term->index() >= 0) {
+    // Branches are laid out as the tags of the variant type, so the branch is picked by the tag index directly.
+    const CaseTerm::Branch& branch = term->get(variant_term->index());
+    result_[term] = Substitute(branch.body.get(), take(std::move(subterm), &variant_term->term()));
+  } else {
+    DieGuardedByTypeChecker();
+  }
+}
+
+void TermEvaluator::Visit(const MatchTerm* term) {
+  term->term()->Accept(this);
+  unique_ptr<Term> subterm = eval(term->term());
+  Term* const value = deref(subterm);
+  MatchTerm* const match_term = const_cast<MatchTerm*>(term);
+
+  // The value is inspected only once, and the fields of a cell are moved (or shared) into the cell arm directly. The
+  // other arm is dropped before evaluating the taken one, as in the conditional.
+  unique_ptr<Term> head, tail;
+  if (term->type() == MatchTermToken::Nat) {
+    const uint64_t n = nat_of(value);
+    if (n != 0) {
+      match_term->empty_arm().reset();
+      result_[term] = Substitute(term->cell_arm().get(), set_nat(std::move(subterm), term->location(), n - 1));
+      return;
+    }
+  } else {
+    BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(value);
+    PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(value);
+    if (cons_term != nullptr && cons_term->type() == BinaryTermToken::Cons) {
+      std::tie(head, tail) = take_both(std::move(subterm), &cons_term->term1(), &cons_term->term2());
+    } else if (packed_term != nullptr && packed_term->size() != 0) {
+      head = element_of(*packed_term->cells(), packed_term->begin(), term->location());
+      tail = std::make_unique<PackedListTerm>(term->location(), packed_term->cells(), packed_term->begin() + 1,
+                                              packed_term->end());
+    }
+  }
+  if (head == nullptr) {
+    match_term->cell_arm().reset();
+    term->empty_arm()->Accept(this);
+    result_[term] = eval(term->empty_arm());
+    return;
+  }
+  match_term->empty_arm().reset();
+  // <tail> is the innermost binding of the cons arm, so it is substituted first.
+  result_[term] = Substitute(Instantiate(term->cell_arm().get(), std::move(tail)).get(), std::move(head));
+}
+
+void TermEvaluator::Visit(const LetRecTerm* term) {
+  // 'letrec ... in f_i' is a member of the group, which unfolds into its binding instead of into itself.
+  const Term* body = term->body().get();
+  const VariableTerm* const variable_term = dyn_cast<VariableTerm>(body);
+  if (variable_term != nullptr && variable_term->index() < static_cast<int>(term->size())) {
+    body = term->get(term->size() - 1 - variable_term->index()).term.get();
+  }
+  result_[term] = TermEvaluator(ctx_).Run(Unfold(term, body).get());
+}
+
+void TermEvaluator::Visit(const PackedListTerm* term) {
+  result_[term] = unique_ptr<Term>(term->clone());
+}
+
+void TermEvaluator::Visit(const ArrayTerm* term) {
+  result_[term] = unique_ptr<Term>(term->clone());
+}
+
+void TermEvaluator::Visit(const RefTerm* term) {
+  result_[term] = unique_ptr<Term>(term->clone());
+}
+
+void TermEvaluator::Visit(const MapTerm* term) {
+  result_[term] = unique_ptr<Term>(term->clone());
+}
+
+void TermEvaluator::Visit(const SharedTerm* term) {
+  // <term> is owned by this evaluator and gets visited only once, so its reference is stolen here. Once all other
+  // references are consumed as well, the value is found unique and could be destructed in place.
+  result_[term] = std::make_unique<SharedTerm>(term->location(), std::move(const_cast<SharedTerm*>(term)->value()));
 }
 
 unique_ptr<Term> TermEvaluator::Substitute(const Term* term, const Term* to) {
@@ -287,5 +1413,39 @@ unique_ptr<Term> TermEvaluator::Substitute(const Term* term, const Term* to) {
   // Shift down by 1 so we can kill the variable 0.
   unique_ptr<Term> down = TermShifter(-1).TermShift(substitutor.TermSubstitute(term).get());
 
-  return TermEvaluator(ctx_).Evaluate(down.get());
+  return TermEvaluator(ctx_).Run(down.get());
+}
+
+unique_ptr<Term> TermEvaluator::Substitute(const Term* term, unique_ptr<Term> value) {
+  return TermEvaluator(ctx_).Run(Instantiate(term, std::move(value)).get());
+}
+
+unique_ptr<Term> TermEvaluator::Apply(unique_ptr<Term> function, unique_ptr<Term> argument) {
+  const AbsTerm* const abs_term = cast<AbsTerm>(deref(function));
+  unique_ptr<Term> body = Instantiate(abs_term->term().get(), std::move(argument));
+  // Drops the closure before running its body, as values it captured are now referenced by <body> as well.
+  function.reset();
+  return TermEvaluator(ctx_).Run(body.get());
+}
+
+unique_ptr<Term> TermEvaluator::Instantiate(const Term* term, unique_ptr<Term> value) {
+  // A closed value is substituted as handles, the copies in the result are then its only references.
+  unique_ptr<Term> up = TermShifter(1).TermShift(share(std::move(value)).get());
+  TermSubstituter substitutor(up.get());
+  return TermShifter(-1).TermShift(substitutor.TermSubstitute(term).get());
+}
+
+unique_ptr<Term> TermEvaluator::Unfold(const LetRecTerm* term, const Term* body) {
+  const int size = term->size();
+  unique_ptr<Term> ret;
+
+  // The innermost name is substituted first, each member is shifted over the names of the group still bound.
+  for (int i = size - 1; i >= 0; --i) {
+    const LetRecTerm member(body->location(), term->bindings(), new VariableTerm(body->location(), size - 1 - i),
+                            term->closed(), term->first());
+    unique_ptr<Term> up = TermShifter(i + 1).TermShift(&member);
+    TermSubstituter substitutor(up.get());
+    ret = TermShifter(-1).TermShift(substitutor.TermSubstitute(ret != nullptr ? ret.get() : body).get());
+  }
+  return ret;
 }
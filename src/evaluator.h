@@ -3,12 +3,16 @@
 #include <functional>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "ast.h"
 #include "visitor.h"
 
 class Context;
 
+// Maps a term bottom-up, the subterms of a node are mapped before the node is visited, and Visit() builds the mapped
+// node out of them. Terms nested too deep are mapped with an explicit stack instead, so that deep terms do not overflow
+// the stack.
 class TermMapper : public Visitor<Term> {
  public:
   TermVisitorOverrides;
@@ -17,14 +21,36 @@ class TermMapper : public Visitor<Term> {
 
  protected:
   std::unique_ptr<Term> Map(const Term*);
+  // Schedules the subterms <term> is built out of, see MapBefore().
+  virtual void Expand(const Term* term);
+  // Schedules <subterm> to be mapped before the term being expanded, under <binders> more variables bound by it.
+  void MapBefore(const Term* subterm, int binders = 0);
+  // Number of variables bound around the term being expanded or visited.
   int depth() const { return depth_; }
 
- private:
   std::unique_ptr<Term> get(const Term* term) { return std::move(result_[term]); }
   std::unique_ptr<Term> get(const std::unique_ptr<Term>& term) { return std::move(result_[term.get()]); }
+  void set(const Term* term, std::unique_ptr<Term> mapped) { result_[term] = std::move(mapped); }
+
+ private:
+  struct Frame {
+    const Term* term;
+    int depth;
+    bool expanded;
+  };
+
+  static const int kMaxNesting = 256;
+
+  // Maps <term> with an explicit stack.
+  void MapNested(const Term* term);
+
+  // Terms left to map, shared by the mappers of a thread.
+  static thread_local std::vector<Frame> frames_;
 
   std::unordered_map<const Term*, std::unique_ptr<Term>> result_;
   int depth_ = 0;
+  int nesting_ = 0;
+  bool nested_ = false;
 };
 
 // Shifts up deBruijn indices of all free variables by <delta>.
@@ -53,22 +79,88 @@ class TermSubstituter : public TermMapper {
   const Term* const substitute_to_;
 };
 
+// Erases what only the type checker needs from a type checked term, so that it never reaches the evaluator, i.e.
+// ascriptions are dropped. Types of 'nil' and lambdas are kept for printing values, but they are shared by all copies
+// of a term rather than cloned with it.
+class TermEraser : public TermMapper {
+ public:
+  std::unique_ptr<Term> Erase(const Term* term) { return Map(term); }
+
+  void Visit(const AscribeTerm* term) override;
+
+ protected:
+  std::unique_ptr<Term> VariableMap(Location location, int var) override;
+};
+
+// Copies a value out of the arena of the current statement, so that it outlives the statement, e.g. as a top-level
+// binding. Parts of the value from outside of the arena are shared instead, and values shared inside of the arena
+// remain shared by the copy.
+class TermExtractor : public TermMapper {
+ public:
+  std::unique_ptr<Term> Extract(const Term* term);
+
+  void Visit(const SharedTerm* term) override;
+  void Visit(const LetRecTerm* term) override;
+
+ protected:
+  void Expand(const Term* term) override;
+  std::unique_ptr<Term> VariableMap(Location location, int var) override;
+
+ private:
+  std::unordered_map<const Term*, std::shared_ptr<Term>> extracted_;
+};
+
+// Pool of dead value cells. When the evaluator destructs a cell it holds the only reference of (e.g. <tail> on a
+// uniquely owned list), the cell is kept here and reused in place by the next <cons> or record, so pure list pipelines
+// do not go through the allocator in the common case. Cells of an arena are left to the arena instead.
+class CellPool final {
+ public:
+  struct Stats {
+    size_t allocated = 0;
+    size_t reused = 0;
+  };
+
+  static std::unique_ptr<Term> NewCons(Location location, Term* head, Term* tail);
+  static std::unique_ptr<RecordTerm> NewRecord(Location location);
+
+  // Takes back a dead cell, subterms still attached to it are released.
+  static void Recycle(Term* cell);
+
+  static const Stats& stats();
+  static void ResetStats();
+};
+
 // Evaluate term into a normal value. Valid values are:
 // * true, false
-// * zero, succ zero, succ (succ zero), ...
+// * 0, 1, 2, ... (as NatTerm)
 // * nil, cons v nil, cons v_1 (cons v_2 nil), ...
+// * packed List[Nat] or List[Bool]
 // * unit
 // * {f_1: v_1, f_2: v_2, ...}
+// * <tag: v> as T
 // * lambda x. t
+// * ref v, a mutable cell
 class TermEvaluator : public Visitor<Term> {
  public:
   TermEvaluator(Context* ctx) : ctx_(ctx) { }
   TermVisitorOverrides;
 
+  // Evaluates a type checked term, through an erased copy of it.
   std::unique_ptr<Term> Evaluate(const Term*);
 
  private:
+  // Evaluates an erased term owned by this evaluator, the handles of shared values are stolen out of it.
+  std::unique_ptr<Term> Run(const Term*);
+
   std::unique_ptr<Term> Substitute(const Term* term, const Term* to);
+  std::unique_ptr<Term> Substitute(const Term* term, std::unique_ptr<Term> value);
+  // Applies a closure to <argument>, i.e. evaluates its body with the argument substituted.
+  std::unique_ptr<Term> Apply(std::unique_ptr<Term> function, std::unique_ptr<Term> argument);
+  // Substitutes without evaluating the result.
+  std::unique_ptr<Term> Instantiate(const Term* term, std::unique_ptr<Term> value);
+  // Substitutes all names of a 'letrec' group in <body> with the members of the group, i.e. 'letrec ... in f_i'. The
+  // members are not values, so they are substituted as terms rather than shared.
+  std::unique_ptr<Term> Unfold(const LetRecTerm* term, const Term* body);
 
   std::unique_ptr<Term> eval(const Term* term) { return std::move(result_[term]); }
   std::unique_ptr<Term> eval(const std::unique_ptr<Term>& term) { return std::move(result_[term.get()]); }
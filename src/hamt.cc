@@ -0,0 +1,181 @@
+#include "hamt.h"
+
+#include <vector>
+
+#include "value-hash.h"
+
+using std::shared_ptr;
+using std::unique_ptr;
+
+// A node is immutable once it is reachable from a Hamt.
+struct Hamt::Node {
+  enum class Kind { Leaf, Branch, Collision };
+
+  explicit Node(Kind kind) : kind(kind) { }
+
+  const Kind kind;
+
+  // Leaf and Collision, hash of the key(s).
+  uint64_t hash = 0;
+
+  // Leaf.
+  unique_ptr<Term> key, value;
+
+  // Branch, the i-th bit of <bitmap> is set if the child for hash chunk i exists.
+  uint32_t bitmap = 0;
+
+  // Children of a Branch ordered by hash chunk, or leaves of a Collision.
+  std::vector<shared_ptr<const Node>> children;
+};
+
+namespace {
+
+using Node = Hamt::Node;
+
+const int kBits = 5;
+const uint64_t kMask = (1 << kBits) - 1;
+
+int chunk(uint64_t hash, int shift) {
+  return (hash >> shift) & kMask;
+}
+
+int child_index(uint32_t bitmap, uint32_t bit) {
+  return __builtin_popcount(bitmap & (bit - 1));
+}
+
+// Builds the subtrie holding both <a> and <b>, whose hashes differ.
+shared_ptr<const Node> merge(shared_ptr<const Node> a, shared_ptr<const Node> b, int shift) {
+  auto branch = std::make_shared<Node>(Node::Kind::Branch);
+  const int chunk_a = chunk(a->hash, shift), chunk_b = chunk(b->hash, shift);
+
+  if (chunk_a == chunk_b) {
+    branch->bitmap = 1u << chunk_a;
+    branch->children.push_back(merge(std::move(a), std::move(b), shift + kBits));
+  } else {
+    branch->bitmap = (1u << chunk_a) | (1u << chunk_b);
+    if (chunk_a > chunk_b) {
+      std::swap(a, b);
+    }
+    branch->children.push_back(std::move(a));
+    branch->children.push_back(std::move(b));
+  }
+  return branch;
+}
+
+shared_ptr<const Node> insert(const shared_ptr<const Node>& node, shared_ptr<const Node> leaf, int shift, bool* added) {
+  if (node == nullptr) {
+    *added = true;
+    return leaf;
+  }
+
+  switch (node->kind) {
+    case Node::Kind::Leaf: {
+      if (node->hash != leaf->hash) {
+        *added = true;
+        return merge(node, std::move(leaf), shift);
+      }
+      if (EqualValues(node->key.get(), leaf->key.get())) {
+        return leaf;
+      }
+      auto collision = std::make_shared<Node>(Node::Kind::Collision);
+      collision->hash = node->hash;
+      collision->children = {node, std::move(leaf)};
+      *added = true;
+      return collision;
+    }
+    case Node::Kind::Collision: {
+      if (node->hash != leaf->hash) {
+        *added = true;
+        return merge(node, std::move(leaf), shift);
+      }
+      auto collision = std::make_shared<Node>(Node::Kind::Collision);
+      collision->hash = node->hash;
+      collision->children = node->children;
+      for (shared_ptr<const Node>& child : collision->children) {
+        if (EqualValues(child->key.get(), leaf->key.get())) {
+          child = std::move(leaf);
+          return collision;
+        }
+      }
+      collision->children.push_back(std::move(leaf));
+      *added = true;
+      return collision;
+    }
+    case Node::Kind::Branch: {
+      const uint32_t bit = 1u << chunk(leaf->hash, shift);
+      const int index = child_index(node->bitmap, bit);
+      auto branch = std::make_shared<Node>(Node::Kind::Branch);
+      branch->bitmap = node->bitmap | bit;
+      branch->children = node->children;
+      if (node->bitmap & bit) {
+        branch->children[index] = insert(node->children[index], std::move(leaf), shift + kBits, added);
+      } else {
+        branch->children.insert(branch->children.begin() + index, std::move(leaf));
+        *added = true;
+      }
+      return branch;
+    }
+  }
+  return nullptr;
+}
+
+void for_each(const Node* node, const std::function<void(const Term*, const Term*)>& fn) {
+  if (node->kind == Node::Kind::Leaf) {
+    fn(node->key.get(), node->value.get());
+    return;
+  }
+  for (const shared_ptr<const Node>& child : node->children) {
+    for_each(child.get(), fn);
+  }
+}
+
+}  // namespace
+
+const Term* Hamt::Find(const Term* key) const {
+  const uint64_t hash = HashValue(key);
+  const Node* node = root_.get();
+
+  for (int shift = 0; node != nullptr; shift += kBits) {
+    switch (node->kind) {
+      case Node::Kind::Leaf: {
+        return node->hash == hash && EqualValues(node->key.get(), key) ? node->value.get() : nullptr;
+      }
+      case Node::Kind::Collision: {
+        if (node->hash != hash) {
+          return nullptr;
+        }
+        for (const shared_ptr<const Node>& child : node->children) {
+          if (EqualValues(child->key.get(), key)) {
+            return child->value.get();
+          }
+        }
+        return nullptr;
+      }
+      case Node::Kind::Branch: {
+        const uint32_t bit = 1u << chunk(hash, shift);
+        if ((node->bitmap & bit) == 0) {
+          return nullptr;
+        }
+        node = node->children[child_index(node->bitmap, bit)].get();
+      } break;
+    }
+  }
+  return nullptr;
+}
+
+Hamt Hamt::Insert(unique_ptr<Term> key, unique_ptr<Term> value) const {
+  auto leaf = std::make_shared<Node>(Node::Kind::Leaf);
+  leaf->hash = HashValue(key.get());
+  leaf->key = std::move(key);
+  leaf->value = std::move(value);
+
+  bool added = false;
+  shared_ptr<const Node> root = insert(root_, std::move(leaf), 0, &added);
+  return Hamt(std::move(root), added ? size_ + 1 : size_);
+}
+
+void Hamt::ForEach(const std::function<void(const Term*, const Term*)>& fn) const {
+  if (root_ != nullptr) {
+    for_each(root_.get(), fn);
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "ast.h"
+
+// Persistent hash array mapped trie from values to values, keyed by HashValue and EqualValues. An update returns a new
+// version that shares every node off the updated path with the old one, so it costs O(log n) and old versions are
+// left intact.
+class Hamt final {
+ public:
+  struct Node;
+
+  Hamt() = default;
+
+  size_t size() const { return size_; }
+
+  // Returns the value bound to <key>, or nullptr if there is none.
+  const Term* Find(const Term* key) const;
+
+  // Returns a new version with <key> bound to <value>, replacing the old binding if there is one.
+  Hamt Insert(std::unique_ptr<Term> key, std::unique_ptr<Term> value) const;
+
+  // Calls <fn> on each binding, in an unspecified but deterministic order.
+  void ForEach(const std::function<void(const Term* key, const Term* value)>& fn) const;
+
+ private:
+  Hamt(std::shared_ptr<const Node> root, size_t size) : root_(std::move(root)), size_(size) { }
+
+  std::shared_ptr<const Node> root_;
+  size_t size_ = 0;
+};
@@ -0,0 +1,231 @@
+#include "hash-cons.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "type-helper.h"
+#include "value-hash.h"
+
+using std::string;
+using std::unique_ptr;
+using std::weak_ptr;
+
+namespace {
+
+// Serializes a type structurally, ignoring locations. With <ctx>, user-defined types are serialized as their
+// definitions, so that the key means the same type in any context. Without it, they are serialized as their indices,
+// which is what tells apart shared type nodes.
+class TypeKeyBuilder : public Visitor<TermType> {
+ public:
+  explicit TypeKeyBuilder(const Context* ctx = nullptr) : ctx_(ctx) { }
+  TermTypeVisitorOverrides;
+
+  string Build(const TermType* type) {
+    type->Accept(this);
+    return std::move(key_);
+  }
+
+ private:
+  void Append(const TermType* type) { type->Accept(this); }
+  void Append(const string& str) { key_ += str; }
+
+  const Context* const ctx_;  // nullable.
+  string key_;
+};
+
+void TypeKeyBuilder::Visit(const BoolTermType* type) {
+  Append("B");
+}
+
+void TypeKeyBuilder::Visit(const NatTermType* type) {
+  Append("N");
+}
+
+void TypeKeyBuilder::Visit(const UnitTermType* type) {
+  Append("U");
+}
+
+void TypeKeyBuilder::Visit(const ListTermType* type) {
+  Append("L(");
+  Append(type->type().get());
+  Append(")");
+}
+
+void TypeKeyBuilder::Visit(const ArrayTermType* type) {
+  Append("A(");
+  Append(type->type().get());
+  Append(")");
+}
+
+void TypeKeyBuilder::Visit(const RefTermType* type) {
+  Append("R(");
+  Append(type->type().get());
+  Append(")");
+}
+
+void TypeKeyBuilder::Visit(const MapTermType* type) {
+  Append("M(");
+  Append(type->key_type().get());
+  Append(",");
+  Append(type->value_type().get());
+  Append(")");
+}
+
+void TypeKeyBuilder::Visit(const RecordTermType* type) {
+  Append("{");
+  for (size_t i = 0; i < type->size(); ++i) {
+    Append(std::to_string(type->get(i).first.id()) + ":");
+    Append(type->get(i).second.get());
+    Append(",");
+  }
+  Append("}");
+}
+
+void TypeKeyBuilder::Visit(const VariantTermType* type) {
+  Append("<");
+  for (size_t i = 0; i < type->size(); ++i) {
+    Append(std::to_string(type->get(i).first.id()) + ":");
+    Append(type->get(i).second.get());
+    Append(",");
+  }
+  Append(">");
+}
+
+void TypeKeyBuilder::Visit(const ArrowTermType* type) {
+  Append("(");
+  Append(type->type1().get());
+  Append("->");
+  Append(type->type2().get());
+  Append(")");
+}
+
+void TypeKeyBuilder::Visit(const UserDefinedTermType* type) {
+  if (ctx_ != nullptr) {
+    Append(SimplifyType(ctx_, type).get());
+    return;
+  }
+  Append("#" + std::to_string(type->index()));
+}
+
+struct ValueEntry {
+  string type_key;
+  weak_ptr<Term> value;
+};
+
+// Tables are pruned of expired entries whenever they have doubled in size since the last time.
+struct Tables {
+  std::mutex mutex;
+  bool enabled = false;
+  std::unordered_map<string, weak_ptr<const TermType>> types;
+  std::unordered_map<uint64_t, std::vector<ValueEntry>> values;
+  size_t values_size = 0;
+  size_t types_pruned_size = 0;
+  size_t values_pruned_size = 0;
+  size_t hits = 0;
+};
+
+// Never destroyed, as nodes of static objects could still be shared after it.
+Tables& tables() {
+  static Tables* const tables = new Tables();
+  return *tables;
+}
+
+void prune_types(Tables* tables) {
+  for (auto iter = tables->types.begin(); iter != tables->types.end();) {
+    iter = iter->second.expired() ? tables->types.erase(iter) : std::next(iter);
+  }
+  tables->types_pruned_size = tables->types.size();
+}
+
+void prune_values(Tables* tables) {
+  tables->values_size = 0;
+  for (auto iter = tables->values.begin(); iter != tables->values.end();) {
+    std::vector<ValueEntry>& entries = iter->second;
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const ValueEntry& entry) {
+      return entry.value.expired();
+    }), entries.end());
+    tables->values_size += entries.size();
+    iter = entries.empty() ? tables->values.erase(iter) : std::next(iter);
+  }
+  tables->values_pruned_size = tables->values_size;
+}
+
+}  // namespace
+
+bool HashCons::enabled() {
+  return tables().enabled;
+}
+
+void HashCons::set_enabled(bool enabled) {
+  tables().enabled = enabled;
+}
+
+SharedTermType HashCons::Type(SharedTermType type) {
+  Tables& tables = ::tables();
+  if (!tables.enabled) {
+    return type;
+  }
+  string key = TypeKeyBuilder().Build(type.get());
+
+  std::lock_guard<std::mutex> lock(tables.mutex);
+  weak_ptr<const TermType>& entry = tables.types[std::move(key)];
+  SharedTermType shared = entry.lock();
+  if (shared != nullptr) {
+    ++tables.hits;
+    return shared;
+  }
+  entry = type;
+  if (tables.types.size() >= 2 * tables.types_pruned_size + 64) {
+    prune_types(&tables);
+  }
+  return type;
+}
+
+unique_ptr<Term> HashCons::Value(const Context* ctx, unique_ptr<Term> value, const TermType* type) {
+  Tables& tables = ::tables();
+  SharedTerm* const shared_term = dyn_cast<SharedTerm>(value.get());
+  if (!tables.enabled || shared_term == nullptr || Arena::Owns(shared_term->value().get()) ||
+      !IsFirstOrderType(ctx, type)) {
+    return value;
+  }
+  string type_key = TypeKeyBuilder(ctx).Build(type);
+  const uint64_t hash = HashValue(shared_term->value().get()) ^ std::hash<string>()(type_key);
+
+  std::lock_guard<std::mutex> lock(tables.mutex);
+  std::vector<ValueEntry>& entries = tables.values[hash];
+  for (const ValueEntry& entry : entries) {
+    if (entry.type_key != type_key) {
+      continue;
+    }
+    // A value updated in place by its only owner could be found under a stale hash, so entries are compared anyway.
+    std::shared_ptr<Term> shared = entry.value.lock();
+    if (shared != nullptr && EqualValues(shared.get(), shared_term->value().get())) {
+      ++tables.hits;
+      shared_term->value() = std::move(shared);
+      return value;
+    }
+  }
+  entries.push_back({std::move(type_key), shared_term->value()});
+  if (++tables.values_size >= 2 * tables.values_pruned_size + 64) {
+    prune_values(&tables);
+  }
+  return value;
+}
+
+HashCons::Stats HashCons::stats() {
+  Tables& tables = ::tables();
+  std::lock_guard<std::mutex> lock(tables.mutex);
+  prune_types(&tables);
+  prune_values(&tables);
+  Stats stats;
+  stats.types = tables.types.size();
+  stats.values = tables.values_size;
+  stats.hits = tables.hits;
+  return stats;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "ast.h"
+
+class Context;
+
+// Optional hash-consing of immutable nodes. While it is enabled, structurally identical types held by SharedTermType
+// (see ShareType) and structurally identical first-order values stored beyond a statement are shared as a single node,
+// so that repetitive data takes the memory of one copy and equal nodes are the same pointer. The tables only hold weak
+// references, a node is freed as usual once it is no longer used.
+//
+// A shared type keeps the location of the first node it was created from.
+class HashCons final {
+ public:
+  struct Stats {
+    size_t types = 0;   // live shared types.
+    size_t values = 0;  // live shared values.
+    size_t hits = 0;
+  };
+
+  HashCons() = delete;
+
+  static bool enabled();
+  static void set_enabled(bool enabled);
+
+  // Returns the type structurally identical to <type> if there is one, <type> itself otherwise.
+  static SharedTermType Type(SharedTermType type);
+  // Returns a handle to the value equal to <value> of <type> if there is one, <value> itself otherwise. Only closed
+  // values (as SharedTerm) of first-order types are shared, see IsFirstOrderType.
+  static std::unique_ptr<Term> Value(const Context* ctx, std::unique_ptr<Term> value, const TermType* type);
+
+  static Stats stats();
+};
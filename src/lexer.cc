@@ -27,16 +27,25 @@ const unordered_map<string, TokenType> keyword_list = {
   {"head", TokenType::Head},
   {"tail", TokenType::Tail},
   {"unit", TokenType::Unit},
+  {"ref", TokenType::Ref},
   {"lambda", TokenType::Lambda},
   {"let", TokenType::Let},
   {"in", TokenType::In},
   {"letrec", TokenType::LetRec},
+  {"and", TokenType::And},
   {"type", TokenType::TypeAlias},
   {"as", TokenType::As},
+  {"case", TokenType::Case},
+  {"of", TokenType::Of},
+  {"match", TokenType::Match},
+  {"with", TokenType::With},
   {"Bool", TokenType::Bool},
   {"Nat", TokenType::Nat},
   {"List", TokenType::List},
+  {"Array", TokenType::Array},
+  {"Map", TokenType::Map},
   {"Unit", TokenType::UUnit},
+  {"Ref", TokenType::URef},
 };
 
 const unordered_map<char, TokenType> onechar_list = {
@@ -52,6 +61,10 @@ const unordered_map<char, TokenType> onechar_list = {
   {'}', TokenType::RCurly},
   {'[', TokenType::LBracket},
   {']', TokenType::RBracket},
+  {'<', TokenType::LAngle},
+  {'>', TokenType::RAngle},
+  {'|', TokenType::Bar},
+  {'!', TokenType::Bang},
 };
 
 bool is_whitespaces(char ch) {
@@ -108,6 +121,15 @@ size_t Lexer::ParseToken(size_t offset, unique_ptr<Token>* token) {
     return length; \
   } while (false)
 
+  // '==' shares its first char with '=', so it goes before single char tokens.
+  if (offset + 1 < input_.length() && input_[offset] == '=' && input_[offset + 1] == '=') {
+    create_token(TokenType::EqEq, 2);
+  }
+  // So does ':=' with ':'.
+  if (offset + 1 < input_.length() && input_[offset] == ':' && input_[offset + 1] == '=') {
+    create_token(TokenType::ColonEq, 2);
+  }
+
   // Handle single char token.
   const unordered_map<char, TokenType>::const_iterator iter = onechar_list.find(input_[offset]);
   if (iter != onechar_list.end()) {
@@ -1,12 +1,126 @@
 #include "location.h"
 
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <limits>
+#include <memory>
+#include <utility>
 
 #include "common.h"
 
 using std::string;
+using std::unique_ptr;
 using std::vector;
 
+namespace {
+
+// Spans are stored in chunks of kChunkSize, the handle of a span is the number of its chunk followed by its slot in the
+// chunk. Chunks are small, so that a pinned table of a short input (e.g. a line of the REPL) holds little unused room.
+constexpr int kChunkBits = 6;
+constexpr uint32_t kChunkSize = 1u << kChunkBits;
+
+using Span = std::pair<uint32_t, uint32_t>;
+using Chunk = std::array<Span, kChunkSize>;
+
+struct Chunks {
+  // By number, 0 is never handed out as handle 0 is the empty span.
+  vector<unique_ptr<Chunk>> chunks = vector<unique_ptr<Chunk>>(1);
+  // Numbers of the chunks given back by the tables destroyed.
+  vector<uint32_t> free;
+  size_t spans = 0;
+};
+
+Chunks& chunks() {
+  static Chunks* const chunks = new Chunks();
+  return *chunks;
+}
+
+Span& span_of(uint32_t handle) {
+  return (*chunks().chunks[handle >> kChunkBits])[handle & (kChunkSize - 1)];
+}
+
+LocationTable* current_table = nullptr;
+
+}  // namespace
+
+Location::Location(size_t begin, size_t end) : handle_(0) {
+  if (begin == 0 && end == 0) {
+    return;
+  }
+  handle_ = LocationTable::Current()->Add(begin, end);
+}
+
+size_t Location::begin() const {
+  return handle_ == 0 ? 0 : span_of(handle_).first;
+}
+
+size_t Location::end() const {
+  return handle_ == 0 ? 0 : span_of(handle_).second;
+}
+
+Location::Stats Location::stats() {
+  Stats stats;
+  stats.spans = chunks().spans;
+  return stats;
+}
+
+LocationTable::LocationTable() : previous_(current_table) {
+  current_table = this;
+}
+
+LocationTable::~LocationTable() {
+  assert(current_table == this && "location tables are destroyed in the reverse order of their construction");
+  current_table = previous_;
+  if (pinned_) {
+    return;
+  }
+  Chunks& c = chunks();
+  for (uint32_t number : chunks_) {
+    c.chunks[number].reset();
+    c.free.push_back(number);
+  }
+  c.spans -= size_;
+}
+
+LocationTable* LocationTable::Current() {
+  if (current_table == nullptr) {
+    // Stays current below the tables constructed after it.
+    LocationTable* const process_table = new LocationTable();
+    process_table->pinned_ = true;
+  }
+  return current_table;
+}
+
+uint32_t LocationTable::Add(size_t begin, size_t end) {
+  assert(end <= std::numeric_limits<uint32_t>::max() && "input too long");
+  const Span span(begin, end);
+  // Spans are mostly created in order, e.g. a node relocated to the span of its last token.
+  if (size_ != 0 && span_of(last_) == span) {
+    return last_;
+  }
+
+  if (size_ % kChunkSize == 0) {
+    Chunks& c = chunks();
+    uint32_t number;
+    if (!c.free.empty()) {
+      number = c.free.back();
+      c.free.pop_back();
+    } else {
+      assert(c.chunks.size() < (size_t{1} << (32 - kChunkBits)) && "too many locations");
+      number = c.chunks.size();
+      c.chunks.emplace_back();
+    }
+    c.chunks[number] = std::make_unique<Chunk>();
+    chunks_.push_back(number);
+  }
+  last_ = chunks_.back() << kChunkBits | size_ % kChunkSize;
+  span_of(last_) = span;
+  ++size_;
+  ++chunks().spans;
+  return last_;
+}
+
 Locator::Locator(const string& filename, const string& input) : filename_(filename), input_(input) {
   int nlines = std::count(input_.begin(), input_.end(), '\n');
   int cur_line = 1;
@@ -21,6 +135,7 @@ Locator::Locator(const string& filename, const string& input) : filename_(filena
 }
 
 void Locator::Locate(Location location, int* line1, int* column1, int* line2, int* column2) const {
+  const size_t begin = location.begin(), end = location.end();
   int l1, l2;
 
 #define assign(dst, src) \
@@ -32,13 +147,13 @@ void Locator::Locate(Location location, int* line1, int* column1, int* line2, in
 
   using std::upper_bound;
 
-  l1 = upper_bound(linemap_.begin(), linemap_.end(), location.begin) - linemap_.begin() - 1;
+  l1 = upper_bound(linemap_.begin(), linemap_.end(), begin) - linemap_.begin() - 1;
   assign(line1, l1);
-  assign(column1, location.begin - linemap_[l1]);
+  assign(column1, begin - linemap_[l1]);
 
-  l2 = upper_bound(linemap_.begin(), linemap_.end(), location.end == 0 ? 0 : location.end - 1) - linemap_.begin() - 1;
+  l2 = upper_bound(linemap_.begin(), linemap_.end(), end == 0 ? 0 : end - 1) - linemap_.begin() - 1;
   assign(line2, l2);
-  assign(column2, location.end- linemap_[l2]);
+  assign(column2, end - linemap_[l2]);
 
 #undef assign
 }
@@ -72,10 +187,11 @@ void Locator::Error(int fd, Location location, const string& error) const {
   size_t from = line1 == 0 ? 0 : linemap_[line1 - 1];
   size_t to = line1 + 2 < int(linemap_.size()) ? linemap_[line1 + 2] : input_.length();
 
+  const size_t begin = location.begin(), end = location.end();
   for (size_t i = from; i < to; ++i) {
-    if (i == location.begin) tty::red(fd);
+    if (i == begin) tty::red(fd);
     fputc(input_[i], f);
-    if (i + 1 == location.end) tty::sgr0(fd);
+    if (i + 1 == end) tty::sgr0(fd);
   }
   fprintf(f, "\n");
 }
@@ -6,13 +6,62 @@
 
 class Locatable;
 
-struct Location {
-  size_t begin;
-  size_t end;
+// Span of source offsets, held as a 32-bit handle into the table of spans of the input it comes from, see
+// LocationTable. Only the lexer and the parser create spans, nodes created at runtime copy the handle of the node they
+// are created from, so they add nothing to the table.
+class Location {
+ public:
+  struct Stats {
+    size_t spans = 0;  // of the tables alive or pinned.
+  };
 
-  Location(size_t begin, size_t end) : begin(begin), end(end) { }
-  Location(Location l, Location r) : begin(l.begin), end(r.end) { }
+  Location(size_t begin, size_t end);
+  Location(Location l, Location r) : Location(l.begin(), r.end()) { }
   Location(const Locatable* l, const Locatable* r);
+
+  size_t begin() const;
+  size_t end() const;
+
+  static Stats stats();
+
+ private:
+  // 0 is the empty span at offset 0, which is not stored in any table.
+  uint32_t handle_;
+};
+
+// Spans of one input. Locations are added to the current table, i.e. the one constructed last and not destroyed yet,
+// or to a table that lives as long as the process if there is none (e.g. for terms built by hand).
+//
+// A table gives its spans back when destroyed, for the tables after it to reuse, unless it is pinned: terms stored by
+// its input, in top-level bindings or in reference cells, keep referring to them.
+//
+// Tables are used by the thread running the interpreter only, neither adding nor reading spans locks.
+class LocationTable {
+ public:
+  LocationTable();
+  ~LocationTable();
+
+  LocationTable(const LocationTable&) = delete;
+  LocationTable& operator=(const LocationTable&) = delete;
+
+  // Keeps the spans after the table is destroyed, as a term carrying them is being stored.
+  void Pin() { pinned_ = true; }
+  static void PinCurrent() { Current()->Pin(); }
+
+  size_t size() const { return size_; }
+  bool pinned() const { return pinned_; }
+
+ private:
+  friend class Location;
+
+  static LocationTable* Current();
+  uint32_t Add(size_t begin, size_t end);
+
+  LocationTable* const previous_;
+  std::vector<uint32_t> chunks_;  // numbers of the chunks the spans are stored in, in order.
+  size_t size_ = 0;
+  uint32_t last_ = 0;  // handle of the span added last.
+  bool pinned_ = false;
 };
 
 class Locatable {
@@ -26,7 +75,7 @@ class Locatable {
 };
 
 inline Location::Location(const Locatable* l, const Locatable* r)
-  : begin(l->location().begin), end(r->location().end) { }
+  : Location(l->location(), r->location()) { }
 
 class Locator {
  public:
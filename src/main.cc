@@ -6,11 +6,15 @@
 #include <string>
 #include <vector>
 
+#include "arena.h"
 #include "ast.h"
+#include "compactor.h"
 #include "context.h"
 #include "error.h"
 #include "evaluator.h"
+#include "hash-cons.h"
 #include "lexer.h"
+#include "node-pool.h"
 #include "parser.h"
 #include "pprinter.h"
 #include "type-checker.h"
@@ -21,16 +25,21 @@ using std::unique_ptr;
 using std::vector;
 
 void usage(int argc, char** argv) {
-  printf("usage: %s [-i | file]\n", argv[0]);
+  printf("usage: %s [--lazy-toplevel] [--hash-cons] [-i | file]\n", argv[0]);
   puts("\n"
        "options:\n"
-       "  -i      interactive mode\n");
+       "  -i                interactive mode\n"
+       "  --lazy-toplevel   evaluate top-level bindings on their first use\n"
+       "  --hash-cons       share structurally identical types and stored values\n");
   exit(0);
 }
 
 Context ctx;
+bool lazy_toplevel = false;
 
 bool Interpret(const string& filename, const string& input) {
+  // Spans of the input, kept after it is interpreted only if it stores terms, see LocationTable.
+  LocationTable locations;
   unique_ptr<Lexer> lexer;
   Locator locator(filename, input);
 
@@ -55,10 +64,12 @@ bool Interpret(const string& filename, const string& input) {
   }
 
   for (size_t i = 0; i < stmts.size(); ++i) {
-    EvalStmt* eval_stmt = dynamic_cast<EvalStmt*>(stmts[i].get());
-    BindTermStmt* term_stmt = dynamic_cast<BindTermStmt*>(stmts[i].get());
-    BindTypeStmt* type_stmt = dynamic_cast<BindTypeStmt*>(stmts[i].get());
+    EvalStmt* eval_stmt = dyn_cast<EvalStmt>(stmts[i].get());
+    BindTermStmt* term_stmt = dyn_cast<BindTermStmt>(stmts[i].get());
+    BindTypeStmt* type_stmt = dyn_cast<BindTypeStmt>(stmts[i].get());
 
+    // Intermediate terms of the statement are released at once with the arena, so it outlives them.
+    Arena arena;
     unique_ptr<TermType> type;
     unique_ptr<Term> term;
 
@@ -69,10 +80,18 @@ bool Interpret(const string& filename, const string& input) {
         printf("%s\n", pprinter.PrettyPrint(term.get()).c_str());
       } else if (term_stmt != nullptr) {
         type = type_checker.TypeCheck(term_stmt->term().get());
-        term = evaluator.Evaluate(term_stmt->term().get());
-        ctx.AddBinding(term_stmt->variable(), new Binding(term.release(), type.release()));
+        if (lazy_toplevel) {
+          locations.Pin();
+          ctx.AddBinding(term_stmt->variable(), Binding::Deferred(term_stmt->term().release(), type.release()));
+        } else {
+          term = evaluator.Evaluate(term_stmt->term().get());
+          unique_ptr<Term> value = HashCons::Value(&ctx, TermExtractor().Extract(term.get()), type.get());
+          locations.Pin();
+          ctx.AddBinding(term_stmt->variable(), new Binding(value.release(), type.release()));
+        }
       } else if (type_stmt != nullptr) {
         type = unique_ptr<TermType>(type_stmt->type()->clone());
+        locations.Pin();
         ctx.AddBinding(type_stmt->type_alias(), new Binding(nullptr, type.release()));
       }
     } catch (const type_exception& e) {
@@ -98,13 +117,32 @@ void Dispatch(const string& input, bool* multi_line_stmts) {
         const TermType* type = ctx.get(i).second->type();
 
         assert(type != nullptr);
-        if (term == nullptr) {
+        if (!ctx.get(i).second->forced()) {
+          printf("%s = <unforced> : %s\n", bind.c_str(), pprinter.PrettyPrint(type).c_str());
+        } else if (term == nullptr) {
           printf("%s = %s\n", bind.c_str(), pprinter.PrettyPrint(type).c_str());
         } else {
           printf("%s = %s : %s\n", bind.c_str(), pprinter.PrettyPrint(term).c_str(), pprinter.PrettyPrint(type).c_str());
         }
       }
     }
+  } else if (input == ":pools") {
+    size_t in_use = 0, reserved = 0;
+    for (const NodePool::Stats& stats : NodePool::stats()) {
+      printf("%4zu bytes: %zu / %zu nodes in use\n", stats.size, stats.in_use, stats.reserved);
+      in_use += stats.size * stats.in_use;
+      reserved += stats.size * stats.reserved;
+    }
+    printf("total: %zu / %zu bytes in use\n", in_use, reserved);
+    printf("locations: %zu spans\n", Location::stats().spans);
+    if (HashCons::enabled()) {
+      const HashCons::Stats stats = HashCons::stats();
+      printf("hash-consed: %zu types, %zu values, %zu hits\n", stats.types, stats.values, stats.hits);
+    }
+  } else if (input == ":compact") {
+    const size_t size = ctx.size();
+    const size_t dropped = CompactContext(&ctx);
+    printf("dropped %zu of %zu bindings.\n", dropped, size);
   } else if (input == ":{") {
     if (*multi_line_stmts) {
       puts("already in multi-line statement mode, skipped.");
@@ -121,6 +159,17 @@ void Dispatch(const string& input, bool* multi_line_stmts) {
 }
 
 int main(int argc, char** argv) {
+  while (argc > 2 && strncmp(argv[1], "--", 2) == 0) {
+    if (strcmp(argv[1], "--lazy-toplevel") == 0) {
+      lazy_toplevel = true;
+    } else if (strcmp(argv[1], "--hash-cons") == 0) {
+      HashCons::set_enabled(true);
+    } else {
+      usage(argc, argv);
+    }
+    --argc;
+    ++argv;
+  }
   if (argc != 2) {
     usage(argc, argv);
   }
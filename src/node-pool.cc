@@ -0,0 +1,90 @@
+#include "node-pool.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#endif
+
+namespace {
+
+const size_t kClasses = NodePool::kMaxSize / NodePool::kGranularity;
+const size_t kSlabSize = 64 * 1024;
+
+struct FreeNode {
+  FreeNode* next;
+};
+
+size_t class_of(size_t size) {
+  return (size + NodePool::kGranularity - 1) / NodePool::kGranularity - 1;
+}
+
+struct Pool {
+  FreeNode* free_lists[kClasses] = {};
+  size_t in_use[kClasses] = {};
+  size_t reserved[kClasses] = {};
+};
+
+// Never destroyed, as nodes of static objects could still be released after it.
+Pool& pool() {
+  static Pool* const pool = new Pool();
+  return *pool;
+}
+
+// Pushes a node of <size> bytes, all but the link of free nodes is poisoned so that the sanitizer still catches uses
+// of released nodes.
+void push(FreeNode** head, void* ptr, size_t size) {
+  FreeNode* const node = static_cast<FreeNode*>(ptr);
+  node->next = *head;
+  *head = node;
+  ASAN_POISON_MEMORY_REGION(node + 1, size - sizeof(FreeNode));
+}
+
+// Fills the empty free list of <index> with a new slab.
+void refill(size_t index) {
+  const size_t size = (index + 1) * NodePool::kGranularity;
+  char* const slab = static_cast<char*>(::operator new(kSlabSize));
+  for (size_t offset = kSlabSize / size * size; offset > 0; offset -= size) {
+    push(&pool().free_lists[index], slab + offset - size, size);
+  }
+  pool().reserved[index] += kSlabSize / size;
+}
+
+}  // namespace
+
+void* NodePool::Allocate(size_t size) {
+  if (size > kMaxSize) {
+    return ::operator new(size);
+  }
+  const size_t index = class_of(size);
+  FreeNode** const lists = pool().free_lists;
+  if (lists[index] == nullptr) {
+    refill(index);
+  }
+  FreeNode* const node = lists[index];
+  lists[index] = node->next;
+  ASAN_UNPOISON_MEMORY_REGION(node, (index + 1) * kGranularity);
+  ++pool().in_use[index];
+  return node;
+}
+
+void NodePool::Release(void* ptr, size_t size) {
+  if (size > kMaxSize) {
+    ::operator delete(ptr);
+    return;
+  }
+  const size_t index = class_of(size);
+  --pool().in_use[index];
+  push(&pool().free_lists[index], ptr, (index + 1) * kGranularity);
+}
+
+std::vector<NodePool::Stats> NodePool::stats() {
+  std::vector<Stats> stats;
+  for (size_t i = 0; i < kClasses; ++i) {
+    if (pool().reserved[i] != 0) {
+      stats.push_back({(i + 1) * kGranularity, pool().in_use[i], pool().reserved[i]});
+    }
+  }
+  return stats;
+}
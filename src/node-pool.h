@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Pools of fixed size classes for AST nodes allocated on the heap, see Term::operator new and
+// TermType::operator new. A released node is put back to the free list of its size class, so that a long session keeps
+// reusing the same memory for nodes of the same class instead of fragmenting the heap. Memory of the pools is never
+// returned to the system.
+//
+// Pools are used by the thread running the interpreter only, neither allocating nor releasing nodes locks.
+//
+// Nodes larger than kMaxSize are allocated with ::operator new.
+class NodePool final {
+ public:
+  static constexpr size_t kGranularity = 16;
+  static constexpr size_t kMaxSize = 256;
+
+  // Occupancy of a size class, in nodes.
+  struct Stats {
+    size_t size;
+    size_t in_use;
+    size_t reserved;
+  };
+
+  NodePool() = delete;
+
+  static void* Allocate(size_t size);
+  static void Release(void* ptr, size_t size);
+
+  // Size classes that have ever been allocated from, in ascending order of size.
+  static std::vector<Stats> stats();
+};
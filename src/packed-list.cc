@@ -0,0 +1,67 @@
+#include "packed-list.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// GCC and clang lower vector extensions to whatever SIMD instructions the target has.
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+
+const size_t kLanes = 4;
+
+// Unaligned load, <v> is passed by pointer to keep vector types out of the function ABI.
+inline void load(u64x4* v, const uint64_t* values) {
+  memcpy(v, values, sizeof(*v));
+}
+
+}  // namespace
+
+namespace packed {
+
+uint64_t Sum(const uint64_t* values, size_t n) {
+  u64x4 acc = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    u64x4 v;
+    load(&v, values + i);
+    acc += v;
+  }
+  uint64_t ret = acc[0] + acc[1] + acc[2] + acc[3];
+  for (; i < n; ++i) {
+    ret += values[i];
+  }
+  return ret;
+}
+
+uint64_t Maximum(const uint64_t* values, size_t n) {
+  u64x4 acc = {values[0], values[0], values[0], values[0]};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    u64x4 v;
+    load(&v, values + i);
+    acc = v > acc ? v : acc;
+  }
+  uint64_t ret = std::max(std::max(acc[0], acc[1]), std::max(acc[2], acc[3]));
+  for (; i < n; ++i) {
+    ret = std::max(ret, values[i]);
+  }
+  return ret;
+}
+
+void Less(const uint64_t* lhs, const uint64_t* rhs, size_t n, uint64_t* out) {
+  const u64x4 one = {1, 1, 1, 1};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    u64x4 l, r;
+    load(&l, lhs + i);
+    load(&r, rhs + i);
+    const u64x4 v = (u64x4) (l < r) & one;
+    memcpy(out + i, &v, sizeof(v));
+  }
+  for (; i < n; ++i) {
+    out[i] = lhs[i] < rhs[i];
+  }
+}
+
+}  // namespace packed
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+
+// Elements of a fully evaluated List[Nat] or List[Bool], Bools are stored as 0 and 1.
+struct PackedCells {
+  enum class Kind { Nat, Bool };
+
+  PackedCells(Kind kind, std::vector<uint64_t> values, SharedTermType list_type)
+    : kind(kind), values(std::move(values)), list_type(std::move(list_type)) { }
+
+  const Kind kind;
+  const std::vector<uint64_t> values;
+  const SharedTermType list_type;  // as the type of 'nil'.
+};
+
+// Vectorized kernels over packed elements.
+namespace packed {
+
+uint64_t Sum(const uint64_t* values, size_t n);
+
+// Requires <n> > 0.
+uint64_t Maximum(const uint64_t* values, size_t n);
+
+// Stores lhs[i] < rhs[i] into out[i], as 0 or 1.
+void Less(const uint64_t* lhs, const uint64_t* rhs, size_t n, uint64_t* out);
+
+}  // namespace packed
@@ -1,11 +1,17 @@
 #include "parser.h"
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "context.h"
 #include "error.h"
+#include "evaluator.h"
+#include "hamt.h"
 #include "lexer.h"
+#include "type-helper.h"
 
 using std::string;
 using std::unique_ptr;
@@ -84,13 +90,150 @@ template <typename T>
 void CheckDuplicateFields(const T& field_container, const LexerIterator* lexer, const string& CFG) {
   unordered_set<string> field_set;
   for (size_t i = 0; i < field_container->size(); ++i) {
-    if (field_set.count(field_container->get(i).first)) {
-      throw ast_exception(lexer->location(), CFG, "found duplicate field <" + field_container->get(i).first + ">");
+    const string& field = field_container->get(i).first.str();
+    if (field_set.count(field)) {
+      throw ast_exception(lexer->location(), CFG, "found duplicate field <" + field + ">");
     }
-    field_set.insert(field_container->get(i).first);
+    field_set.insert(field);
   }
 }
 
+// Builtins named by lcids, see AppTerm().
+const std::unordered_map<string, UnaryTermToken> unary_builtin_list = {
+  {"sum", UnaryTermToken::Sum},
+  {"maximum", UnaryTermToken::Maximum},
+  {"length", UnaryTermToken::Length},
+  {"reverse", UnaryTermToken::Reverse},
+  {"array_length", UnaryTermToken::ArrayLength},
+  {"array_of_list", UnaryTermToken::ArrayOfList},
+  {"list_of_array", UnaryTermToken::ListOfArray},
+  {"map_size", UnaryTermToken::MapSize},
+};
+
+const std::unordered_map<string, BinaryTermToken> binary_builtin_list = {
+  {"append", BinaryTermToken::Append},
+  {"nth", BinaryTermToken::Nth},
+  {"range", BinaryTermToken::Range},
+  {"less", BinaryTermToken::Less},
+  {"array_make", BinaryTermToken::ArrayMake},
+  {"array_get", BinaryTermToken::ArrayGet},
+  {"map_lookup", BinaryTermToken::MapLookup},
+};
+
+const std::unordered_map<string, TernaryTermToken> ternary_builtin_list = {
+  {"foldl", TernaryTermToken::Foldl},
+  {"array_set", TernaryTermToken::ArraySet},
+  {"map_insert", TernaryTermToken::MapInsert},
+};
+
+// The 'letrec' groups being parsed, innermost last. A binding of a group is parsed before the names of the later ones
+// are known, so a name not in scope is taken as a forward reference to one of them. The <k>th forward reference is a
+// variable at the absolute position -1-k of the context, i.e. below its outermost binding, until the group binding the
+// name is closed, see LetRecBindings().
+struct OpenLetRecGroups {
+  struct Forward {
+    string name;
+    Location location;
+    bool bound;
+  };
+
+  int depth = 0;
+  vector<Forward> forwards;
+  // Lcids parsed as builtins in the groups, as long as no later binding shadows them.
+  vector<std::pair<string, Location>> builtins;
+};
+
+thread_local OpenLetRecGroups open_groups;
+
+// Opens a 'letrec' group for the scope, the state of all groups is dropped once the outermost one is closed.
+class OpenLetRecGroup {
+ public:
+  OpenLetRecGroup() { ++open_groups.depth; }
+  ~OpenLetRecGroup() {
+    if (--open_groups.depth == 0) {
+      open_groups.forwards.clear();
+      open_groups.builtins.clear();
+    }
+  }
+
+  OpenLetRecGroup(const OpenLetRecGroup&) = delete;
+  OpenLetRecGroup& operator=(const OpenLetRecGroup&) = delete;
+};
+
+// The index of the variable <lcid> in <ctx>, or of a forward reference to it if a group is open, -1 if not found.
+int VariableIndex(const Context* ctx, const string& lcid, Location location) {
+  const int index = ctx->ToIndex(lcid);
+  if (index != -1 || open_groups.depth == 0) {
+    return index;
+  }
+  open_groups.forwards.push_back({lcid, location, false});
+  return static_cast<int>(ctx->size() + open_groups.forwards.size()) - 1;
+}
+
+void UseBuiltin(const Token* token) {
+  if (open_groups.depth > 0) {
+    open_groups.builtins.emplace_back(token->identifier(), token->location());
+  }
+}
+
+// Maps the free variables of a term, <var> bindings out of the term, to <renumber(var)>, and the aliases the types
+// annotating it refer to the same way.
+class LetRecRenumberer : public TermMapper {
+ public:
+  explicit LetRecRenumberer(std::function<int(int)> renumber) : renumber_(std::move(renumber)) { }
+  TermPtr Renumber(const Term* term) { return Map(term); }
+
+  void Visit(const NilTerm* term) override {
+    set(term, std::make_unique<NilTerm>(term->location(), renumbered(term->list_type().get()).release()));
+  }
+  void Visit(const AbsTerm* term) override {
+    set(term, std::make_unique<AbsTerm>(term->location(), term->variable(),
+                                        renumbered(term->variable_type().get()).release(),
+                                        get(term->term()).release()));
+  }
+  void Visit(const AscribeTerm* term) override {
+    set(term, std::make_unique<AscribeTerm>(term->location(), get(term->term()).release(),
+                                            renumbered(term->ascribe_type().get()).release()));
+  }
+  void Visit(const VariantTerm* term) override {
+    set(term, std::make_unique<VariantTerm>(term->location(), term->tag(), get(term->term()).release(),
+                                            renumbered(term->variant_type().get()).release()));
+  }
+  void Visit(const LetRecTerm* term) override;
+  void Visit(const MapTerm* term) override {
+    set(term, std::make_unique<MapTerm>(term->location(), ShareType(renumbered(term->key_type().get()).release()),
+                                        ShareType(renumbered(term->value_type().get()).release()), term->hamt(),
+                                        term->closed()));
+  }
+
+ protected:
+  TermPtr VariableMap(Location location, int var) override {
+    return std::make_unique<VariableTerm>(location, renumbered(var, depth()));
+  }
+
+ private:
+  int renumbered(int index, int depth) const { return index >= depth ? depth + renumber_(index - depth) : index; }
+  // Renumbers a type under <binders> more variables than the node annotated by it.
+  TermTypePtr renumbered(const TermType* type, int binders = 0) const {
+    const int depth = this->depth() + binders;
+    return TermTypeShifter([this, depth](int index) { return renumbered(index, depth); }).Shift(type);
+  }
+
+  const std::function<int(int)> renumber_;
+};
+
+void LetRecRenumberer::Visit(const LetRecTerm* term) {
+  auto bindings = std::make_shared<LetRecTerm::Bindings>();
+  bindings->reserve(term->size());
+  for (size_t i = 0; i < term->size(); ++i) {
+    const LetRecTerm::Binding& binding = term->get(i);
+    bindings->push_back({binding.variable,
+                         ShareType(renumbered(binding.type.get(), static_cast<int>(term->size())).release()),
+                         get(binding.term)});
+  }
+  set(term, std::make_unique<LetRecTerm>(term->location(), std::move(bindings), get(term->body()).release(), false));
+}
+
 namespace LL {
 
 // Dear bison & flex, you were right, salvation lays within.
@@ -99,10 +242,13 @@ namespace LL {
 // For failure of each function, only throws exception if parser commits to this branch,
 // i.e. some tokens are consumed, otherwise just returns a null pointer.
 
-StmtPtr Statement(LexerIterator*, Context*);
+bool Statement(LexerIterator*, Context*, vector<StmtPtr>*);
 PatternPtr Pattern(LexerIterator*, Context*);
 TypedBindersPtr TypedBinder(LexerIterator*, Context*);
 TypedBindersPtr TypedBinders(LexerIterator*, Context*);
+std::shared_ptr<LetRecTerm::Bindings> LetRecBindings(LexerIterator*, Context*, Location*);
+TermPtr LetRecFix(Location, LetRecTerm::Binding*);
+TermPtr LetRecIn(Location, Location, std::shared_ptr<LetRecTerm::Bindings>, TermPtr);
 TermTypePtr Type(LexerIterator*, Context*);
 TermPtr Term(LexerIterator*, Context*);
 
@@ -111,11 +257,14 @@ TermPtr Term(LexerIterator*, Context*);
 // Statement = Term ';'
 //           | 'type' ucid '=' Type ';'
 //           | 'let' Pattern '=' Term ';'
-//           | 'letrec' TypedBinder '=' Term ';'
+//           | 'letrec' LetRecBindings ';'
+//
+// A 'letrec' with a single binding is desugared into 'fix', otherwise each name of the group is bound by a BindTermStmt
+// of its own.
 
-StmtPtr Statement(LexerIterator* lexer, Context* ctx) {
+bool Statement(LexerIterator* lexer, Context* ctx, vector<StmtPtr>* stmts) {
   const Token* token = lexer->peak();
-  if (token == nullptr) return nullptr;
+  if (token == nullptr) return false;
 
   switch (token->type()) {
     case TokenType::TypeAlias: {
@@ -128,7 +277,8 @@ StmtPtr Statement(LexerIterator* lexer, Context* ctx) {
       assign_or_throw(type, Type(lexer, ctx));
       pop_or_throw(TokenType::Semi);
       ctx->AddName(ucid);
-      return StmtPtr(new BindTypeStmt(Location(token->location(), lexer->last_loc()), ucid, type.release()));
+      stmts->emplace_back(new BindTypeStmt(Location(token->location(), lexer->last_loc()), ucid, type.release()));
+      return true;
     }
     case TokenType::Let: {
       cfg_scope(R"(Statement = 'let' Pattern '=' Term ';')");
@@ -143,8 +293,9 @@ StmtPtr Statement(LexerIterator* lexer, Context* ctx) {
 
       if (lexer->peak() == nullptr || lexer->peak()->type() == TokenType::Semi) {
         pop_or_throw(TokenType::Semi);  // expect to fail if lexer->peak() == nullptr.
-        return StmtPtr(new BindTermStmt(Location(token->location(), lexer->last_loc()),
-                                        pattern.release(), term.release()));
+        stmts->emplace_back(new BindTermStmt(Location(token->location(), lexer->last_loc()),
+                                             pattern.release(), term.release()));
+        return true;
       } else {
         cfg_scope(R"(Statement = Term ';')");
         TermPtr stmt_term;
@@ -160,66 +311,66 @@ StmtPtr Statement(LexerIterator* lexer, Context* ctx) {
                                      pattern->variable(), term.release(), body.release()));
         }());
         pop_or_throw(TokenType::Semi);
-        return StmtPtr(new EvalStmt(Location(token->location(), lexer->last_loc()), stmt_term.release()));
+        stmts->emplace_back(new EvalStmt(Location(token->location(), lexer->last_loc()), stmt_term.release()));
+        return true;
       }
     }
     case TokenType::LetRec: {
-      cfg_scope(R"(Statement = 'letrec' TypedBinder '=' Term ';')");
-      TypedBindersPtr binders;
-      TermPtr term;
+      cfg_scope(R"(Statement = 'letrec' LetRecBindings ';')");
+      std::shared_ptr<LetRecTerm::Bindings> bindings;
+      Location binder = token->location();  // of the first binder, see LetRecBindings().
 
       pop_or_throw(TokenType::LetRec);
-      assign_or_throw(binders, TypedBinder(lexer, ctx));
-      assert(binders->size() == 1);
-      pop_or_throw(TokenType::Eq);
-      assign_or_throw(term, Term(lexer, ctx));
+      assign_or_throw(bindings, LetRecBindings(lexer, ctx, &binder));
+      const size_t size = bindings->size();
 
       if (lexer->peak() == nullptr || lexer->peak()->type() == TokenType::Semi) {
         pop_or_throw(TokenType::Semi);  // expect to fail if lexer->peak() == nullptr.
-
-        const std::string& variable = binders->get(0).first;
-        PatternPtr pattern(new class Pattern(binders->location(), variable));
-        Location location = Location(binders.get(), term.get());
-        TermPtr fix_term(
-            new UnaryTerm(location, UnaryTermToken::Fix,
-              new AbsTerm(location, variable, binders->get(0).second.release(), term.release())));
-        return StmtPtr(new BindTermStmt(Location(token->location(), lexer->last_loc()),
-                                        pattern.release(), fix_term.release()));
+        Location location(token->location(), lexer->last_loc());
+
+        if (size == 1) {
+          PatternPtr pattern(new class Pattern(binder, bindings->at(0).variable.str()));
+          TermPtr fix_term = LetRecFix(binder, &bindings->at(0));
+          stmts->emplace_back(new BindTermStmt(location, pattern.release(), fix_term.release()));
+          return true;
+        }
+        // Every name of the group is bound by a statement of its own, i.e. 'letrec ... in f_i' of the members from f_i
+        // on, as the ones before are bound by the statements before. All of them share the group, which is already
+        // parsed under the names they bind.
+        for (size_t i = 0; i < size; ++i) {
+          TermPtr member(new LetRecTerm(location, bindings, new VariableTerm(location, size - 1 - i), false, i));
+          stmts->emplace_back(new BindTermStmt(location, new class Pattern(location, bindings->at(i).variable.str()),
+                                               member.release()));
+        }
+        return true;
       } else {
         cfg_scope(R"(Statement = Term ';')");
         TermPtr stmt_term;
 
         assign_or_throw(stmt_term, [&]() -> TermPtr {
-          cfg_scope(R"(Term = 'letrec' TypedBinder '=' Term 'in' Term)");
+          cfg_scope(R"(Term = 'letrec' LetRecBindings 'in' Term)");
           TermPtr body;
 
           pop_or_throw(TokenType::In);
           assign_or_throw(body, Term(lexer, ctx));
-          ctx->DropBindings(1);  // throws away the binding introduced in TypedBinder.
-
-          const std::string& variable = binders->get(0).first;
-          PatternPtr pattern(new class Pattern(binders->location(), variable));
-          Location location = Location(binders.get(), term.get());
-          TermPtr fix_term(
-              new UnaryTerm(location, UnaryTermToken::Fix,
-                new AbsTerm(location, variable, binders->get(0).second.release(), term.release())));
-          return TermPtr(new LetTerm(Location(token->location(), lexer->last_loc()),
-                                     pattern->variable(), fix_term.release(), body.release()));
+          ctx->DropBindings(size);  // throws away the bindings introduced in LetRecBindings.
+          return LetRecIn(Location(token->location(), lexer->last_loc()), binder, std::move(bindings), std::move(body));
         }());
         pop_or_throw(TokenType::Semi);
-        return StmtPtr(new EvalStmt(Location(token->location(), lexer->last_loc()), stmt_term.release()));
+        stmts->emplace_back(new EvalStmt(Location(token->location(), lexer->last_loc()), stmt_term.release()));
+        return true;
       }
-      return nullptr;
     }
     default: {
       cfg_scope(R"(Statement = Term ';')");
       TermPtr term;
 
       assign(term, Term(lexer, ctx));
-      if (term == nullptr) return nullptr;
+      if (term == nullptr) return false;
       pop_or_throw(TokenType::Semi);
       Location location(term->location(), lexer->last_loc());
-      return StmtPtr(new EvalStmt(location, term.release()));
+      stmts->emplace_back(new EvalStmt(location, term.release()));
+      return true;
     }
   }
 }
@@ -305,6 +456,97 @@ TypedBindersPtr TypedBinders(LexerIterator* lexer, Context* ctx) {
   return binders;
 }
 
+// LetRecBindings parsers.
+//
+// LetRecBindings = TypedBinder '=' Term
+//                | TypedBinder '=' Term 'and' LetRecBindings
+//
+// All names of the group are bound in every binding and in their types, and are left in context. Each binding is
+// parsed once, under the names up to its own, where the names of the later bindings are forward references. Once the
+// group is closed, the bindings are moved under all of the names. <binder> is set to the location of the first binder.
+
+std::shared_ptr<LetRecTerm::Bindings> LetRecBindings(LexerIterator* lexer, Context* ctx, Location* binder) {
+  cfg_scope(R"(LetRecBindings = TypedBinder '=' Term | TypedBinder '=' Term 'and' LetRecBindings)");
+  OpenLetRecGroup group;
+  const size_t base = ctx->size();
+  const size_t builtins = open_groups.builtins.size();
+  TypedBindersPtr binders;
+
+  assign(binders, TypedBinder(lexer, ctx));
+  if (binders == nullptr) return nullptr;
+  *binder = binders->location();
+
+  std::shared_ptr<LetRecTerm::Bindings> bindings = std::make_shared<LetRecTerm::Bindings>();
+  while (true) {
+    TermPtr term;
+
+    pop_or_throw(TokenType::Eq);
+    assign_or_throw(term, Term(lexer, ctx));
+    bindings->push_back({binders->get(0).first, ShareType(binders->get(0).second.release()), std::move(term)});
+    if (lexer->peak() == nullptr || lexer->peak()->type() != TokenType::And) break;
+    pop_or_throw(TokenType::And);
+    assign_or_throw(binders, TypedBinder(lexer, ctx));
+  }
+
+  // The last binding of each name, which the name refers to in all bindings of the group.
+  const int size = bindings->size();
+  std::unordered_map<string, int> last;
+  for (int i = 0; i < size; ++i) {
+    last[bindings->at(i).variable.str()] = i;
+  }
+  for (size_t i = builtins; i < open_groups.builtins.size(); ++i) {
+    const string& name = open_groups.builtins[i].first;
+    if (last.count(name) != 0) {
+      throw ast_exception(open_groups.builtins[i].second, CFG, "builtin <" + name + "> is used before its binding");
+    }
+  }
+  for (int i = 0; i < size; ++i) {
+    LetRecTerm::Binding& binding = bindings->at(i);
+    // The type is parsed before the name of its binding.
+    binding.type = ShareType(TermTypeShifter(size - i).Shift(binding.type.get()).release());
+    if (i == size - 1) break;  // the last binding is parsed under all of the names.
+    binding.term = LetRecRenumberer([ctx, base, size, i, &last](int var) {
+      int position = static_cast<int>(base) + i - var;
+      const bool forward = position < 0;
+      const string& name =
+          forward ? open_groups.forwards[-1 - position].name : ctx->get(ctx->size() - 1 - position).first;
+      const auto it = last.find(name);
+      if (it != last.end()) {
+        if (forward) {
+          open_groups.forwards[-1 - position].bound = true;
+        }
+        position = static_cast<int>(base) + it->second;
+      }
+      return static_cast<int>(base) + size - 1 - position;
+    }).Renumber(binding.term.get());
+  }
+
+  if (open_groups.depth == 1) {
+    for (const OpenLetRecGroups::Forward& forward : open_groups.forwards) {
+      if (!forward.bound) {
+        throw ast_exception(forward.location, CFG, "variable <" + forward.name + "> is not in scope");
+      }
+    }
+  }
+  return bindings;
+}
+
+// A 'letrec' of a single binding is desugared into 'fix', i.e. 'fix (lambda f:T. t)'.
+TermPtr LetRecFix(Location binder, LetRecTerm::Binding* binding) {
+  Location location(binder, binding->term->location());
+  return TermPtr(new UnaryTerm(location, UnaryTermToken::Fix,
+                               new AbsTerm(location, binding->variable, binding->type, binding->term.release())));
+}
+
+// 'letrec ... in body', where a single binding is bound by 'let' to its 'fix'.
+TermPtr LetRecIn(Location location, Location binder, std::shared_ptr<LetRecTerm::Bindings> bindings, TermPtr body) {
+  if (bindings->size() == 1) {
+    return TermPtr(new LetTerm(location, bindings->at(0).variable, LetRecFix(binder, &bindings->at(0)).release(),
+                               body.release()));
+  }
+  return TermPtr(new LetRecTerm(location, std::move(bindings), body.release(), false));
+}
+
 // Type parsers.
 //
 // Type = ArrowType
@@ -316,14 +558,23 @@ TypedBindersPtr TypedBinders(LexerIterator* lexer, Context* ctx) {
 //            | 'Bool'
 //            | 'Nat'
 //            | 'List' '[' Type ']'
+//            | 'Array' '[' Type ']'
+//            | 'Ref' '[' Type ']'
+//            | 'Map' '[' Type ',' Type ']'
 //            | 'Unit'
 //            | '{' FieldTypes '}'
+//            | '<' TagTypes '>'
 //            | ucid
 //
 // FieldTypes = FieldType
 //            | FieldType ',' FieldTypes
 //
 // FieldType = lcid ':' Type
+//
+// TagTypes = TagType
+//          | TagType ',' TagTypes
+//
+// TagType = lcid ':' Type
 
 TermTypePtr FieldTypes(LexerIterator* lexer, Context* ctx) {
   auto FieldType = [](LexerIterator* lexer, Context* ctx) -> unique_ptr<RecordTermType> {
@@ -358,6 +609,39 @@ TermTypePtr FieldTypes(LexerIterator* lexer, Context* ctx) {
   return TermTypePtr(fields.release());
 }
 
+TermTypePtr TagTypes(LexerIterator* lexer, Context* ctx) {
+  auto TagType = [](LexerIterator* lexer, Context* ctx) -> unique_ptr<VariantTermType> {
+    cfg_scope(R"(TagType = lcid ':' Type)");
+    const Token* token = lexer->peak();
+    if (token == nullptr || token->type() != TokenType::LCaseId) {
+      return nullptr;
+    }
+    TermTypePtr type;
+    unique_ptr<VariantTermType> tag;
+
+    pop_lcid_or_throw(const string& lcid);
+    pop_or_throw(TokenType::Colon);
+    assign_or_throw(type, Type(lexer, ctx));
+    tag = std::make_unique<VariantTermType>(Location(token, type.get()));
+    tag->add(lcid, type.release());
+    return tag;
+  };
+
+  cfg_scope(R"(TagTypes = TagType | TagType ',' TagTypes)");
+  std::unique_ptr<VariantTermType> tags, cur;
+
+  assign(tags, TagType(lexer, ctx));
+  if (tags == nullptr) return nullptr;
+  while (lexer->peak() != nullptr && lexer->peak()->type() == TokenType::Comma) {
+    pop_or_throw(TokenType::Comma);
+    assign_or_throw(cur, TagType(lexer, ctx));
+    tags->relocate(Location(tags.get(), cur.get()));
+    tags->merge(std::move(*cur.release()));
+  }
+  CheckDuplicateFields(tags, lexer, CFG);
+  return TermTypePtr(tags.release());
+}
+
 TermTypePtr AtomicType(LexerIterator* lexer, Context* ctx) {
   const Token* token = lexer->peak();
   if (token == nullptr) return nullptr;
@@ -401,6 +685,39 @@ TermTypePtr AtomicType(LexerIterator* lexer, Context* ctx) {
       pop_or_throw(TokenType::RBracket);
       return TermTypePtr(new ListTermType(Location(token->location(), lexer->last_loc()), type.release()));
     }
+    case TokenType::Array: {
+      cfg_scope(R"(AtomicType = 'Array' '[' Type ']')");
+      TermTypePtr type;
+
+      pop_or_throw(TokenType::Array);
+      pop_or_throw(TokenType::LBracket);
+      assign_or_throw(type, Type(lexer, ctx));
+      pop_or_throw(TokenType::RBracket);
+      return TermTypePtr(new ArrayTermType(Location(token->location(), lexer->last_loc()), type.release()));
+    }
+    case TokenType::URef: {
+      cfg_scope(R"(AtomicType = 'Ref' '[' Type ']')");
+      TermTypePtr type;
+
+      pop_or_throw(TokenType::URef);
+      pop_or_throw(TokenType::LBracket);
+      assign_or_throw(type, Type(lexer, ctx));
+      pop_or_throw(TokenType::RBracket);
+      return TermTypePtr(new RefTermType(Location(token->location(), lexer->last_loc()), type.release()));
+    }
+    case TokenType::Map: {
+      cfg_scope(R"(AtomicType = 'Map' '[' Type ',' Type ']')");
+      TermTypePtr key_type, value_type;
+
+      pop_or_throw(TokenType::Map);
+      pop_or_throw(TokenType::LBracket);
+      assign_or_throw(key_type, Type(lexer, ctx));
+      pop_or_throw(TokenType::Comma);
+      assign_or_throw(value_type, Type(lexer, ctx));
+      pop_or_throw(TokenType::RBracket);
+      return TermTypePtr(new MapTermType(Location(token->location(), lexer->last_loc()), key_type.release(),
+                                         value_type.release()));
+    }
     case TokenType::LCurly: {
       cfg_scope(R"(AtomicType = {' FieldTypes '}')");
       TermTypePtr type;
@@ -411,6 +728,16 @@ TermTypePtr AtomicType(LexerIterator* lexer, Context* ctx) {
       type->relocate(Location(token->location(), lexer->last_loc()));
       return type;
     }
+    case TokenType::LAngle: {
+      cfg_scope(R"(AtomicType = '<' TagTypes '>')");
+      TermTypePtr type;
+
+      pop_or_throw(TokenType::LAngle);
+      assign_or_throw(type, TagTypes(lexer, ctx));
+      pop_or_throw(TokenType::RAngle);
+      type->relocate(Location(token->location(), lexer->last_loc()));
+      return type;
+    }
     case TokenType::UCaseId: {
       cfg_scope(R"(AtomicType = ucid)");
 
@@ -459,7 +786,11 @@ TermTypePtr Type(LexerIterator* lexer, Context* ctx) {
 //      | 'lambda' TypedBinders '.' Term
 //      | 'if' Term 'then' Term 'else' Term
 //      | 'let' Pattern '=' Term 'in' Term
-//      | 'letrec' TypedBinder '=' Term 'in' Term
+//      | 'letrec' LetRecBindings 'in' Term
+//      | 'case' Term 'of' Cases
+//      | 'match' Term 'with' Arms
+//      | AppTerm '==' AppTerm
+//      | AppTerm ':=' Term
 //
 // AppTerm = PathTerm
 //         | 'succ' PathTerm
@@ -469,27 +800,88 @@ TermTypePtr Type(LexerIterator* lexer, Context* ctx) {
 //         | 'isnil' PathTerm
 //         | 'head' PathTerm
 //         | 'tail' PathTerm
+//         | 'sum' PathTerm
+//         | 'maximum' PathTerm
+//         | 'length' PathTerm
+//         | 'reverse' PathTerm
+//         | 'append' PathTerm PathTerm
+//         | 'nth' PathTerm PathTerm
+//         | 'range' PathTerm PathTerm
+//         | 'foldl' PathTerm PathTerm PathTerm
+//         | 'less' PathTerm PathTerm
+//         | 'array_make' PathTerm PathTerm
+//         | 'array_get' PathTerm PathTerm
+//         | 'array_set' PathTerm PathTerm PathTerm
+//         | 'array_length' PathTerm
+//         | 'array_of_list' PathTerm
+//         | 'list_of_array' PathTerm
+//         | 'map_insert' PathTerm PathTerm PathTerm
+//         | 'map_lookup' PathTerm PathTerm
+//         | 'map_size' PathTerm
+//         | 'ref' PathTerm
+//         | '!' PathTerm
 //         | AppTerm PathTerm
 //
+// The builtins from 'sum' to 'map_size', and 'map_empty', are lcids rather than keywords, so that bindings of the same
+// names shadow them.
+//
 // PathTerm = PathTerm '.' lcid
 //          | AscribeTerm
 //
 // AscribeTerm = AtomicTerm
 //             | AtomicTerm 'as' Type
 //
-// AtomicTerm = '(' Term ')'
+// AtomicTerm = '(' Sequence ')'
 //            | 'true'
 //            | 'false'
 //            | int
 //            | 'nil' '[' Type ']'
+//            | 'map_empty' '[' Type ',' Type ']'
 //            | 'unit'
 //            | '{' Fields '}'
+//            | '{' Term 'with' Updates '}'
+//            | '<' lcid ':' Term '>' 'as' Type
 //            | lcid
 //
+// Sequence = Term
+//          | Term ';' Sequence
+//
 // Fields = Field
 //        | Field ',' Fields
 //
 // Field = lcid '=' Term
+//
+// Updates = Update
+//         | Update ',' Updates
+//
+// Update = lcid '=' Term
+//
+// Cases = Case
+//       | Case '|' Cases
+//
+// Case = '<' lcid ':' Pattern '>' '->' Term
+//
+// Arms = Arm '|' Arm
+//
+// Arm = 'nil' '->' Term
+//     | 'cons' Pattern Pattern '->' Term
+//     | '0' '->' Term
+//     | 'succ' Pattern '->' Term
+
+// Sequences are nested to the right, the value of a sequence is the value of its last term.
+TermPtr Sequence(LexerIterator* lexer, Context* ctx) {
+  cfg_scope(R"(Sequence = Term | Term ';' Sequence)");
+  TermPtr term, rest;
+
+  assign(term, Term(lexer, ctx));
+  if (term == nullptr || lexer->peak() == nullptr || lexer->peak()->type() != TokenType::Semi) {
+    return term;
+  }
+  pop_or_throw(TokenType::Semi);
+  assign_or_throw(rest, Sequence(lexer, ctx));
+  Location location(term.get(), rest.get());
+  return TermPtr(new BinaryTerm(location, BinaryTermToken::Seq, term.release(), rest.release()));
+}
 
 TermPtr Fields(LexerIterator* lexer, Context* ctx) {
   auto Field = [](LexerIterator* lexer, Context* ctx) -> unique_ptr<RecordTerm> {
@@ -524,17 +916,138 @@ TermPtr Fields(LexerIterator* lexer, Context* ctx) {
   return TermPtr(fields.release());
 }
 
+TermPtr Updates(LexerIterator* lexer, Context* ctx, TermPtr term) {
+  auto Update = [](LexerIterator* lexer, Context* ctx, RecordUpdateTerm* update_term) {
+    cfg_scope(R"(Update = lcid '=' Term)");
+    TermPtr term;
+
+    pop_lcid_or_throw(const string& lcid);
+    pop_or_throw(TokenType::Eq);
+    assign_or_throw(term, Term(lexer, ctx));
+    for (size_t i = 0; i < update_term->size(); ++i) {
+      if (update_term->get(i).field.str() == lcid) {
+        throw ast_exception(lexer->location(), CFG, "found duplicate field <" + lcid + ">");
+      }
+    }
+    update_term->add(lcid, term.release());
+  };
+
+  cfg_scope(R"(Updates = Update | Update ',' Updates)");
+  const Location location = term->location();
+  unique_ptr<RecordUpdateTerm> update_term = std::make_unique<RecordUpdateTerm>(location, term.release());
+
+  Update(lexer, ctx, update_term.get());
+  while (lexer->peak() != nullptr && lexer->peak()->type() == TokenType::Comma) {
+    pop_or_throw(TokenType::Comma);
+    Update(lexer, ctx, update_term.get());
+  }
+  return TermPtr(update_term.release());
+}
+
+TermPtr Cases(LexerIterator* lexer, Context* ctx, TermPtr term) {
+  auto Case = [](LexerIterator* lexer, Context* ctx, CaseTerm* case_term) {
+    cfg_scope(R"(Case = '<' lcid ':' Pattern '>' '->' Term)");
+    PatternPtr pattern;
+    TermPtr body;
+
+    pop_or_throw(TokenType::LAngle);
+    pop_lcid_or_throw(const string& lcid);
+    pop_or_throw(TokenType::Colon);
+    assign_or_throw(pattern, Pattern(lexer, ctx));
+    pop_or_throw(TokenType::RAngle);
+    pop_or_throw(TokenType::Arrow);
+    ctx->AddName(pattern->variable());
+    assign_or_throw(body, Term(lexer, ctx));
+    ctx->DropBindings(1);  // throws away the binding introduced in Pattern.
+    case_term->add(lcid, pattern->variable(), body.release());
+  };
+
+  cfg_scope(R"(Cases = Case | Case '|' Cases)");
+  const Location location = term->location();
+  unique_ptr<CaseTerm> case_term = std::make_unique<CaseTerm>(location, term.release());
+
+  Case(lexer, ctx, case_term.get());
+  while (lexer->peak() != nullptr && lexer->peak()->type() == TokenType::Bar) {
+    pop_or_throw(TokenType::Bar);
+    Case(lexer, ctx, case_term.get());
+  }
+  for (size_t i = 1; i < case_term->size(); ++i) {
+    // Branches are sorted by tag, so duplicates are next to each other.
+    if (case_term->get(i - 1).tag == case_term->get(i).tag) {
+      throw ast_exception(lexer->location(), CFG, "found duplicate tag <" + case_term->get(i).tag.str() + ">");
+    }
+  }
+  return TermPtr(case_term.release());
+}
+
+TermPtr Arms(LexerIterator* lexer, Context* ctx, TermPtr term) {
+  struct ParsedArm {
+    MatchTermToken type;
+    vector<Symbol> variables;  // empty for the arm of 'nil' or '0'.
+    TermPtr body;
+  };
+
+  auto Arm = [](LexerIterator* lexer, Context* ctx) -> ParsedArm {
+    cfg_scope(R"(Arm = 'nil' '->' Term | 'cons' Pattern Pattern '->' Term | '0' '->' Term | 'succ' Pattern '->' Term)");
+    const Token* token = lexer->peak();
+    ParsedArm arm;
+
+    if (token != nullptr && token->type() == TokenType::Nil) {
+      pop_or_throw(TokenType::Nil);
+      arm.type = MatchTermToken::List;
+    } else if (token != nullptr && token->type() == TokenType::Int && token->number() == 0) {
+      lexer->pop();
+      arm.type = MatchTermToken::Nat;
+    } else if (token != nullptr && (token->type() == TokenType::Cons || token->type() == TokenType::Succ)) {
+      PatternPtr pattern;
+
+      lexer->pop();
+      arm.type = token->type() == TokenType::Cons ? MatchTermToken::List : MatchTermToken::Nat;
+      for (int i = arm.type == MatchTermToken::List ? 2 : 1; i > 0; --i) {
+        assign_or_throw(pattern, Pattern(lexer, ctx));
+        arm.variables.push_back(pattern->variable());
+      }
+    } else {
+      throw ast_exception(lexer->location(), CFG, "expect an Arm");
+    }
+    pop_or_throw(TokenType::Arrow);
+    for (Symbol variable : arm.variables) {
+      ctx->AddName(variable.str());
+    }
+    assign_or_throw(arm.body, Term(lexer, ctx));
+    ctx->DropBindings(arm.variables.size());  // throws away the bindings introduced in Patterns.
+    return arm;
+  };
+
+  cfg_scope(R"(Arms = Arm '|' Arm)");
+  ParsedArm arm1, arm2;
+
+  assign(arm1, Arm(lexer, ctx));
+  pop_or_throw(TokenType::Bar);
+  assign(arm2, Arm(lexer, ctx));
+  if (arm1.type != arm2.type || arm1.variables.empty() == arm2.variables.empty()) {
+    throw ast_exception(lexer->location(), CFG, arm1.type == MatchTermToken::List ? "expect a 'nil' and a 'cons' arm"
+                                                                                  : "expect a '0' and a 'succ' arm");
+  }
+  if (!arm1.variables.empty()) {
+    std::swap(arm1, arm2);
+  }
+  const Location location = term->location();
+  return TermPtr(new MatchTerm(location, arm1.type, term.release(), arm1.body.release(), std::move(arm2.variables),
+                               arm2.body.release()));
+}
+
 TermPtr AtomicTerm(LexerIterator* lexer, Context* ctx) {
   const Token* token = lexer->peak();
   if (token == nullptr) return nullptr;
 
   switch (token->type()) {
     case TokenType::LParen: {
-      cfg_scope(R"(AtomicTerm = '(' Term ')')");
+      cfg_scope(R"(AtomicTerm = '(' Sequence ')')");
       TermPtr term;
 
       pop_or_throw(TokenType::LParen);
-      assign_or_throw(term, Term(lexer, ctx));
+      assign_or_throw(term, Sequence(lexer, ctx));
       pop_or_throw(TokenType::RParen);
       term->relocate(Location(token->location(), lexer->last_loc()));
       return term;
@@ -576,20 +1089,60 @@ TermPtr AtomicTerm(LexerIterator* lexer, Context* ctx) {
       return TermPtr(new NullaryTerm(token->location(), NullaryTermToken::Unit));
     }
     case TokenType::LCurly: {
-      cfg_scope(R"(AtomicTerm = '{' Fields '}')");
+      cfg_scope(R"(AtomicTerm = '{' Fields '}' | '{' Term 'with' Updates '}')");
       TermPtr term;
 
       pop_or_throw(TokenType::LCurly);
-      assign_or_throw(term, Fields(lexer, ctx));
+      // A record starts with a field name and a colon, anything else is the record to update.
+      LexerIterator lookahead = *lexer;
+      const Token* const first = lookahead.pop();
+      if (first != nullptr && first->type() == TokenType::LCaseId &&
+          lookahead.peak() != nullptr && lookahead.peak()->type() == TokenType::Colon) {
+        assign_or_throw(term, Fields(lexer, ctx));
+      } else {
+        TermPtr record;
+
+        assign_or_throw(record, Term(lexer, ctx));
+        pop_or_throw(TokenType::With);
+        assign_or_throw(term, Updates(lexer, ctx, std::move(record)));
+      }
       pop_or_throw(TokenType::RCurly);
       term->relocate(Location(token->location(), lexer->last_loc()));
       return term;
     }
+    case TokenType::LAngle: {
+      cfg_scope(R"(AtomicTerm = '<' lcid ':' Term '>' 'as' Type)");
+      TermPtr term;
+      TermTypePtr type;
+
+      pop_or_throw(TokenType::LAngle);
+      pop_lcid_or_throw(const string& lcid);
+      pop_or_throw(TokenType::Colon);
+      assign_or_throw(term, Term(lexer, ctx));
+      pop_or_throw(TokenType::RAngle);
+      pop_or_throw(TokenType::As);
+      assign_or_throw(type, Type(lexer, ctx));
+      return TermPtr(new VariantTerm(Location(token->location(), lexer->last_loc()), lcid, term.release(),
+                                     type.release()));
+    }
     case TokenType::LCaseId: {
+      if (token->identifier() == "map_empty" && ctx->ToIndex("map_empty") == -1) {
+        cfg_scope(R"(AtomicTerm = 'map_empty' '[' Type ',' Type ']')");
+        TermTypePtr key_type, value_type;
+
+        UseBuiltin(lexer->pop());
+        pop_or_throw(TokenType::LBracket);
+        assign_or_throw(key_type, Type(lexer, ctx));
+        pop_or_throw(TokenType::Comma);
+        assign_or_throw(value_type, Type(lexer, ctx));
+        pop_or_throw(TokenType::RBracket);
+        return TermPtr(new MapTerm(Location(token->location(), lexer->last_loc()), std::move(key_type),
+                                   std::move(value_type), std::make_shared<const Hamt>(), true));
+      }
       cfg_scope(R"(AtomicTerm = lcid)");
 
       pop_lcid_or_throw(const string& lcid);
-      int index = ctx->ToIndex(lcid);
+      int index = VariableIndex(ctx, lcid, lexer->last_loc());
       if (index == -1) throw ast_exception(lexer->last_loc(), CFG, "variable <" + lcid + "> is not in scope");
       return TermPtr(new VariableTerm(lexer->last_loc(), index));
     }
@@ -636,6 +1189,51 @@ TermPtr PathTerm(LexerIterator* lexer, Context* ctx) {
   return term;
 }
 
+// An lcid naming a builtin is the builtin unless a binding of the name is in scope, otherwise returns a null pointer.
+// Inside of a 'letrec' group, a builtin is an error if a later binding of the group shadows it, see LetRecBindings().
+TermPtr BuiltinTerm(LexerIterator* lexer, Context* ctx) {
+  const Token* token = lexer->peak();
+  if (token == nullptr || token->type() != TokenType::LCaseId || ctx->ToIndex(token->identifier()) != -1) {
+    return nullptr;
+  }
+
+  const auto unary_builtin = unary_builtin_list.find(token->identifier());
+  if (unary_builtin != unary_builtin_list.end()) {
+    cfg_scope(R"(AppTerm = lcid PathTerm)");
+    TermPtr path_term;
+
+    UseBuiltin(lexer->pop());
+    assign_or_throw(path_term, PathTerm(lexer, ctx));
+    Location location(token, path_term.get());
+    return TermPtr(new UnaryTerm(location, unary_builtin->second, path_term.release()));
+  }
+  const auto binary_builtin = binary_builtin_list.find(token->identifier());
+  if (binary_builtin != binary_builtin_list.end()) {
+    cfg_scope(R"(AppTerm = lcid PathTerm PathTerm)");
+    TermPtr term1, term2;
+
+    UseBuiltin(lexer->pop());
+    assign_or_throw(term1, PathTerm(lexer, ctx));
+    assign_or_throw(term2, PathTerm(lexer, ctx));
+    Location location(token, term2.get());
+    return TermPtr(new BinaryTerm(location, binary_builtin->second, term1.release(), term2.release()));
+  }
+  const auto ternary_builtin = ternary_builtin_list.find(token->identifier());
+  if (ternary_builtin != ternary_builtin_list.end()) {
+    cfg_scope(R"(AppTerm = lcid PathTerm PathTerm PathTerm)");
+    TermPtr term1, term2, term3;
+
+    UseBuiltin(lexer->pop());
+    assign_or_throw(term1, PathTerm(lexer, ctx));
+    assign_or_throw(term2, PathTerm(lexer, ctx));
+    assign_or_throw(term3, PathTerm(lexer, ctx));
+    Location location(token, term3.get());
+    return TermPtr(new TernaryTerm(location, ternary_builtin->second, term1.release(), term2.release(),
+                                   term3.release()));
+  }
+  return nullptr;
+}
+
 // AppTerm introduces left recursion. The expansion of AppTerm can be viewed as
 //   {PathTerm, 'succ' PathTerm ...} [PathTerm]*
 TermPtr AppTerm(LexerIterator* lexer, Context* ctx) {
@@ -661,22 +1259,41 @@ TermPtr AppTerm(LexerIterator* lexer, Context* ctx) {
     unary_term(IsNil, isnil);
     unary_term(Head, head);
     unary_term(Tail, tail);
+    unary_term(Ref, ref);
 
 #undef unary_term
 
-    case (TokenType::Cons): {
-      cfg_scope(R"(AppTerm = 'cons' PathTerm PathTerm)");
-      TermPtr term1, term2;
+    case TokenType::Bang: {
+      cfg_scope(R"(AppTerm = '!' PathTerm)");
+      TermPtr path_term;
 
-      pop_or_throw(TokenType::Cons);
-      assign_or_throw(term1, PathTerm(lexer, ctx));
-      assign_or_throw(term2, PathTerm(lexer, ctx));
-      Location location(token, term2.get());
-      term = TermPtr(new BinaryTerm(location, BinaryTermToken::Cons, term1.release(), term2.release()));
+      pop_or_throw(TokenType::Bang);
+      assign_or_throw(path_term, PathTerm(lexer, ctx));
+      Location location(token, path_term.get());
+      term = TermPtr(new UnaryTerm(location, UnaryTermToken::Deref, path_term.release()));
     } break;
+
+#define binary_term(token_type, token_id) \
+    case (TokenType::token_type): { \
+      cfg_scope(R"(AppTerm = ')" #token_id R"(' PathTerm PathTerm)"); \
+      TermPtr term1, term2; \
+       \
+      pop_or_throw(TokenType::token_type); \
+      assign_or_throw(term1, PathTerm(lexer, ctx)); \
+      assign_or_throw(term2, PathTerm(lexer, ctx)); \
+      Location location(token, term2.get()); \
+      term = TermPtr(new BinaryTerm(location, BinaryTermToken::token_type, term1.release(), term2.release())); \
+    } break
+
+    binary_term(Cons, cons);
+
+#undef binary_term
+
     default: {
       cfg_scope(R"(AppTerm = PathTerm)");
 
+      assign(term, BuiltinTerm(lexer, ctx));
+      if (term != nullptr) break;
       assign(term, PathTerm(lexer, ctx));
       if (term == nullptr) return nullptr;
     }
@@ -745,34 +1362,62 @@ TermPtr Term(LexerIterator* lexer, Context* ctx) {
                                  pattern->variable(), term.release(), body.release()));
     }
     case TokenType::LetRec: {
-      cfg_scope(R"(Term = 'letrec' TypedBinder '=' Term 'in' Term)");
-      TypedBindersPtr binders;
-      TermPtr term, body;
+      cfg_scope(R"(Term = 'letrec' LetRecBindings 'in' Term)");
+      std::shared_ptr<LetRecTerm::Bindings> bindings;
+      Location binder = token->location();  // of the first binder, see LetRecBindings().
+      TermPtr body;
 
       pop_or_throw(TokenType::LetRec);
-      assign_or_throw(binders, TypedBinder(lexer, ctx));
-      assert(binders->size() == 1);
-      pop_or_throw(TokenType::Eq);
-      assign_or_throw(term, Term(lexer, ctx));
+      assign_or_throw(bindings, LetRecBindings(lexer, ctx, &binder));
       pop_or_throw(TokenType::In);
       assign_or_throw(body, Term(lexer, ctx));
-      ctx->DropBindings(1);  // throws away the binding introduced in TypedBinder.
-
-      const std::string& variable = binders->get(0).first;
-      PatternPtr pattern(new class Pattern(binders->location(), variable));
-      Location location = Location(binders.get(), term.get());
-      TermPtr fix_term(
-          new UnaryTerm(location, UnaryTermToken::Fix,
-            new AbsTerm(location, variable, binders->get(0).second.release(), term.release())));
-      return TermPtr(new LetTerm(Location(token->location(), lexer->last_loc()),
-                                 pattern->variable(), fix_term.release(), body.release()));
+      ctx->DropBindings(bindings->size());  // throws away the bindings introduced in LetRecBindings.
+      return LetRecIn(Location(token->location(), lexer->last_loc()), binder, std::move(bindings), std::move(body));
+    }
+    case TokenType::Case: {
+      cfg_scope(R"(Term = 'case' Term 'of' Cases)");
+      TermPtr term, case_term;
+
+      pop_or_throw(TokenType::Case);
+      assign_or_throw(term, Term(lexer, ctx));
+      pop_or_throw(TokenType::Of);
+      assign_or_throw(case_term, Cases(lexer, ctx, std::move(term)));
+      case_term->relocate(Location(token->location(), lexer->last_loc()));
+      return case_term;
+    }
+    case TokenType::Match: {
+      cfg_scope(R"(Term = 'match' Term 'with' Arms)");
+      TermPtr term, match_term;
+
+      pop_or_throw(TokenType::Match);
+      assign_or_throw(term, Term(lexer, ctx));
+      pop_or_throw(TokenType::With);
+      assign_or_throw(match_term, Arms(lexer, ctx, std::move(term)));
+      match_term->relocate(Location(token->location(), lexer->last_loc()));
+      return match_term;
     }
     default: {
-      cfg_scope(R"(Term = AppTerm)");
-      TermPtr term;
+      cfg_scope(R"(Term = AppTerm | AppTerm '==' AppTerm | AppTerm ':=' Term)");
+      TermPtr term, rhs;
 
       assign(term, AppTerm(lexer, ctx));
-      return term;
+      if (term == nullptr || lexer->peak() == nullptr) {
+        return term;
+      }
+      if (lexer->peak()->type() == TokenType::ColonEq) {
+        // The assigned value could be any term, e.g. 'r := lambda x:Nat. x'.
+        pop_or_throw(TokenType::ColonEq);
+        assign_or_throw(rhs, Term(lexer, ctx));
+        Location location(term.get(), rhs.get());
+        return TermPtr(new BinaryTerm(location, BinaryTermToken::Assign, term.release(), rhs.release()));
+      }
+      if (lexer->peak()->type() != TokenType::EqEq) {
+        return term;
+      }
+      pop_or_throw(TokenType::EqEq);
+      assign_or_throw(rhs, AppTerm(lexer, ctx));
+      Location location(term.get(), rhs.get());
+      return TermPtr(new BinaryTerm(location, BinaryTermToken::Equal, term.release(), rhs.release()));
     }
   }
 }
@@ -793,19 +1438,15 @@ vector<StmtPtr> Parser::ParseAST(Context* ctx) {
   ctx = ctx != nullptr ? ctx : &empty_ctx;
   const size_t old_size = ctx->size();
   do {
-    StmtPtr stmt;
+    bool parsed;
     try {
-      stmt = LL::Statement(&lexer_iter, ctx);
+      parsed = LL::Statement(&lexer_iter, ctx, &stmts);
     } catch (ast_exception e) {
       ctx->DropBindingsTo(old_size);
       throw ast_exception(std::move(e), CFG);
     }
-    if (stmt == nullptr) {
-      if (!lexer_iter.eof()) {
-        throw ast_exception(lexer_iter.location(), CFG, "expect a statement");
-      }
-    } else {
-      stmts.push_back(std::move(stmt));
+    if (!parsed && !lexer_iter.eof()) {
+      throw ast_exception(lexer_iter.location(), CFG, "expect a statement");
     }
   } while (!lexer_iter.eof());
   // Restore the Context to leave it unchanged.
@@ -1,21 +1,56 @@
 #include "pprinter.h"
 
+#include <iterator>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "ast.h"
 #include "context.h"
+#include "evaluator.h"
+#include "hamt.h"
+#include "packed-list.h"
 
 using std::string;
 using std::unique_ptr;
 
 string PrettyPrinter::PrettyPrint(const Term* term) {
-  term->Accept(this);
-  string ret = get(term);
-  term_pprints_.clear();
+  // Pieces left to print, the next one on the back. Terms are expanded into their pieces one at a time instead of being
+  // printed recursively, so that deep terms, e.g. long lists, do not overflow the stack.
+  std::vector<Piece> pending;
+  pending.push_back(Piece{Piece::Kind::Term, string(), term});
+
+  string pprint;
+  while (!pending.empty()) {
+    Piece piece = std::move(pending.back());
+    pending.pop_back();
+    switch (piece.kind) {
+      case Piece::Kind::Text: {
+        pprint += piece.text;
+      } break;
+      case Piece::Kind::Term: {
+        pieces_.clear();
+        piece.term->Accept(this);
+        pending.insert(pending.end(), std::make_move_iterator(pieces_.rbegin()),
+                       std::make_move_iterator(pieces_.rend()));
+      } break;
+      case Piece::Kind::AddName: {
+        ctx_->AddName(piece.text);
+      } break;
+      case Piece::Kind::DropBindings: {
+        ctx_->DropBindings(piece.size);
+      } break;
+      case Piece::Kind::ReleaseCell: {
+        printing_cells_.erase(piece.cell);
+      } break;
+    }
+  }
+  pieces_.clear();
   not_nat_.clear();
-  return ret;
+  shifted_values_.clear();
+  return pprint;
 }
 
 string PrettyPrinter::PrettyPrint(const TermType* type) {
@@ -27,34 +62,64 @@ string PrettyPrinter::PrettyPrint(const TermType* type) {
 
 // Term Visitor.
 
+void PrettyPrinter::Append(string text) {
+  pieces_.push_back(Piece{Piece::Kind::Text, std::move(text)});
+}
+
+void PrettyPrinter::Append(const Term* term) {
+  pieces_.push_back(Piece{Piece::Kind::Term, string(), term});
+}
+
+void PrettyPrinter::Append(const Term* term, bool parens) {
+  if (parens) {
+    Append("(");
+    Append(term);
+    Append(")");
+  } else {
+    Append(term);
+  }
+}
+
+void PrettyPrinter::AppendName(string name) {
+  pieces_.push_back(Piece{Piece::Kind::AddName, std::move(name)});
+}
+
+void PrettyPrinter::AppendDrop(size_t size) {
+  Piece piece{Piece::Kind::DropBindings};
+  piece.size = size;
+  pieces_.push_back(std::move(piece));
+}
+
 void PrettyPrinter::Visit(const NullaryTerm* term) {
   switch (term->type()) {
     case NullaryTermToken::True: {
-      term_pprints_[term] = "true";
+      Append("true");
     } break;
     case NullaryTermToken::False: {
-      term_pprints_[term] = "false";
+      Append("false");
     } break;
     case NullaryTermToken::Unit: {
-      term_pprints_[term] = "unit";
+      Append("unit");
     } break;
     case NullaryTermToken::Zero: {
-      term_pprints_[term] = "0";
+      Append("0");
     } break;
   }
 }
 
+void PrettyPrinter::Visit(const NatTerm* term) {
+  Append(std::to_string(term->value()));
+}
+
 void PrettyPrinter::Visit(const UnaryTerm* term) {
   if (term->type() == UnaryTermToken::Succ) {
-    int nat = 0;
+    uint64_t nat = 0;
     if (IsPrintableNatTerm(term, &nat)) {
-      term_pprints_[term] = std::to_string(nat);
+      Append(std::to_string(nat));
       return;
     }
   }
 
-  term->term()->Accept(this);
-
   string func;
   switch (term->type()) {
     case (UnaryTermToken::Succ): {
@@ -78,143 +143,380 @@ void PrettyPrinter::Visit(const UnaryTerm* term) {
     case (UnaryTermToken::Fix): {
       func = "fix";
     } break;
+    case (UnaryTermToken::Sum): {
+      func = "sum";
+    } break;
+    case (UnaryTermToken::Maximum): {
+      func = "maximum";
+    } break;
+    case (UnaryTermToken::Length): {
+      func = "length";
+    } break;
+    case (UnaryTermToken::Reverse): {
+      func = "reverse";
+    } break;
+    case (UnaryTermToken::ArrayLength): {
+      func = "array_length";
+    } break;
+    case (UnaryTermToken::ArrayOfList): {
+      func = "array_of_list";
+    } break;
+    case (UnaryTermToken::ListOfArray): {
+      func = "list_of_array";
+    } break;
+    case (UnaryTermToken::MapSize): {
+      func = "map_size";
+    } break;
+    case (UnaryTermToken::Ref): {
+      func = "ref";
+    } break;
+    case (UnaryTermToken::Deref): {
+      Append("!");
+      Append(term->term().get(), term->term()->ast_level() <= term->ast_level());
+    } return;
   }
-  if (term->term()->ast_level() <= term->ast_level()) {
-    term_pprints_[term] = func + " (" + get(term->term()) + ")";
-  } else {
-    term_pprints_[term] = func + " " + get(term->term());
-  }
+  Append(func + " ");
+  Append(term->term().get(), term->term()->ast_level() <= term->ast_level());
 }
 
 void PrettyPrinter::Visit(const BinaryTerm* term) {
-  term->term1()->Accept(this);
-  term->term2()->Accept(this);
+  string func;
   switch (term->type()) {
     case BinaryTermToken::Cons: {
       // TODO(foreverbell): pretty printer for list.
-      term_pprints_[term] = "cons ";
-      if (term->term1()->ast_level() <= term->ast_level()) {
-        term_pprints_[term] += "(" + get(term->term1()) + ")";
-      } else {
-        term_pprints_[term] += get(term->term1());
-      }
-      term_pprints_[term] += " ";
-      if (term->term2()->ast_level() <= term->ast_level()) {
-        term_pprints_[term] += "(" + get(term->term2()) + ")";
-      } else {
-        term_pprints_[term] += get(term->term2());
-      }
+      func = "cons";
+    } break;
+    case BinaryTermToken::Append: {
+      func = "append";
+    } break;
+    case BinaryTermToken::Nth: {
+      func = "nth";
+    } break;
+    case BinaryTermToken::Range: {
+      func = "range";
+    } break;
+    case BinaryTermToken::Less: {
+      func = "less";
+    } break;
+    case BinaryTermToken::ArrayMake: {
+      func = "array_make";
     } break;
+    case BinaryTermToken::ArrayGet: {
+      func = "array_get";
+    } break;
+    case BinaryTermToken::MapLookup: {
+      func = "map_lookup";
+    } break;
+    case BinaryTermToken::Assign: {
+      // 'AppTerm := Term'.
+      Append(term->term1().get(), term->term1()->ast_level() <= term->ast_level());
+      Append(" := ");
+      Append(term->term2().get());
+    } return;
+    case BinaryTermToken::Equal: {
+      // Both operands are AppTerms, i.e. 'AppTerm == AppTerm'.
+      Append(term->term1().get(), term->term1()->ast_level() <= term->ast_level());
+      Append(" == ");
+      Append(term->term2().get(), term->term2()->ast_level() <= term->ast_level());
+    } return;
+    case BinaryTermToken::Seq: {
+      // A sequence nested on the right is a continuation of this one, its parentheses are dropped.
+      Append("(");
+      const BinaryTerm* seq_term = term;
+      for (;;) {
+        Append(seq_term->term1().get());
+        Append("; ");
+        const BinaryTerm* const rest = dyn_cast<BinaryTerm>(seq_term->term2().get());
+        if (rest == nullptr || rest->type() != BinaryTermToken::Seq) {
+          break;
+        }
+        seq_term = rest;
+      }
+      Append(seq_term->term2().get());
+      Append(")");
+    } return;
     case BinaryTermToken::App: {
       // Use '<' here instead of '<=', for the grammar is 'AppTerm = AppTerm PathTerm'.
-      if (term->term1()->ast_level() < term->ast_level()) {
-        term_pprints_[term] += "(" + get(term->term1()) + ")";
-      } else {
-        term_pprints_[term] += get(term->term1());
-      }
-      term_pprints_[term] += " ";
-      if (term->term2()->ast_level() <= term->ast_level()) {
-        term_pprints_[term] += "(" + get(term->term2()) + ")";
-      } else {
-        term_pprints_[term] += get(term->term2());
-      }
-    } break;
+      Append(term->term1().get(), term->term1()->ast_level() < term->ast_level());
+      Append(" ");
+      Append(term->term2().get(), term->term2()->ast_level() <= term->ast_level());
+    } return;
   }
+  Append(func + " ");
+  Append(term->term1().get(), term->term1()->ast_level() <= term->ast_level());
+  Append(" ");
+  Append(term->term2().get(), term->term2()->ast_level() <= term->ast_level());
 }
 
 void PrettyPrinter::Visit(const TernaryTerm* term) {
-  term->term1()->Accept(this);
-  term->term2()->Accept(this);
-  term->term3()->Accept(this);
   switch (term->type()) {
     case (TernaryTermToken::If): {
-      term_pprints_[term] = "if ";
-      term_pprints_[term] += get(term->term1());
-      term_pprints_[term] += " then ";
-      term_pprints_[term] += get(term->term2());
-      term_pprints_[term] += " else ";
-      term_pprints_[term] += get(term->term3());
+      Append("if ");
+      Append(term->term1().get());
+      Append(" then ");
+      Append(term->term2().get());
+      Append(" else ");
+      Append(term->term3().get());
+    } break;
+    case (TernaryTermToken::Foldl):
+    case (TernaryTermToken::ArraySet):
+    case (TernaryTermToken::MapInsert): {
+      if (term->type() == TernaryTermToken::Foldl) {
+        Append("foldl");
+      } else {
+        Append(term->type() == TernaryTermToken::ArraySet ? "array_set" : "map_insert");
+      }
+      for (const Term* subterm : {term->term1().get(), term->term2().get(), term->term3().get()}) {
+        Append(" ");
+        Append(subterm, subterm->ast_level() <= term->ast_level());
+      }
     } break;
   }
 }
 
 void PrettyPrinter::Visit(const NilTerm* term) {
-  term_pprints_[term] = "nil[" + PrettyPrint(term->list_type().get()) + "]";
+  Append("nil[" + PrettyPrint(term->list_type().get()) + "]");
 }
 
 void PrettyPrinter::Visit(const VariableTerm* term) {
-  term_pprints_[term] = ctx_->get(term->index()).first;
+  Append(ctx_->get(term->index()).first);
 }
 
 void PrettyPrinter::Visit(const RecordTerm* term) {
-  term_pprints_[term] = "{";
+  Append("{");
   for (size_t i = 0; i < term->size(); ++i) {
-    if (i != 0) {
-      term_pprints_[term] += ",";
-    }
-    const unique_ptr<Term>& subterm = term->get(i).second;
-    subterm->Accept(this);
-    term_pprints_[term] += term->get(i).first + ":" + get(subterm);
+    Append((i != 0 ? "," : "") + term->get(i).first.str() + ":");
+    Append(term->get(i).second.get());
   }
-  term_pprints_[term] += "}";
+  Append("}");
 }
 
 void PrettyPrinter::Visit(const ProjectTerm* term) {
-  term->term()->Accept(this);
-  if (term->term()->ast_level() < term->ast_level()) {
-    term_pprints_[term] = "(" + get(term->term()) + ")." + term->field();
-  } else {
-    term_pprints_[term] = get(term->term()) + "." + term->field();
+  Append(term->term().get(), term->term()->ast_level() < term->ast_level());
+  Append("." + term->field().str());
+}
+
+void PrettyPrinter::Visit(const RecordUpdateTerm* term) {
+  Append("{");
+  Append(term->term().get());
+  Append(" with ");
+  for (size_t i = 0; i < term->size(); ++i) {
+    Append((i != 0 ? ", " : "") + term->get(i).field.str() + " = ");
+    Append(term->get(i).term.get());
   }
+  Append("}");
 }
 
-void PrettyPrinter::Visit(const LetTerm* term) {
-  term->bind_term()->Accept(this);
+// Binders pick their fresh names as they are expanded, and drop them right away. The names are bound again only while
+// the pieces in their scope are printed.
 
-  string fresh = ctx_->PickFreshName(term->variable());
-  term->body_term()->Accept(this);
+void PrettyPrinter::Visit(const LetTerm* term) {
+  const string fresh = ctx_->PickFreshName(term->variable().str());
   ctx_->DropBindings(1);
 
-  term_pprints_[term] = "let " + fresh + " = " + get(term->bind_term()) + " in " + get(term->body_term());
+  Append("let " + fresh + " = ");
+  Append(term->bind_term().get());
+  Append(" in ");
+  AppendName(fresh);
+  Append(term->body_term().get());
+  AppendDrop(1);
 }
 
 void PrettyPrinter::Visit(const AbsTerm* term) {
-  string fresh = ctx_->PickFreshName(term->variable());
-  term->term()->Accept(this);
+  const string fresh = ctx_->PickFreshName(term->variable().str());
   ctx_->DropBindings(1);
 
-  term_pprints_[term] = "lambda " + fresh + ":" + PrettyPrint(term->variable_type().get()) + ". " + get(term->term());
+  Append("lambda " + fresh + ":" + PrettyPrint(term->variable_type().get()) + ". ");
+  AppendName(fresh);
+  Append(term->term().get());
+  AppendDrop(1);
 }
 
 void PrettyPrinter::Visit(const AscribeTerm* term) {
-  term->term()->Accept(this);
-  if (term->term()->ast_level() <= term->ast_level()) {
-    term_pprints_[term] = "(" + get(term->term()) + ") as " + PrettyPrint(term->ascribe_type().get());
-  } else {
-    term_pprints_[term] = get(term->term()) + " as " + PrettyPrint(term->ascribe_type().get());
+  Append(term->term().get(), term->term()->ast_level() <= term->ast_level());
+  Append(" as " + PrettyPrint(term->ascribe_type().get()));
+}
+
+void PrettyPrinter::Visit(const VariantTerm* term) {
+  Append("<" + term->tag().str() + ":");
+  Append(term->term().get());
+  Append("> as " + PrettyPrint(term->variant_type().get()));
+}
+
+void PrettyPrinter::Visit(const CaseTerm* term) {
+  Append("case ");
+  Append(term->term().get());
+  Append(" of ");
+  for (size_t i = 0; i < term->size(); ++i) {
+    const CaseTerm::Branch& branch = term->get(i);
+    const string fresh = ctx_->PickFreshName(branch.variable.str());
+    ctx_->DropBindings(1);
+
+    Append((i != 0 ? " | <" : "<") + branch.tag.str() + ":" + fresh + "> -> ");
+    AppendName(fresh);
+    // A body that is not the last one would take the branches after it, if it extends as far as possible.
+    Append(branch.body.get(), i + 1 < term->size() && branch.body->ast_level() <= term->ast_level());
+    AppendDrop(1);
+  }
+}
+
+void PrettyPrinter::Visit(const MatchTerm* term) {
+  std::vector<string> fresh;
+  string cell_pattern = term->type() == MatchTermToken::List ? "cons" : "succ";
+  for (Symbol variable : term->variables()) {
+    fresh.push_back(ctx_->PickFreshName(variable.str()));
+    cell_pattern += " " + fresh.back();
+  }
+  ctx_->DropBindings(fresh.size());
+
+  Append("match ");
+  Append(term->term().get());
+  Append(term->type() == MatchTermToken::List ? " with nil -> " : " with 0 -> ");
+  // The empty arm would take the cell arm after it, if it extends as far as possible.
+  Append(term->empty_arm().get(), term->empty_arm()->ast_level() <= term->ast_level());
+  Append(" | " + cell_pattern + " -> ");
+  for (string& name : fresh) {
+    AppendName(std::move(name));
   }
+  Append(term->cell_arm().get());
+  AppendDrop(term->variables().size());
 }
 
-bool PrettyPrinter::IsPrintableNatTerm(const Term* term, int* nat) {
-  if (not_nat_.find(term) != not_nat_.end()) {
-    return false;
+void PrettyPrinter::Visit(const LetRecTerm* term) {
+  // All names of the group are bound in every binding, as well as in their types.
+  std::vector<string> fresh;
+  for (size_t i = 0; i < term->size(); ++i) {
+    fresh.push_back(ctx_->PickFreshName(term->get(i).variable.str()));
+  }
+  std::vector<string> types;
+  for (size_t i = 0; i < term->size(); ++i) {
+    types.push_back(PrettyPrint(term->get(i).type.get()));
+  }
+  ctx_->DropBindings(term->size());
+
+  for (const string& name : fresh) {
+    AppendName(name);
+  }
+  for (size_t i = 0; i < term->size(); ++i) {
+    Append((i != 0 ? " and " : "letrec ") + fresh[i] + ":" + types[i] + " = ");
+    Append(term->get(i).term.get());
   }
-  const UnaryTerm* unary_term = dynamic_cast<const UnaryTerm*>(term);
-  if (unary_term == nullptr || unary_term->type() != UnaryTermToken::Succ) {
-    const NullaryTerm* nullary_term = dynamic_cast<const NullaryTerm*>(term);
-    if (nullary_term != nullptr && nullary_term->type() == NullaryTermToken::Zero) {
-      *nat = 0;
+  Append(" in ");
+  Append(term->body().get());
+  AppendDrop(term->size());
+}
+
+void PrettyPrinter::Visit(const SharedTerm* term) {
+  Append(term->value().get());
+}
+
+void PrettyPrinter::Visit(const PackedListTerm* term) {
+  // Printed as its equivalent 'cons' cells, built in a loop as packed lists can be long.
+  const PackedCells& cells = *term->cells();
+  string pprint;
+  for (size_t i = term->begin(); i < term->end(); ++i) {
+    const uint64_t value = cells.values[i];
+    if (cells.kind == PackedCells::Kind::Bool) {
+      pprint += value ? "cons true " : "cons false ";
+    } else if (value == 0) {
+      pprint += "cons 0 ";
+    } else {
+      pprint += "cons (" + std::to_string(value) + ") ";
+    }
+    if (i + 1 < term->end()) {
+      pprint += "(";
+    }
+  }
+  pprint += "nil[" + PrettyPrint(cells.list_type.get()) + "]";
+  if (term->size() > 1) {
+    pprint.append(term->size() - 1, ')');
+  }
+  Append(std::move(pprint));
+}
+
+void PrettyPrinter::Visit(const ArrayTerm* term) {
+  Append("[|");
+  for (size_t i = 0; i < term->size(); ++i) {
+    if (i != 0) {
+      Append(",");
+    }
+    Append(term->get(i).get());
+  }
+  Append("|]");
+}
+
+void PrettyPrinter::Visit(const RefTerm* term) {
+  const RefCell* const cell = term->cell().get();
+  // A cell could hold a closure which refers to the cell itself.
+  if (!printing_cells_.insert(cell).second) {
+    Append("ref ...");
+    return;
+  }
+  // The value is open in the context it was stored in, which could be shorter than the current one.
+  shifted_values_.push_back(
+      TermShifter(static_cast<int>(ctx_->size() - cell->context_size)).TermShift(cell->value.get()));
+  const Term* const value = shifted_values_.back().get();
+
+  Append("ref ");
+  Append(value, value->ast_level() <= term->ast_level());
+  Piece piece{Piece::Kind::ReleaseCell};
+  piece.cell = cell;
+  pieces_.push_back(std::move(piece));
+}
+
+void PrettyPrinter::Visit(const MapTerm* term) {
+  // Printed as the 'map_insert's building the map from 'map_empty', in the order of the trie, i.e.
+  //   map_insert (map_insert map_empty[K,V] k_1 v_1) k_2 v_2
+  std::vector<std::pair<const Term*, const Term*>> bindings;
+  term->hamt()->ForEach([&bindings](const Term* key, const Term* value) { bindings.emplace_back(key, value); });
+
+  string pprint;
+  for (size_t i = 0; i < bindings.size(); ++i) {
+    pprint += i + 1 < bindings.size() ? "map_insert (" : "map_insert ";
+  }
+  pprint += "map_empty[" + PrettyPrint(term->key_type().get()) + "," + PrettyPrint(term->value_type().get()) + "]";
+  Append(std::move(pprint));
+  for (size_t i = 0; i < bindings.size(); ++i) {
+    Append(i != 0 ? ") " : " ");
+    Append(bindings[i].first, bindings[i].first->ast_level() <= 2);
+    Append(" ");
+    Append(bindings[i].second, bindings[i].second->ast_level() <= 2);
+  }
+}
+
+bool PrettyPrinter::IsPrintableNatTerm(const Term* term, uint64_t* nat) {
+  // The 'succ' terms on the way, walked in a loop as the chain could be long.
+  std::vector<const UnaryTerm*> succ_terms;
+  for (;;) {
+    const SharedTerm* shared_term = dyn_cast<SharedTerm>(term);
+    if (shared_term != nullptr) {
+      term = shared_term->value().get();
+      continue;
+    }
+    if (not_nat_.find(term) != not_nat_.end()) {
+      break;
+    }
+    const NatTerm* nat_term = dyn_cast<NatTerm>(term);
+    if (nat_term != nullptr) {
+      *nat = nat_term->value() + succ_terms.size();
       return true;
     }
-    return false;
+    const UnaryTerm* unary_term = dyn_cast<UnaryTerm>(term);
+    if (unary_term == nullptr || unary_term->type() != UnaryTermToken::Succ) {
+      const NullaryTerm* nullary_term = dyn_cast<NullaryTerm>(term);
+      if (nullary_term != nullptr && nullary_term->type() == NullaryTermToken::Zero) {
+        *nat = succ_terms.size();
+        return true;
+      }
+      break;
+    }
+    succ_terms.push_back(unary_term);
+    term = unary_term->term().get();
   }
-  if (IsPrintableNatTerm(unary_term->term().get(), nat)) {
-    *nat += 1;
-    return true;
-  } else {
-    not_nat_.insert(unary_term->term().get());
-    return false;
+  for (const UnaryTerm* succ_term : succ_terms) {
+    not_nat_.insert(succ_term->term().get());
   }
+  return false;
 }
 
 // TermType Visitor.
@@ -236,6 +538,22 @@ void PrettyPrinter::Visit(const ListTermType* type) {
   type_pprints_[type] = "List[" + get(type->type()) + "]";
 }
 
+void PrettyPrinter::Visit(const ArrayTermType* type) {
+  type->type()->Accept(this);
+  type_pprints_[type] = "Array[" + get(type->type()) + "]";
+}
+
+void PrettyPrinter::Visit(const RefTermType* type) {
+  type->type()->Accept(this);
+  type_pprints_[type] = "Ref[" + get(type->type()) + "]";
+}
+
+void PrettyPrinter::Visit(const MapTermType* type) {
+  type->key_type()->Accept(this);
+  type->value_type()->Accept(this);
+  type_pprints_[type] = "Map[" + get(type->key_type()) + "," + get(type->value_type()) + "]";
+}
+
 void PrettyPrinter::Visit(const RecordTermType* type) {
   type_pprints_[type] = "{";
   for (size_t i = 0; i < type->size(); ++i) {
@@ -244,11 +562,24 @@ void PrettyPrinter::Visit(const RecordTermType* type) {
     }
     const unique_ptr<TermType>& subtype = type->get(i).second;
     subtype->Accept(this);
-    type_pprints_[type] += type->get(i).first + ":" + get(subtype);
+    type_pprints_[type] += type->get(i).first.str() + ":" + get(subtype);
   }
   type_pprints_[type] += "}";
 }
 
+void PrettyPrinter::Visit(const VariantTermType* type) {
+  type_pprints_[type] = "<";
+  for (size_t i = 0; i < type->size(); ++i) {
+    if (i != 0) {
+      type_pprints_[type] += ",";
+    }
+    const unique_ptr<TermType>& subtype = type->get(i).second;
+    subtype->Accept(this);
+    type_pprints_[type] += type->get(i).first.str() + ":" + get(subtype);
+  }
+  type_pprints_[type] += ">";
+}
+
 void PrettyPrinter::Visit(const ArrowTermType* type) {
   type->type1()->Accept(this);
   type->type2()->Accept(this);
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "ast.h"
 #include "visitor.h"
@@ -22,16 +24,38 @@ class PrettyPrinter : public Visitor<Term>, public Visitor<TermType> {
   std::string get(const TermType* type) { return std::move(type_pprints_[type]); }
   std::string get(const std::unique_ptr<TermType>& type) { return std::move(type_pprints_[type.get()]); }
 
-  std::string get(const Term* term) { return std::move(term_pprints_[term]); }
-  std::string get(const std::unique_ptr<Term>& term) { return std::move(term_pprints_[term.get()]); }
+  // A piece of the output of a term, or a change to the context between two pieces.
+  struct Piece {
+    enum class Kind { Text, Term, AddName, DropBindings, ReleaseCell };
 
-  bool IsPrintableNatTerm(const Term* term, int* nat);
+    Kind kind;
+    std::string text;  // of Text, or the name of AddName.
+    const Term* term = nullptr;
+    const RefCell* cell = nullptr;
+    size_t size = 0;  // of DropBindings.
+  };
+
+  // Appends pieces to the ones of the term being visited, see PrettyPrint().
+  void Append(std::string text);
+  void Append(const Term* term);
+  void Append(const Term* term, bool parens);
+  void AppendName(std::string name);
+  void AppendDrop(size_t size);
+
+  bool IsPrintableNatTerm(const Term* term, uint64_t* nat);
 
   std::unordered_map<const TermType*, std::string> type_pprints_;
-  std::unordered_map<const Term*, std::string> term_pprints_;
   Context* const ctx_;
 
+  // Pieces of the term being visited, in order.
+  std::vector<Piece> pieces_;
+
   // If a 'succ' term is contained in this unordered_set, it is not a printable Nat,
   // A printable Nat is a list of 'succ's, i.e. succ (succ (succ ... 0))).
   std::unordered_set<const Term*> not_nat_;
+
+  // Cells of the references being printed, to cut cycles through them.
+  std::unordered_set<const RefCell*> printing_cells_;
+  // Values of the references being printed, shifted to the current context.
+  std::vector<std::unique_ptr<Term>> shifted_values_;
 };
@@ -0,0 +1,35 @@
+#include "symbol.h"
+
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+
+namespace {
+
+struct SymbolTable {
+  std::unordered_map<string, uint32_t> ids;
+  // Points to keys of <ids>, which stay where they are on rehashing.
+  std::vector<const string*> names;
+};
+
+// Intentionally leaked, as symbols may still be referred to during static destruction.
+SymbolTable* table() {
+  static SymbolTable* const table = new SymbolTable();
+  return table;
+}
+
+}  // namespace
+
+Symbol::Symbol(const string& name) {
+  SymbolTable* const symbols = table();
+  const auto inserted = symbols->ids.emplace(name, symbols->names.size());
+  if (inserted.second) {
+    symbols->names.push_back(&inserted.first->first);
+  }
+  id_ = inserted.first->second;
+}
+
+const string& Symbol::str() const {
+  return *table()->names[id_];
+}
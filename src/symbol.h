@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// An identifier interned into a process-wide symbol table, so that it is stored, copied and compared as a 32-bit id.
+// Interned names are never released.
+class Symbol final {
+ public:
+  Symbol(const std::string& name);
+  Symbol(const char* name) : Symbol(std::string(name)) { }
+
+  uint32_t id() const { return id_; }
+  const std::string& str() const;
+
+  bool operator==(Symbol rhs) const { return id_ == rhs.id_; }
+  bool operator!=(Symbol rhs) const { return id_ != rhs.id_; }
+
+  // Orders by name rather than by id, e.g. fields of records are sorted with it.
+  bool operator<(Symbol rhs) const { return id_ != rhs.id_ && str() < rhs.str(); }
+
+ private:
+  uint32_t id_;
+};
@@ -4,6 +4,7 @@
 #include <string>
 
 #include "location.h"
+#include "symbol.h"
 
 enum class TokenType {
   Int,               // With a natural integer number.
@@ -13,13 +14,15 @@ enum class TokenType {
   True, False, Zero,
   Nil, Cons,
   IsNil, Head, Tail,
-  Unit,
-  Bool, Nat, List, UUnit,
-  Lambda, Let, In, LetRec, TypeAlias, As,
+  Unit, Ref,
+  Bool, Nat, List, Array, Map, UUnit, URef,
+  Lambda, Let, In, LetRec, And, TypeAlias, As,
+  Case, Of, Match, With,
   LParen, RParen,
   LCurly, RCurly,
   LBracket, RBracket,
-  Arrow, Dot, Comma, Colon, Semi, Eq, UScore,
+  LAngle, RAngle,
+  Arrow, Dot, Comma, Colon, ColonEq, Semi, Eq, EqEq, UScore, Bar, Bang,
 };
 
 class Token final : public Locatable {
@@ -66,7 +69,7 @@ class Token final : public Locatable {
 
   const std::string& identifier() const {
     assert(is_id());
-    return identifier_;
+    return identifier_.str();
   }
 
  private:
@@ -76,5 +79,5 @@ class Token final : public Locatable {
   const TokenType type_;
 
   const int number_;
-  const std::string identifier_;
+  const Symbol identifier_;
 };
@@ -1,9 +1,11 @@
 #include "type-checker.h"
 
 #include <memory>
+#include <vector>
 
 #include "context.h"
 #include "error.h"
+#include "packed-list.h"
 #include "type-helper.h"
 
 using std::unique_ptr;
@@ -16,7 +18,7 @@ T* type_cast(const Context* ctx, unique_ptr<TermType>* ptr) {
   if (simplified_ptr != nullptr) {
     *ptr = std::move(simplified_ptr);
   }
-  return dynamic_cast<T*>(ptr->get());
+  return dyn_cast<T>(ptr->get());
 }
 
 }  // namespace
@@ -93,6 +95,65 @@ void TypeChecker::Visit(const UnaryTerm* term) {
       }
       typeof_[term] = std::make_unique<BoolTermType>(term->location());
     } break;
+    case UnaryTermToken::Sum:
+    case UnaryTermToken::Maximum: {
+      ListTermType* const list_type = type_cast<ListTermType>(ctx_, &subtype);
+      if (!list_type || !NatTermType(term->location()).Compare(ctx_, list_type->type().get())) {
+        throw type_exception(term->location(), term->type() == UnaryTermToken::Sum ?
+                             "<sum> expects List[Nat] type" : "<maximum> expects List[Nat] type");
+      }
+      typeof_[term] = std::make_unique<NatTermType>(term->location());
+    } break;
+    case UnaryTermToken::Length: {
+      ListTermType* const list_type = type_cast<ListTermType>(ctx_, &subtype);
+      if (!list_type) {
+        throw type_exception(term->location(), "<length> expects list type");
+      }
+      typeof_[term] = std::make_unique<NatTermType>(term->location());
+    } break;
+    case UnaryTermToken::Reverse: {
+      if (!type_cast<ListTermType>(ctx_, &subtype)) {
+        throw type_exception(term->location(), "<reverse> expects list type");
+      }
+      typeof_[term] = std::move(subtype);
+    } break;
+    case UnaryTermToken::ArrayLength: {
+      if (!type_cast<ArrayTermType>(ctx_, &subtype)) {
+        throw type_exception(term->location(), "<array_length> expects Array type");
+      }
+      typeof_[term] = std::make_unique<NatTermType>(term->location());
+    } break;
+    case UnaryTermToken::ArrayOfList: {
+      ListTermType* const list_type = type_cast<ListTermType>(ctx_, &subtype);
+      if (!list_type) {
+        throw type_exception(term->location(), "<array_of_list> expects list type");
+      }
+      typeof_[term] = std::make_unique<ArrayTermType>(term->location(), list_type->type().release());
+    } break;
+    case UnaryTermToken::ListOfArray: {
+      ArrayTermType* const array_type = type_cast<ArrayTermType>(ctx_, &subtype);
+      if (!array_type) {
+        throw type_exception(term->location(), "<list_of_array> expects Array type");
+      }
+      typeof_[term] = std::make_unique<ListTermType>(term->location(), array_type->type().release());
+    } break;
+    case UnaryTermToken::MapSize: {
+      if (!type_cast<MapTermType>(ctx_, &subtype)) {
+        throw type_exception(term->location(), "<map_size> expects Map type");
+      }
+      typeof_[term] = std::make_unique<NatTermType>(term->location());
+    } break;
+    case UnaryTermToken::Ref: {
+      term->set_value_type(ShareType(ResolveType(ctx_, subtype.get()).release()));
+      typeof_[term] = std::make_unique<RefTermType>(term->location(), subtype.release());
+    } break;
+    case UnaryTermToken::Deref: {
+      RefTermType* const ref_type = type_cast<RefTermType>(ctx_, &subtype);
+      if (!ref_type) {
+        throw type_exception(term->location(), "<!> expects Ref type");
+      }
+      typeof_[term] = std::move(ref_type->type());
+    } break;
   }
 }
 
@@ -123,6 +184,93 @@ void TypeChecker::Visit(const BinaryTerm* term) {
       }
       typeof_[term] = std::move(arrow_type->type2());
     } break;
+    case BinaryTermToken::Equal: {
+      if (!subtype1->Compare(ctx_, subtype2.get())) {
+        throw type_exception(term->location(), "operands of <==> have different types");
+      }
+      if (!IsFirstOrderType(ctx_, subtype1.get())) {
+        throw type_exception(term->location(), "<==> expects first-order type");
+      }
+      typeof_[term] = std::make_unique<BoolTermType>(term->location());
+    } break;
+    case BinaryTermToken::Append: {
+      if (!type_cast<ListTermType>(ctx_, &subtype1) || !type_cast<ListTermType>(ctx_, &subtype2)) {
+        throw type_exception(term->location(), "<append> expects list type on both parameters");
+      }
+      if (!subtype1->Compare(ctx_, subtype2.get())) {
+        throw type_exception(term->location(), "lists of <append> are incompatible");
+      }
+      typeof_[term] = std::move(subtype1);
+    } break;
+    case BinaryTermToken::Nth: {
+      ListTermType* const list_type = type_cast<ListTermType>(ctx_, &subtype1);
+      if (!list_type) {
+        throw type_exception(term->location(), "<nth> expects list type on 1st parameter");
+      }
+      if (!type_cast<NatTermType>(ctx_, &subtype2)) {
+        throw type_exception(term->location(), "<nth> expects Nat type on 2nd parameter");
+      }
+      typeof_[term] = std::move(list_type->type());
+    } break;
+    case BinaryTermToken::Range: {
+      if (!type_cast<NatTermType>(ctx_, &subtype1) || !type_cast<NatTermType>(ctx_, &subtype2)) {
+        throw type_exception(term->location(), "<range> expects Nat type on both parameters");
+      }
+      typeof_[term] = std::make_unique<ListTermType>(term->location(), new NatTermType(term->location()));
+    } break;
+    case BinaryTermToken::Less: {
+      ListTermType* const list_type1 = type_cast<ListTermType>(ctx_, &subtype1);
+      ListTermType* const list_type2 = type_cast<ListTermType>(ctx_, &subtype2);
+      const NatTermType nat_type(term->location());
+      if (!list_type1 || !list_type2 ||
+          !nat_type.Compare(ctx_, list_type1->type().get()) || !nat_type.Compare(ctx_, list_type2->type().get())) {
+        throw type_exception(term->location(), "<less> expects List[Nat] type on both parameters");
+      }
+      typeof_[term] = std::make_unique<ListTermType>(term->location(), new BoolTermType(term->location()));
+    } break;
+    case BinaryTermToken::ArrayMake: {
+      if (!type_cast<NatTermType>(ctx_, &subtype1)) {
+        throw type_exception(term->location(), "<array_make> expects Nat type on 1st parameter");
+      }
+      term->set_element_type(ShareType(ResolveType(ctx_, subtype2.get()).release()));
+      typeof_[term] = std::make_unique<ArrayTermType>(term->location(), subtype2.release());
+    } break;
+    case BinaryTermToken::ArrayGet: {
+      ArrayTermType* const array_type = type_cast<ArrayTermType>(ctx_, &subtype1);
+      if (!array_type) {
+        throw type_exception(term->location(), "<array_get> expects Array type on 1st parameter");
+      }
+      if (!type_cast<NatTermType>(ctx_, &subtype2)) {
+        throw type_exception(term->location(), "<array_get> expects Nat type on 2nd parameter");
+      }
+      typeof_[term] = std::move(array_type->type());
+    } break;
+    case BinaryTermToken::MapLookup: {
+      MapTermType* const map_type = type_cast<MapTermType>(ctx_, &subtype1);
+      if (!map_type) {
+        throw type_exception(term->location(), "<map_lookup> expects Map type on 1st parameter");
+      }
+      if (!subtype2->Compare(ctx_, map_type->key_type().get())) {
+        throw type_exception(term->location(), "key and map of <map_lookup> are incompatible");
+      }
+      typeof_[term] = std::make_unique<ListTermType>(term->location(), map_type->value_type().release());
+    } break;
+    case BinaryTermToken::Assign: {
+      RefTermType* const ref_type = type_cast<RefTermType>(ctx_, &subtype1);
+      if (!ref_type) {
+        throw type_exception(term->location(), "<:=> expects Ref type on left side");
+      }
+      if (!subtype2->Compare(ctx_, ref_type->type().get())) {
+        throw type_exception(term->location(), "value and reference of <:=> are incompatible");
+      }
+      typeof_[term] = std::make_unique<UnitTermType>(term->location());
+    } break;
+    case BinaryTermToken::Seq: {
+      if (!type_cast<UnitTermType>(ctx_, &subtype1)) {
+        throw type_exception(term->location(), "non-last term of sequence is not unit");
+      }
+      typeof_[term] = std::move(subtype2);
+    } break;
   }
 }
 
@@ -145,6 +293,51 @@ void TypeChecker::Visit(const TernaryTerm* term) {
       }
       typeof_[term] = std::move(subtype2);
     } break;
+    case TernaryTermToken::Foldl: {
+      // foldl f z l, where f: A->T->A, z: A and l: List[T].
+      ArrowTermType* const arrow_type = type_cast<ArrowTermType>(ctx_, &subtype1);
+      if (!arrow_type) {
+        throw type_exception(term->location(), "<foldl> expects arrow type on 1st parameter");
+      }
+      ListTermType* const list_type = type_cast<ListTermType>(ctx_, &subtype3);
+      if (!list_type) {
+        throw type_exception(term->location(), "<foldl> expects list type on 3rd parameter");
+      }
+      ArrowTermType* const step_type = type_cast<ArrowTermType>(ctx_, &arrow_type->type2());
+      if (!step_type || !arrow_type->type1()->Compare(ctx_, subtype2.get()) ||
+          !step_type->type1()->Compare(ctx_, list_type->type().get()) ||
+          !step_type->type2()->Compare(ctx_, subtype2.get())) {
+        throw type_exception(term->location(), "function of <foldl> is incompatible with accumulator and list");
+      }
+      typeof_[term] = std::move(subtype2);
+    } break;
+    case TernaryTermToken::ArraySet: {
+      ArrayTermType* const array_type = type_cast<ArrayTermType>(ctx_, &subtype1);
+      if (!array_type) {
+        throw type_exception(term->location(), "<array_set> expects Array type on 1st parameter");
+      }
+      if (!type_cast<NatTermType>(ctx_, &subtype2)) {
+        throw type_exception(term->location(), "<array_set> expects Nat type on 2nd parameter");
+      }
+      if (!subtype3->Compare(ctx_, array_type->type().get())) {
+        throw type_exception(term->location(), "element and array of <array_set> are incompatible");
+      }
+      typeof_[term] = std::move(subtype1);
+    } break;
+    case TernaryTermToken::MapInsert: {
+      MapTermType* const map_type = type_cast<MapTermType>(ctx_, &subtype1);
+      if (!map_type) {
+        throw type_exception(term->location(), "<map_insert> expects Map type on 1st parameter");
+      }
+      if (!subtype2->Compare(ctx_, map_type->key_type().get())) {
+        throw type_exception(term->location(), "key and map of <map_insert> are incompatible");
+      }
+      if (!subtype3->Compare(ctx_, map_type->value_type().get())) {
+        throw type_exception(term->location(), "value and map of <map_insert> are incompatible");
+      }
+      term->set_map_type(ShareType(ResolveType(ctx_, map_type).release()));
+      typeof_[term] = std::move(subtype1);
+    } break;
   }
 }
 
@@ -177,19 +370,42 @@ void TypeChecker::Visit(const ProjectTerm* term) {
   if (!record_type) {
     throw type_exception(term->location(), "field projection expects record type");
   }
-  for (size_t i = 0; i < record_type->size(); ++i) {
-    if (record_type->get(i).first == term->field()) {
-      typeof_[term] = std::move(record_type->get(i).second);
-      return;
+  const int slot = record_type->find(term->field());
+  if (slot < 0) {
+    throw type_exception(term->location(), "field <" + term->field().str() + "> not found for field projection");
+  }
+  // Record values are laid out as their types, so the evaluator loads the field by this index.
+  term->set_slot(slot);
+  typeof_[term] = std::move(record_type->get(slot).second);
+}
+
+void TypeChecker::Visit(const RecordUpdateTerm* term) {
+  term->term()->Accept(this);
+  unique_ptr<TermType> subtype = typeof(term->term());
+
+  RecordTermType* const record_type = type_cast<RecordTermType>(ctx_, &subtype);
+  if (!record_type) {
+    throw type_exception(term->location(), "record update expects record type");
+  }
+  for (size_t i = 0; i < term->size(); ++i) {
+    const RecordUpdateTerm::Update& update = term->get(i);
+    const int slot = record_type->find(update.field);
+    if (slot < 0) {
+      throw type_exception(term->location(), "field <" + update.field.str() + "> not found for record update");
     }
+    update.term->Accept(this);
+    if (!record_type->get(slot).second->Compare(ctx_, typeof(update.term).get())) {
+      throw type_exception(term->location(), "field <" + update.field.str() + "> is updated with another type");
+    }
+    term->set_slot(i, slot);
   }
-  throw type_exception(term->location(), "field <" + term->field() + "> not found for field projection");
+  typeof_[term] = std::move(subtype);
 }
 
 void TypeChecker::Visit(const LetTerm* term) {
   term->bind_term()->Accept(this);
   unique_ptr<TermType> bind_type = typeof(term->bind_term());
-  ctx_->AddBinding(term->variable(), new Binding(nullptr, bind_type.release()));
+  ctx_->AddBinding(term->variable().str(), new Binding(nullptr, bind_type.release()));
   term->body_term()->Accept(this);
   ctx_->DropBindings(1);
 
@@ -199,7 +415,7 @@ void TypeChecker::Visit(const LetTerm* term) {
 }
 
 void TypeChecker::Visit(const AbsTerm* term) {
-  ctx_->AddBinding(term->variable(), new Binding(nullptr, term->variable_type()->clone()));
+  ctx_->AddBinding(term->variable().str(), new Binding(nullptr, term->variable_type()->clone()));
   term->term()->Accept(this);
   ctx_->DropBindings(1);
 
@@ -218,3 +434,145 @@ void TypeChecker::Visit(const AscribeTerm* term) {
   }
   typeof_[term] = std::move(subtype);
 }
+
+void TypeChecker::Visit(const VariantTerm* term) {
+  term->term()->Accept(this);
+  unique_ptr<TermType> subtype = typeof(term->term());
+
+  unique_ptr<TermType> type(term->variant_type()->clone());
+  VariantTermType* const variant_type = type_cast<VariantTermType>(ctx_, &type);
+  if (!variant_type) {
+    throw type_exception(term->location(), "variant expects variant type");
+  }
+  const int index = variant_type->find(term->tag());
+  if (index < 0) {
+    throw type_exception(term->location(), "tag <" + term->tag().str() + "> not found in variant type");
+  }
+  if (!subtype->Compare(ctx_, variant_type->get(index).second.get())) {
+    throw type_exception(term->location(), "body of variant does not have the type of its tag");
+  }
+  // Values of a variant type are tagged with the index of their tag in its sorted tags.
+  term->set_index(index);
+  typeof_[term] = unique_ptr<TermType>(term->variant_type()->clone());
+}
+
+void TypeChecker::Visit(const CaseTerm* term) {
+  term->term()->Accept(this);
+  unique_ptr<TermType> subtype = typeof(term->term());
+
+  VariantTermType* const variant_type = type_cast<VariantTermType>(ctx_, &subtype);
+  if (!variant_type) {
+    throw type_exception(term->location(), "<case> expects variant type");
+  }
+  // Both are sorted by tag, so the i-th branch must handle the i-th tag, which makes <case> exhaustive.
+  bool matched = variant_type->size() == term->size();
+  for (size_t i = 0; matched && i < term->size(); ++i) {
+    matched = variant_type->get(i).first == term->get(i).tag;
+  }
+  if (!matched) {
+    throw type_exception(term->location(), "branches of <case> do not match tags of the variant type");
+  }
+
+  unique_ptr<TermType> case_type;
+  for (size_t i = 0; i < term->size(); ++i) {
+    const CaseTerm::Branch& branch = term->get(i);
+    ctx_->AddBinding(branch.variable.str(), new Binding(nullptr, variant_type->get(i).second->clone()));
+    branch.body->Accept(this);
+    ctx_->DropBindings(1);
+
+    unique_ptr<TermType> body_type = TermTypeShifter(-1).Shift(typeof(branch.body).get());
+    if (case_type == nullptr) {
+      case_type = std::move(body_type);
+    } else if (!case_type->Compare(ctx_, body_type.get())) {
+      throw type_exception(term->location(), "branches of <case> have different types");
+    }
+  }
+  typeof_[term] = std::move(case_type);
+}
+
+void TypeChecker::Visit(const MatchTerm* term) {
+  term->term()->Accept(this);
+  term->empty_arm()->Accept(this);
+  unique_ptr<TermType> subtype = typeof(term->term());
+  unique_ptr<TermType> empty_type = typeof(term->empty_arm());
+
+  // Types of the variables bound by the cell arm, each of them is shifted over the variables bound before it.
+  std::vector<unique_ptr<TermType>> variable_types;
+  if (term->type() == MatchTermToken::List) {
+    ListTermType* const list_type = type_cast<ListTermType>(ctx_, &subtype);
+    if (!list_type) {
+      throw type_exception(term->location(), "<match> expects list type");
+    }
+    variable_types.push_back(unique_ptr<TermType>(list_type->type()->clone()));
+    variable_types.push_back(TermTypeShifter(1).Shift(list_type));
+  } else {
+    if (!type_cast<NatTermType>(ctx_, &subtype)) {
+      throw type_exception(term->location(), "<match> expects Nat type");
+    }
+    variable_types.push_back(std::move(subtype));
+  }
+
+  const int size = term->variables().size();
+  for (int i = 0; i < size; ++i) {
+    ctx_->AddBinding(term->variables()[i].str(), new Binding(nullptr, variable_types[i].release()));
+  }
+  term->cell_arm()->Accept(this);
+  ctx_->DropBindings(size);
+
+  unique_ptr<TermType> cell_type = TermTypeShifter(-size).Shift(typeof(term->cell_arm()).get());
+  if (!empty_type->Compare(ctx_, cell_type.get())) {
+    throw type_exception(term->location(), "arms of <match> have different types");
+  }
+  typeof_[term] = std::move(empty_type);
+}
+
+void TypeChecker::Visit(const LetRecTerm* term) {
+  // Declared types are under all names of the group, while the type of each binding is under the names before it.
+  const int size = term->size();
+  for (int i = 0; i < size; ++i) {
+    ctx_->AddBinding(term->get(i).variable.str(),
+                     new Binding(nullptr, TermTypeShifter(i - size).Shift(term->get(i).type.get()).release()));
+  }
+  for (int i = 0; i < size; ++i) {
+    term->get(i).term->Accept(this);
+    if (!term->get(i).type->Compare(ctx_, typeof(term->get(i).term).get())) {
+      ctx_->DropBindings(size);
+      throw type_exception(term->get(i).term->location(), "binding of <letrec> does not have its declared type");
+    }
+  }
+  term->body()->Accept(this);
+  ctx_->DropBindings(size);
+
+  typeof_[term] = TermTypeShifter(-size).Shift(typeof(term->body()).get());
+}
+
+void TypeChecker::Visit(const NatTerm* term) {
+  typeof_[term] = std::make_unique<NatTermType>(term->location());
+}
+
+// Runtime values are type checked only when the evaluator needs the type of a value, e.g. in <array_make>.
+
+void TypeChecker::Visit(const PackedListTerm* term) {
+  typeof_[term] = std::make_unique<ListTermType>(term->location(), term->cells()->list_type->clone());
+}
+
+void TypeChecker::Visit(const ArrayTerm* term) {
+  typeof_[term] = std::make_unique<ArrayTermType>(term->location(), term->element_type()->clone());
+}
+
+void TypeChecker::Visit(const RefTerm* term) {
+  typeof_[term] = std::make_unique<RefTermType>(term->location(), term->value_type()->clone());
+}
+
+void TypeChecker::Visit(const MapTerm* term) {
+  if (!IsHashableType(ctx_, term->key_type().get())) {
+    throw type_exception(term->location(), "<map_empty> expects hashable key type");
+  }
+  typeof_[term] = std::make_unique<MapTermType>(term->location(), term->key_type()->clone(),
+                                                term->value_type()->clone());
+}
+
+void TypeChecker::Visit(const SharedTerm* term) {
+  term->value()->Accept(this);
+  typeof_[term] = typeof(term->value().get());
+}
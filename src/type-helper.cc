@@ -15,7 +15,7 @@ using std::unordered_map;
 using std::vector;
 
 unique_ptr<TermType> SimplifyType(const Context* ctx, const TermType* type) {
-  const UserDefinedTermType* ud_type = dynamic_cast<const UserDefinedTermType*>(type);
+  const UserDefinedTermType* ud_type = dyn_cast<UserDefinedTermType>(type);
 
   if (ud_type == nullptr) {
     return nullptr;
@@ -29,6 +29,70 @@ unique_ptr<TermType> SimplifyType(const Context* ctx, const TermType* type) {
   return deeper_shifted == nullptr ? std::move(shifted) : std::move(deeper_shifted);
 }
 
+unique_ptr<TermType> ResolveType(const Context* ctx, const TermType* type) {
+  return TermTypeShifter(ctx).Shift(type);
+}
+
+bool IsHashableType(const Context* ctx, const TermType* type) {
+  unique_ptr<TermType> simplified = SimplifyType(ctx, type);
+  if (simplified != nullptr) {
+    type = simplified.get();
+  }
+  if (dyn_cast<NatTermType>(type) != nullptr || dyn_cast<BoolTermType>(type) != nullptr ||
+      dyn_cast<UnitTermType>(type) != nullptr) {
+    return true;
+  }
+  const RecordTermType* const record_type = dyn_cast<RecordTermType>(type);
+  if (record_type == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < record_type->size(); ++i) {
+    if (!IsHashableType(ctx, record_type->get(i).second.get())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IsFirstOrderType(const Context* ctx, const TermType* type) {
+  unique_ptr<TermType> simplified = SimplifyType(ctx, type);
+  if (simplified != nullptr) {
+    type = simplified.get();
+  }
+  if (dyn_cast<ArrowTermType>(type) != nullptr || dyn_cast<RefTermType>(type) != nullptr) {
+    return false;
+  }
+  const ListTermType* const list_type = dyn_cast<ListTermType>(type);
+  if (list_type != nullptr) {
+    return IsFirstOrderType(ctx, list_type->type().get());
+  }
+  const ArrayTermType* const array_type = dyn_cast<ArrayTermType>(type);
+  if (array_type != nullptr) {
+    return IsFirstOrderType(ctx, array_type->type().get());
+  }
+  const MapTermType* const map_type = dyn_cast<MapTermType>(type);
+  if (map_type != nullptr) {
+    return IsFirstOrderType(ctx, map_type->key_type().get()) && IsFirstOrderType(ctx, map_type->value_type().get());
+  }
+  const RecordTermType* const record_type = dyn_cast<RecordTermType>(type);
+  if (record_type != nullptr) {
+    for (size_t i = 0; i < record_type->size(); ++i) {
+      if (!IsFirstOrderType(ctx, record_type->get(i).second.get())) {
+        return false;
+      }
+    }
+  }
+  const VariantTermType* const variant_type = dyn_cast<VariantTermType>(type);
+  if (variant_type != nullptr) {
+    for (size_t i = 0; i < variant_type->size(); ++i) {
+      if (!IsFirstOrderType(ctx, variant_type->get(i).second.get())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 unique_ptr<TermType> TermTypeShifter::Shift(const TermType* type) {
   type->Accept(this);
   unique_ptr<TermType> ret = std::move(shifted_types_[type]);
@@ -53,6 +117,23 @@ void TermTypeShifter::Visit(const ListTermType* type) {
   shifted_types_[type] = std::make_unique<ListTermType>(type->location(), get(type->type()).release());
 }
 
+void TermTypeShifter::Visit(const ArrayTermType* type) {
+  type->type()->Accept(this);
+  shifted_types_[type] = std::make_unique<ArrayTermType>(type->location(), get(type->type()).release());
+}
+
+void TermTypeShifter::Visit(const RefTermType* type) {
+  type->type()->Accept(this);
+  shifted_types_[type] = std::make_unique<RefTermType>(type->location(), get(type->type()).release());
+}
+
+void TermTypeShifter::Visit(const MapTermType* type) {
+  type->key_type()->Accept(this);
+  type->value_type()->Accept(this);
+  shifted_types_[type] = std::make_unique<MapTermType>(
+      type->location(), get(type->key_type()).release(), get(type->value_type()).release());
+}
+
 void TermTypeShifter::Visit(const RecordTermType* type) {
   auto shifted_type = std::make_unique<RecordTermType>(type->location());
   for (size_t i = 0; i < type->size(); ++i) {
@@ -62,6 +143,15 @@ void TermTypeShifter::Visit(const RecordTermType* type) {
   shifted_types_[type] = std::move(shifted_type);
 }
 
+void TermTypeShifter::Visit(const VariantTermType* type) {
+  auto shifted_type = std::make_unique<VariantTermType>(type->location());
+  for (size_t i = 0; i < type->size(); ++i) {
+    type->get(i).second->Accept(this);
+    shifted_type->add(type->get(i).first, get(type->get(i).second).release());
+  }
+  shifted_types_[type] = std::move(shifted_type);
+}
+
 void TermTypeShifter::Visit(const ArrowTermType* type) {
   type->type1()->Accept(this);
   type->type2()->Accept(this);
@@ -70,24 +160,54 @@ void TermTypeShifter::Visit(const ArrowTermType* type) {
 }
 
 void TermTypeShifter::Visit(const UserDefinedTermType* type) {
-  shifted_types_[type] = std::make_unique<UserDefinedTermType>(type->location(), type->index() + delta_);
+  if (ctx_ != nullptr) {
+    // Aliases only refer to the ones defined before them, so the expansion ends.
+    const unique_ptr<TermType> definition = SimplifyType(ctx_, type);
+    definition->Accept(this);
+    shifted_types_[type] = get(definition.get());
+    return;
+  }
+  const int index = renumber_ != nullptr ? renumber_(type->index()) : type->index() + delta_;
+  shifted_types_[type] = std::make_unique<UserDefinedTermType>(type->location(), index);
 }
 
 bool ListTermTypeComparator::Compare(const ListTermType* rhs) const {
   return lhs_->type()->Compare(ctx_, rhs->type().get());
 }
 
+bool ArrayTermTypeComparator::Compare(const ArrayTermType* rhs) const {
+  return lhs_->type()->Compare(ctx_, rhs->type().get());
+}
+
+bool RefTermTypeComparator::Compare(const RefTermType* rhs) const {
+  return lhs_->type()->Compare(ctx_, rhs->type().get());
+}
+
+bool MapTermTypeComparator::Compare(const MapTermType* rhs) const {
+  return lhs_->key_type()->Compare(ctx_, rhs->key_type().get()) &&
+         lhs_->value_type()->Compare(ctx_, rhs->value_type().get());
+}
+
 bool RecordTermTypeComparator::Compare(const RecordTermType* rhs) const {
   if (lhs_->size() != rhs->size()) {
     return false;
   }
-  unordered_map<string, const TermType*> field_map;
-  for (size_t i = 0; i < lhs_->size(); ++i) {
-    field_map[lhs_->get(i).first] = lhs_->get(i).second.get();
+  // Fields of both are sorted by name, so the order they are written in does not matter.
+  for (size_t i = 0; i < rhs->size(); ++i) {
+    if (lhs_->get(i).first != rhs->get(i).first || !lhs_->get(i).second->Compare(ctx_, rhs->get(i).second.get())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VariantTermTypeComparator::Compare(const VariantTermType* rhs) const {
+  if (lhs_->size() != rhs->size()) {
+    return false;
   }
+  // Same as records, tags of both are sorted by name.
   for (size_t i = 0; i < rhs->size(); ++i) {
-    auto iter = field_map.find(rhs->get(i).first);
-    if (iter == field_map.end() || !iter->second->Compare(ctx_, rhs->get(i).second.get())) {
+    if (lhs_->get(i).first != rhs->get(i).first || !lhs_->get(i).second->Compare(ctx_, rhs->get(i).second.get())) {
       return false;
     }
   }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <unordered_map>
 
@@ -11,10 +12,22 @@ class Context;
 // Returns nullptr if no simplification can be done.
 std::unique_ptr<TermType> SimplifyType(const Context* ctx, const TermType* type);
 
-// TermType shifter.
+// Expands all user-defined types in <type> into their definitions in <ctx>, so that the result is valid in any context.
+std::unique_ptr<TermType> ResolveType(const Context* ctx, const TermType* type);
+
+// Whether values of <type> can be hashed and compared structurally, i.e. it is made of Nat, Bool, Unit and records.
+bool IsHashableType(const Context* ctx, const TermType* type);
+
+// Whether <type> has no arrow or reference type in it, so that its values can be compared by '=='.
+bool IsFirstOrderType(const Context* ctx, const TermType* type);
+
+// TermType shifter, shifts the indices of user-defined types by <delta>, maps them with <renumber>, or expands the
+// types into their definitions in <ctx>, see ResolveType().
 class TermTypeShifter : public Visitor<TermType> {
  public:
   TermTypeShifter(int delta) : delta_(delta) { }
+  explicit TermTypeShifter(std::function<int(int)> renumber) : delta_(0), renumber_(std::move(renumber)) { }
+  explicit TermTypeShifter(const Context* ctx) : delta_(0), ctx_(ctx) { }
   TermTypeVisitorOverrides;
 
   std::unique_ptr<TermType> Shift(const TermType*);
@@ -24,6 +37,8 @@ class TermTypeShifter : public Visitor<TermType> {
   std::unique_ptr<TermType> get(const std::unique_ptr<TermType>& type) { return std::move(shifted_types_[type.get()]); }
 
   const int delta_;
+  const std::function<int(int)> renumber_;  // nullable.
+  const Context* const ctx_ = nullptr;
   std::unordered_map<const TermType*, std::unique_ptr<TermType>> shifted_types_;
 };
 
@@ -37,7 +52,11 @@ class TermTypeComparator {
   virtual bool Compare(const NatTermType*) const { return false; }
   virtual bool Compare(const UnitTermType*) const { return false; }
   virtual bool Compare(const ListTermType*) const { return false; }
+  virtual bool Compare(const ArrayTermType*) const { return false; }
+  virtual bool Compare(const RefTermType*) const { return false; }
+  virtual bool Compare(const MapTermType*) const { return false; }
   virtual bool Compare(const RecordTermType*) const { return false; }
+  virtual bool Compare(const VariantTermType*) const { return false; }
   virtual bool Compare(const ArrowTermType*) const { return false; }
 };
 
@@ -69,6 +88,36 @@ class ListTermTypeComparator : public TermTypeComparator {
   const ListTermType* const lhs_;
 };
 
+class ArrayTermTypeComparator : public TermTypeComparator {
+ public:
+  ArrayTermTypeComparator(const Context* ctx, const ArrayTermType* lhs) : ctx_(ctx), lhs_(lhs) { }
+  bool Compare(const ArrayTermType* rhs) const override;
+
+ private:
+  const Context* const ctx_;
+  const ArrayTermType* const lhs_;
+};
+
+class RefTermTypeComparator : public TermTypeComparator {
+ public:
+  RefTermTypeComparator(const Context* ctx, const RefTermType* lhs) : ctx_(ctx), lhs_(lhs) { }
+  bool Compare(const RefTermType* rhs) const override;
+
+ private:
+  const Context* const ctx_;
+  const RefTermType* const lhs_;
+};
+
+class MapTermTypeComparator : public TermTypeComparator {
+ public:
+  MapTermTypeComparator(const Context* ctx, const MapTermType* lhs) : ctx_(ctx), lhs_(lhs) { }
+  bool Compare(const MapTermType* rhs) const override;
+
+ private:
+  const Context* const ctx_;
+  const MapTermType* const lhs_;
+};
+
 class RecordTermTypeComparator : public TermTypeComparator {
  public:
   RecordTermTypeComparator(const Context* ctx, const RecordTermType* lhs) : ctx_(ctx), lhs_(lhs) { }
@@ -79,6 +128,16 @@ class RecordTermTypeComparator : public TermTypeComparator {
   const RecordTermType* const lhs_;
 };
 
+class VariantTermTypeComparator : public TermTypeComparator {
+ public:
+  VariantTermTypeComparator(const Context* ctx, const VariantTermType* lhs) : ctx_(ctx), lhs_(lhs) { }
+  bool Compare(const VariantTermType* rhs) const override;
+
+ private:
+  const Context* const ctx_;
+  const VariantTermType* const lhs_;
+};
+
 class ArrowTermTypeComparator : public TermTypeComparator {
  public:
   ArrowTermTypeComparator(const Context* ctx, const ArrowTermType* lhs) : ctx_(ctx), lhs_(lhs) { }
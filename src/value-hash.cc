@@ -0,0 +1,291 @@
+#include "value-hash.h"
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "hamt.h"
+#include "packed-list.h"
+
+namespace {
+
+const Term* deref(const Term* value) {
+  const SharedTerm* const shared_term = dyn_cast<SharedTerm>(value);
+  return shared_term != nullptr ? shared_term->value().get() : value;
+}
+
+// Finalizer of splitmix64.
+uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+const uint64_t kGolden = 0x9e3779b97f4a7c15ULL;
+const uint64_t kNilHash = mix(kGolden ^ 0x6c697374ULL);
+
+uint64_t hash_nullary(NullaryTermToken token) {
+  return mix(kGolden + static_cast<uint64_t>(token));
+}
+
+// Hash of an element of a packed list, the same as the hash of the element as a term.
+uint64_t hash_packed(const PackedCells& cells, size_t i) {
+  if (cells.kind == PackedCells::Kind::Nat) {
+    return mix(cells.values[i]);
+  }
+  return hash_nullary(cells.values[i] ? NullaryTermToken::True : NullaryTermToken::False);
+}
+
+uint64_t hash_cons(uint64_t head, uint64_t tail) {
+  // 0 marks an uncached cons cell.
+  const uint64_t hash = mix(head + kGolden * (tail ^ 0x636f6e73ULL));
+  return hash != 0 ? hash : 1;
+}
+
+bool is_list(const Term* value) {
+  const BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(value);
+  return (cons_term != nullptr && cons_term->type() == BinaryTermToken::Cons) ||
+         dyn_cast<NilTerm>(value) != nullptr || dyn_cast<PackedListTerm>(value) != nullptr;
+}
+
+// Hashes a list without recursing on its spine. The hash of every cons cell on the way is cached, so hashing a list
+// again, or a list sharing its tail, stops at the first cached cell.
+uint64_t hash_list(const Term* list) {
+  std::vector<const BinaryTerm*> cells;
+  uint64_t hash = kNilHash;
+
+  for (;;) {
+    list = deref(list);
+    const BinaryTerm* const cons_term = dyn_cast<BinaryTerm>(list);
+    if (cons_term == nullptr) {
+      const PackedListTerm* const packed_term = dyn_cast<PackedListTerm>(list);
+      if (packed_term != nullptr) {
+        for (size_t i = packed_term->end(); i > packed_term->begin(); --i) {
+          hash = hash_cons(hash_packed(*packed_term->cells(), i - 1), hash);
+        }
+      }
+      break;
+    }
+    if (cons_term->cached_hash() != 0) {
+      hash = cons_term->cached_hash();
+      break;
+    }
+    cells.push_back(cons_term);
+    list = cons_term->term2().get();
+  }
+  for (size_t i = cells.size(); i > 0; --i) {
+    hash = hash_cons(HashValue(cells[i - 1]->term1().get()), hash);
+    cells[i - 1]->set_cached_hash(hash);
+  }
+  return hash;
+}
+
+// Walks the elements of a list value. Elements of packed runs have no term, and are read as scalars instead.
+class ListCursor {
+ public:
+  explicit ListCursor(const Term* list) { Seek(list); }
+
+  bool done() const { return cons_term_ == nullptr && (packed_term_ == nullptr || index_ == packed_term_->end()); }
+  bool packed() const { return cons_term_ == nullptr; }
+  const Term* term() const { return cons_term_->term1().get(); }
+  uint64_t scalar() const { return packed_term_->cells()->values[index_]; }
+
+  // The rest of the list, nullptr inside of a packed run.
+  const Term* rest() const { return cons_term_; }
+
+  void Next() {
+    if (cons_term_ != nullptr) {
+      Seek(cons_term_->term2().get());
+    } else {
+      ++index_;
+    }
+  }
+
+ private:
+  void Seek(const Term* list) {
+    list = deref(list);
+    cons_term_ = dyn_cast<BinaryTerm>(list);
+    packed_term_ = dyn_cast<PackedListTerm>(list);
+    index_ = packed_term_ != nullptr ? packed_term_->begin() : 0;
+  }
+
+  const BinaryTerm* cons_term_ = nullptr;
+  const PackedListTerm* packed_term_ = nullptr;
+  size_t index_ = 0;
+};
+
+// Scalar of a Nat or Bool, as stored in packed lists.
+uint64_t scalar_of(const Term* value) {
+  value = deref(value);
+  const NatTerm* const nat_term = dyn_cast<NatTerm>(value);
+  if (nat_term != nullptr) {
+    return nat_term->value();
+  }
+  return cast<NullaryTerm>(value)->type() == NullaryTermToken::True;
+}
+
+}  // namespace
+
+uint64_t HashValue(const Term* value) {
+  value = deref(value);
+
+  const NatTerm* const nat_term = dyn_cast<NatTerm>(value);
+  if (nat_term != nullptr) {
+    return mix(nat_term->value());
+  }
+  const NullaryTerm* const nullary_term = dyn_cast<NullaryTerm>(value);
+  if (nullary_term != nullptr) {
+    return hash_nullary(nullary_term->type());
+  }
+  if (is_list(value)) {
+    return hash_list(value);
+  }
+  const ArrayTerm* const array_term = dyn_cast<ArrayTerm>(value);
+  if (array_term != nullptr) {
+    uint64_t hash = mix(array_term->size() ^ 0x6172726179ULL);
+    for (size_t i = 0; i < array_term->size(); ++i) {
+      hash = mix(hash + kGolden * HashValue(array_term->get(i).get()));
+    }
+    return hash;
+  }
+  const MapTerm* const map_term = dyn_cast<MapTerm>(value);
+  if (map_term != nullptr) {
+    // Bindings are summed up, as the order they are visited in depends on the shape of the trie.
+    uint64_t hash = mix(map_term->hamt()->size() ^ 0x6d6170ULL);
+    map_term->hamt()->ForEach([&hash](const Term* key, const Term* value) {
+      hash += mix(HashValue(key) + kGolden * HashValue(value));
+    });
+    return hash;
+  }
+  const VariantTerm* const variant_term = dyn_cast<VariantTerm>(value);
+  if (variant_term != nullptr) {
+    return mix(static_cast<uint64_t>(variant_term->index()) + kGolden * HashValue(variant_term->term().get()));
+  }
+  const RecordTerm* const record_term = cast<RecordTerm>(value);
+
+  // Fields are summed up, so that the hash does not depend on the order of fields.
+  uint64_t hash = mix(record_term->size());
+  for (size_t i = 0; i < record_term->size(); ++i) {
+    const uint64_t field_hash = mix(record_term->get(i).first.id());
+    hash += mix(field_hash ^ HashValue(record_term->get(i).second.get()));
+  }
+  return hash;
+}
+
+bool EqualValues(const Term* lhs, const Term* rhs) {
+  // Pairs of values left to compare, so that long lists are compared in a loop.
+  std::vector<std::pair<const Term*, const Term*>> pending = {{lhs, rhs}};
+
+  while (!pending.empty()) {
+    lhs = deref(pending.back().first);
+    rhs = deref(pending.back().second);
+    pending.pop_back();
+    if (lhs == rhs) {
+      continue;
+    }
+
+    const NatTerm* const lhs_nat = dyn_cast<NatTerm>(lhs);
+    if (lhs_nat != nullptr) {
+      const NatTerm* const rhs_nat = dyn_cast<NatTerm>(rhs);
+      if (rhs_nat == nullptr || lhs_nat->value() != rhs_nat->value()) {
+        return false;
+      }
+      continue;
+    }
+    const NullaryTerm* const lhs_nullary = dyn_cast<NullaryTerm>(lhs);
+    if (lhs_nullary != nullptr) {
+      const NullaryTerm* const rhs_nullary = dyn_cast<NullaryTerm>(rhs);
+      if (rhs_nullary == nullptr || lhs_nullary->type() != rhs_nullary->type()) {
+        return false;
+      }
+      continue;
+    }
+
+    if (is_list(lhs)) {
+      // Hashes are cached by cons cells, so unequal lists are mostly told apart here without walking them.
+      if (HashValue(lhs) != HashValue(rhs)) {
+        return false;
+      }
+      ListCursor lhs_cursor(lhs), rhs_cursor(rhs);
+      bool shared_tail = false;
+      for (; !lhs_cursor.done() && !rhs_cursor.done(); lhs_cursor.Next(), rhs_cursor.Next()) {
+        if (lhs_cursor.rest() != nullptr && lhs_cursor.rest() == rhs_cursor.rest()) {
+          shared_tail = true;
+          break;
+        }
+        if (lhs_cursor.packed() || rhs_cursor.packed()) {
+          const uint64_t lhs_scalar = lhs_cursor.packed() ? lhs_cursor.scalar() : scalar_of(lhs_cursor.term());
+          const uint64_t rhs_scalar = rhs_cursor.packed() ? rhs_cursor.scalar() : scalar_of(rhs_cursor.term());
+          if (lhs_scalar != rhs_scalar) {
+            return false;
+          }
+        } else {
+          pending.emplace_back(lhs_cursor.term(), rhs_cursor.term());
+        }
+      }
+      if (!shared_tail && lhs_cursor.done() != rhs_cursor.done()) {
+        return false;
+      }
+      continue;
+    }
+
+    const ArrayTerm* const lhs_array = dyn_cast<ArrayTerm>(lhs);
+    if (lhs_array != nullptr) {
+      const ArrayTerm* const rhs_array = cast<ArrayTerm>(rhs);
+      if (lhs_array->size() != rhs_array->size()) {
+        return false;
+      }
+      for (size_t i = 0; i < lhs_array->size(); ++i) {
+        pending.emplace_back(lhs_array->get(i).get(), rhs_array->get(i).get());
+      }
+      continue;
+    }
+    const MapTerm* const lhs_map = dyn_cast<MapTerm>(lhs);
+    if (lhs_map != nullptr) {
+      const Hamt* const rhs_hamt = cast<MapTerm>(rhs)->hamt().get();
+      if (lhs_map->hamt()->size() != rhs_hamt->size()) {
+        return false;
+      }
+      bool found = true;
+      lhs_map->hamt()->ForEach([&](const Term* key, const Term* value) {
+        const Term* const rhs_value = found ? rhs_hamt->Find(key) : nullptr;
+        if (rhs_value == nullptr) {
+          found = false;
+        } else {
+          pending.emplace_back(value, rhs_value);
+        }
+      });
+      if (!found) {
+        return false;
+      }
+      continue;
+    }
+
+    const VariantTerm* const lhs_variant = dyn_cast<VariantTerm>(lhs);
+    if (lhs_variant != nullptr) {
+      const VariantTerm* const rhs_variant = cast<VariantTerm>(rhs);
+      if (lhs_variant->index() != rhs_variant->index()) {
+        return false;
+      }
+      pending.emplace_back(lhs_variant->term().get(), rhs_variant->term().get());
+      continue;
+    }
+
+    const RecordTerm* const lhs_record = cast<RecordTerm>(lhs);
+    const RecordTerm* const rhs_record = dyn_cast<RecordTerm>(rhs);
+    if (rhs_record == nullptr || lhs_record->size() != rhs_record->size()) {
+      return false;
+    }
+    // Fields are sorted by name, so records of the same type are compared field by field.
+    for (size_t i = 0; i < lhs_record->size(); ++i) {
+      if (lhs_record->get(i).first != rhs_record->get(i).first) {
+        return false;
+      }
+      pending.emplace_back(lhs_record->get(i).second.get(), rhs_record->get(i).second.get());
+    }
+  }
+  return true;
+}
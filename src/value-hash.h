@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ast.h"
+
+// Structural hashing and equality of evaluated values of first-order types, used by '==' and by keys of maps.
+// Records are compared by field names, so the order of fields does not matter. A packed list equals the same list
+// made of cons cells. Lists are hashed and compared without recursing on their spines, and the hash of each cons cell
+// is cached in the cell, so unequal lists are mostly told apart in O(1) once they were hashed.
+uint64_t HashValue(const Term* value);
+bool EqualValues(const Term* lhs, const Term* rhs);
@@ -3,36 +3,7 @@
 template<class T>
 class Visitor;
 
-template<class Base>
-class Visitable {
- public:
-  virtual void Accept(Visitor<Base>* visitor) const = 0;
-};
-
-/*
- * Virtual inheritance is required to solve the diamond inheritance issue.
- *
- *            Visitable
- *              / \
- *             /   \
- *            /     \
- * VisitableImpl   Abstract Class
- *            \     /
- *             \   /
- *              \ /
- *         Concrete Class
- *
- * Both VisitableImpl and Abstract class will inherit Visitable::Accept, but the static polymorphism implemenation of
- * Visitable::Accept lays in VisitableImpl. VisitableImpl and Abstact Class both need to inherit Visitable virtually.
- */
-
-template<class Base, class Derived>
-class VisitableImpl : public virtual Visitable<Base> {
- public:
-  void Accept(Visitor<Base>* visitor) const override {
-    visitor->Visit(static_cast<const Derived*>(this));
-  }
-};
+// Terms and types are visited through their Accept(), which dispatches on the kind tag of the node, see ast.cc.
 
 // Term visitior.
 class Term;
@@ -47,6 +18,17 @@ class ProjectTerm;
 class LetTerm;
 class AbsTerm;
 class AscribeTerm;
+class SharedTerm;
+class NatTerm;
+class PackedListTerm;
+class ArrayTerm;
+class MapTerm;
+class VariantTerm;
+class CaseTerm;
+class MatchTerm;
+class LetRecTerm;
+class RecordUpdateTerm;
+class RefTerm;
 
 #define TermVisitorOverrides \
   void Visit(const NullaryTerm*) override; \
@@ -59,7 +41,18 @@ class AscribeTerm;
   void Visit(const ProjectTerm*) override; \
   void Visit(const LetTerm*) override; \
   void Visit(const AbsTerm*) override; \
-  void Visit(const AscribeTerm*) override
+  void Visit(const AscribeTerm*) override; \
+  void Visit(const SharedTerm*) override; \
+  void Visit(const NatTerm*) override; \
+  void Visit(const PackedListTerm*) override; \
+  void Visit(const ArrayTerm*) override; \
+  void Visit(const MapTerm*) override; \
+  void Visit(const VariantTerm*) override; \
+  void Visit(const CaseTerm*) override; \
+  void Visit(const MatchTerm*) override; \
+  void Visit(const LetRecTerm*) override; \
+  void Visit(const RecordUpdateTerm*) override; \
+  void Visit(const RefTerm*) override
 
 template<>
 class Visitor<Term> {
@@ -75,6 +68,17 @@ class Visitor<Term> {
   virtual void Visit(const LetTerm*) = 0;
   virtual void Visit(const AbsTerm*) = 0;
   virtual void Visit(const AscribeTerm*) = 0;
+  virtual void Visit(const SharedTerm*) = 0;
+  virtual void Visit(const NatTerm*) = 0;
+  virtual void Visit(const PackedListTerm*) = 0;
+  virtual void Visit(const ArrayTerm*) = 0;
+  virtual void Visit(const MapTerm*) = 0;
+  virtual void Visit(const VariantTerm*) = 0;
+  virtual void Visit(const CaseTerm*) = 0;
+  virtual void Visit(const MatchTerm*) = 0;
+  virtual void Visit(const LetRecTerm*) = 0;
+  virtual void Visit(const RecordUpdateTerm*) = 0;
+  virtual void Visit(const RefTerm*) = 0;
 };
 
 // TermType visitor.
@@ -83,7 +87,11 @@ class BoolTermType;
 class NatTermType;
 class UnitTermType;
 class ListTermType;
+class ArrayTermType;
+class RefTermType;
+class MapTermType;
 class RecordTermType;
+class VariantTermType;
 class ArrowTermType;
 class UserDefinedTermType;
 
@@ -92,7 +100,11 @@ class UserDefinedTermType;
   void Visit(const NatTermType*) override; \
   void Visit(const UnitTermType*) override; \
   void Visit(const ListTermType*) override; \
+  void Visit(const ArrayTermType*) override; \
+  void Visit(const RefTermType*) override; \
+  void Visit(const MapTermType*) override; \
   void Visit(const RecordTermType*) override; \
+  void Visit(const VariantTermType*) override; \
   void Visit(const ArrowTermType*) override; \
   void Visit(const UserDefinedTermType*) override
 
@@ -103,7 +115,11 @@ class Visitor<TermType> {
   virtual void Visit(const NatTermType*) = 0;
   virtual void Visit(const UnitTermType*) = 0;
   virtual void Visit(const ListTermType*) = 0;
+  virtual void Visit(const ArrayTermType*) = 0;
+  virtual void Visit(const RefTermType*) = 0;
+  virtual void Visit(const MapTermType*) = 0;
   virtual void Visit(const RecordTermType*) = 0;
+  virtual void Visit(const VariantTermType*) = 0;
   virtual void Visit(const ArrowTermType*) = 0;
   virtual void Visit(const UserDefinedTermType*) = 0;
 };
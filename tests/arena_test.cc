@@ -0,0 +1,61 @@
+#include "arena.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "ast.h"
+
+using std::unique_ptr;
+
+TEST(ArenaTest, Allocate) {
+  const Location location(size_t(0), size_t(0));
+  unique_ptr<Term> heap_term = std::make_unique<NatTerm>(location, 1);
+  EXPECT_EQ(Arena::current(), nullptr);
+  EXPECT_FALSE(Arena::Owns(heap_term.get()));
+
+  Arena arena;
+  EXPECT_EQ(Arena::current(), &arena);
+  unique_ptr<Term> arena_term = std::make_unique<NatTerm>(location, 2);
+  EXPECT_TRUE(Arena::Owns(arena_term.get()));
+  EXPECT_FALSE(Arena::Owns(heap_term.get()));
+  EXPECT_EQ(arena.stats().allocations, 1);
+  EXPECT_GE(arena.stats().allocated, sizeof(NatTerm));
+
+  {
+    Arena::HeapScope heap_scope;
+    EXPECT_EQ(Arena::current(), nullptr);
+    heap_term = std::make_unique<NatTerm>(location, 3);
+    EXPECT_FALSE(Arena::Owns(heap_term.get()));
+  }
+  EXPECT_EQ(Arena::current(), &arena);
+
+  // Allocations larger than a commit step are committed at once, the next terms are bumped right after them.
+  char* const large = static_cast<char*>(arena.Allocate(1 << 20));
+  unique_ptr<Term> next_term = std::make_unique<NatTerm>(location, 4);
+  EXPECT_TRUE(Arena::Owns(large));
+  EXPECT_TRUE(Arena::Owns(large + (1 << 20) - 1));
+  EXPECT_EQ(reinterpret_cast<char*>(next_term.get()), large + (1 << 20));
+  EXPECT_GE(arena.stats().reserved, arena.stats().allocated);
+  // Addresses past the bumped ones are not the arena's.
+  EXPECT_FALSE(Arena::Owns(reinterpret_cast<char*>(next_term.get()) + arena.stats().reserved));
+}
+
+TEST(ArenaTest, Release) {
+  const Location location(size_t(0), size_t(0));
+  Arena arena;
+  unique_ptr<Term> term = std::make_unique<NatTerm>(location, 1);
+  const void* const released = term.get();
+  term.reset();
+  EXPECT_TRUE(Arena::Owns(released));
+
+  // The next term of the same size takes the released memory, without bumping the arena.
+  const size_t allocated = arena.stats().allocated;
+  term = std::make_unique<NatTerm>(location, 2);
+  EXPECT_EQ(term.get(), released);
+  EXPECT_EQ(arena.stats().reused, 1);
+  EXPECT_EQ(arena.stats().allocated, allocated);
+
+  unique_ptr<Term> next_term = std::make_unique<NatTerm>(location, 3);
+  EXPECT_NE(next_term.get(), released);
+  EXPECT_EQ(arena.stats().reused, 1);
+}
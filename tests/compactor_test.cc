@@ -0,0 +1,160 @@
+#include "compactor.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "evaluator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "pprinter.h"
+#include "test-utils.h"
+#include "type-checker.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+class CompactorTest : public ::testing::Test {
+ protected:
+  // Runs the statements as the interpreter does, and checks the values printed by the ones that are not bindings.
+  void TestStatements(const string& input, const string& output) {
+    unique_ptr<Lexer> lexer(Lexer::Create(input));
+    Parser parser(lexer.get());
+    PrettyPrinter pprinter(&ctx_);
+    TypeChecker type_checker(&ctx_);
+    TermEvaluator evaluator(&ctx_);
+
+    vector<unique_ptr<Stmt>> stmts;
+    ASSERT_NO_THROW(stmts = parser.ParseAST(&ctx_));
+    vector<string> pprints;
+    for (const unique_ptr<Stmt>& stmt : stmts) {
+      EvalStmt* const eval_stmt = dyn_cast<EvalStmt>(stmt.get());
+      BindTermStmt* const term_stmt = dyn_cast<BindTermStmt>(stmt.get());
+      BindTypeStmt* const type_stmt = dyn_cast<BindTypeStmt>(stmt.get());
+
+      if (eval_stmt != nullptr) {
+        type_checker.TypeCheck(eval_stmt->term().get());
+        pprints.push_back(pprinter.PrettyPrint(evaluator.Evaluate(eval_stmt->term().get()).get()));
+      } else if (term_stmt != nullptr) {
+        unique_ptr<TermType> type = type_checker.TypeCheck(term_stmt->term().get());
+        unique_ptr<Term> value = evaluator.Evaluate(term_stmt->term().get());
+        ctx_.AddBinding(term_stmt->variable(), new Binding(value.release(), type.release()));
+      } else {
+        ctx_.AddBinding(type_stmt->type_alias(), new Binding(nullptr, type_stmt->type()->clone()));
+      }
+    }
+    EXPECT_EQ(SplitByLine(output), pprints);
+  }
+
+  Context ctx_;
+};
+
+TEST_F(CompactorTest, Shadowed) {
+  TestStatements(R"(
+let x = 1;
+let x = 2;
+let y = x;
+let x = 3;
+)", "");
+  EXPECT_EQ(2, CompactContext(&ctx_));
+  EXPECT_EQ(2, ctx_.size());
+  EXPECT_EQ(0, CompactContext(&ctx_));
+
+  TestStatements(R"(
+x;
+y;
+)", R"(
+3
+2
+)");
+}
+
+TEST_F(CompactorTest, Closure) {
+  TestStatements(R"(
+let l = cons 1 nil[Nat];
+let x = 1;
+let x = 2;
+let f = lambda n:Nat. cons n l;
+let l = nil[Nat];
+let x = 3;
+)", "");
+  // The first 'l' is still used by 'f'.
+  EXPECT_EQ(2, CompactContext(&ctx_));
+  EXPECT_EQ(4, ctx_.size());
+
+  TestStatements(R"(
+f 4;
+l;
+x;
+)", R"(
+cons (4) (cons (1) nil[Nat])
+nil[Nat]
+3
+)");
+}
+
+TEST_F(CompactorTest, TypeAndReference) {
+  TestStatements(R"(
+type T = Nat;
+let a = 5;
+let b = 0;
+let c = ref (lambda n:T. a);
+type T = Bool;
+let a = 6;
+let b = 1;
+let d = ref 0;
+)", "");
+  // The first 'T' is used by the type of 'c', and the first 'a' by the value in its cell.
+  EXPECT_EQ(1, CompactContext(&ctx_));
+
+  TestStatements(R"(
+(!c) 0;
+c := lambda n:Nat. a;
+)", R"(
+5
+unit
+)");
+  // Only the cell used the first 'a'.
+  EXPECT_EQ(1, CompactContext(&ctx_));
+  EXPECT_EQ(6, ctx_.size());
+
+  TestStatements(R"(
+(!c) 0;
+!d;
+)", R"(
+6
+0
+)");
+}
+
+TEST_F(CompactorTest, AnnotationType) {
+  TestStatements(R"(
+type U = Nat;
+let x = 0;
+let x = 1;
+let f = (lambda n:U. n) as Nat->Nat;
+type U = Bool;
+)", "");
+  // The first 'U' is only used by the type annotating the value of 'f'.
+  EXPECT_EQ(1, CompactContext(&ctx_));
+  ASSERT_EQ(4, ctx_.size());
+
+  // The annotation is open in the context 'f' was bound in, i.e. without 'f' and the second 'U'.
+  const Term* value = ctx_.get(1).second->term();
+  if (isa<SharedTerm>(value)) {
+    value = cast<SharedTerm>(value)->value().get();
+  }
+  const int index = cast<UserDefinedTermType>(cast<AbsTerm>(value)->variable_type().get())->index();
+  EXPECT_EQ(1, index);
+  EXPECT_EQ("U", ctx_.get(2 + index).first);
+
+  TestStatements(R"(
+f 2;
+)", R"(
+2
+)");
+}
@@ -60,3 +60,19 @@ TEST_F(ContextTest, FreshNameTest) {
   EXPECT_EQ(ctx_.PickFreshName("z"), "z");
   EXPECT_EQ(ctx_.size(), 10);
 }
+
+TEST_F(ContextTest, FreshNameReuse) {
+  EXPECT_EQ(ctx_.PickFreshName("x"), "x_1");
+  EXPECT_EQ(ctx_.PickFreshName("x"), "x_2");
+  ctx_.AddName("x_3");
+  EXPECT_EQ(ctx_.PickFreshName("x"), "x_4");
+
+  // Aliases dropped are picked again, the least one first.
+  ctx_.DropBindings(4);
+  EXPECT_EQ(ctx_.PickFreshName("x"), "x_1");
+  ctx_.AddName("x_2");
+  EXPECT_EQ(ctx_.PickFreshName("x"), "x_3");
+  ctx_.DropBindings(2);
+  EXPECT_EQ(ctx_.PickFreshName("x"), "x_2");
+  EXPECT_EQ(ctx_.PickFreshName("x_1"), "x_1_1");
+}
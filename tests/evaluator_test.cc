@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 
+#include "arena.h"
 #include "ast.h"
 #include "context.h"
 #include "error.h"
@@ -34,7 +35,11 @@ class EvaluatorTest : public ::testing::Test {
 
     ASSERT_EQ(pprints.size(), stmts.size());
 
+    // Set up before the terms of each statement, so that it is released after them.
+    unique_ptr<Arena> arena;
     for (size_t i = 0; i < stmts.size(); ++i) {
+      ReleaseArena(&arena);
+      arena = arena_ ? std::make_unique<Arena>() : nullptr;
       EvalStmt* eval_stmt = dynamic_cast<EvalStmt*>(stmts[i].get());
       BindTermStmt* term_stmt = dynamic_cast<BindTermStmt*>(stmts[i].get());
 
@@ -53,6 +58,12 @@ class EvaluatorTest : public ::testing::Test {
         unique_ptr<TermType> type = type_checker.TypeCheck(term_stmt->term().get());
         unique_ptr<Term> term;
 
+        if (lazy_) {
+          // A deferred binding is checked against its type, as it has no value yet.
+          EXPECT_EQ(pprints[i], pprinter.PrettyPrint(type.get()));
+          ctx_.AddBinding(term_stmt->variable(), Binding::Deferred(term_stmt->term().release(), type.release()));
+          continue;
+        }
         try {
           term = evaluator.Evaluate(term_stmt->term().get());
         } catch (const runtime_exception& e) {
@@ -60,15 +71,30 @@ class EvaluatorTest : public ::testing::Test {
           continue;
         }
         EXPECT_EQ(pprints[i], pprinter.PrettyPrint(term.get()));
+        if (arena_) {
+          term = TermExtractor().Extract(term.get());
+        }
         ctx_.AddBinding(term_stmt->variable(), new Binding(term.release(), type.release()));
       } else {
         // Leave BindTypeStmt unhandled.
         FAIL() << "unknown stmt.";
       }
     }
+    ReleaseArena(&arena);
+  }
+
+  void ReleaseArena(unique_ptr<Arena>* arena) {
+    if (*arena != nullptr) {
+      arena_reused_ += (*arena)->stats().reused;
+      arena->reset();
+    }
   }
 
   Context ctx_;
+  bool lazy_ = false;
+  bool arena_ = false;
+  // Allocations taken from the free lists of the arenas so far.
+  size_t arena_reused_ = 0;
 };
 
 TEST_F(EvaluatorTest, EmptyList) {
@@ -101,13 +127,107 @@ TEST_F(EvaluatorTest, Field) {
   TestEvaluator(R"(
 (if false then {x: 12} else {x: 23}).x;
 (lambda b:Bool. (let bb = b in if (bb as Bool) then {x: 12} else {x: 23}).x) true;
+{y: true, x: 1, z: unit};
+(lambda r:{z:Unit, x:Nat, y:Bool}. r.y) {x: 2, y: false, z: unit};
+(if true then {b: 1, a: 2} else {a: 3, b: 4}).a;
 )", R"(
 23
 12
+{x:1,y:true,z:unit}
+false
+2
 )");
 
 }
 
+TEST_F(EvaluatorTest, RecordUpdate) {
+  TestEvaluator(R"(
+let r = {a: range 0 3, b: 1, c: true};
+{r with b = 2};
+{r with c = false, a = nil[Nat]}.c;
+{{x: 1, y: 2} with y = 3, x = 4};
+letrec count:Nat->{i:Nat, s:Nat}->{i:Nat, s:Nat} =
+  lambda n:Nat st:{i:Nat, s:Nat}. if iszero n then st else count (pred n) {st with i = succ st.i, s = plus st.s st.i}
+and plus:Nat->Nat->Nat = lambda a:Nat b:Nat. match a with 0 -> b | succ m -> succ (plus m b)
+in count 10 {i: 0, s: 0};
+let r' = {r with b = 5};
+r;
+)", R"(
+{a:cons 0 (cons (1) (cons (2) nil[Nat])),b:1,c:true}
+{a:cons 0 (cons (1) (cons (2) nil[Nat])),b:2,c:true}
+false
+{x:4,y:3}
+{i:10,s:45}
+{a:cons 0 (cons (1) (cons (2) nil[Nat])),b:5,c:true}
+{a:cons 0 (cons (1) (cons (2) nil[Nat])),b:1,c:true}
+)");
+
+  // The unchanged field of <r'> is shared with <r> rather than copied.
+  auto record = [this](int index) {
+    const SharedTerm* shared_term = dynamic_cast<const SharedTerm*>(ctx_.get(index).second->term());
+    EXPECT_NE(shared_term, nullptr);
+    return dynamic_cast<const RecordTerm*>(shared_term->value().get());
+  };
+  const Term* a = record(1)->get(0).second.get();
+  const SharedTerm* shared_a = dynamic_cast<const SharedTerm*>(record(0)->get(0).second.get());
+  ASSERT_NE(shared_a, nullptr);
+  EXPECT_EQ(shared_a->value().get(), a);
+}
+
+TEST_F(EvaluatorTest, Ref) {
+  TestEvaluator(R"(
+let counter = ref 0;
+letrec loop:Nat->Unit = lambda n:Nat. if iszero n then unit else (counter := succ (!counter); loop (pred n)) in loop 100;
+!counter;
+let alias = counter;
+(alias := 7; !counter);
+let r = ref {x: 1, y: true};
+(r := {!r with x = 2}; (!r).x);
+let k = 5;
+let f = ref (lambda x:Nat. k);
+let z = 0;
+!f z;
+let g = ref (lambda n:Nat. n);
+(g := lambda n:Nat. if iszero n then 0 else !g (pred n); !g 3);
+f;
+g;
+let h = ref (lambda n:Nat. n) in (h := lambda n:Nat. if iszero n then 0 else !h (pred n); h);
+length (let r = ref (foldl (lambda acc:List[{x:Nat}] n:Nat. cons {x: n} acc) nil[{x:Nat}] (range 0 1000000)) in !r);
+)", R"(
+ref 0
+unit
+100
+ref (100)
+7
+ref {x:1,y:true}
+2
+5
+ref (lambda x:Nat. k)
+0
+5
+ref (lambda n:Nat. n)
+0
+ref (lambda x:Nat. k)
+ref (lambda n:Nat. if iszero n then 0 else !g (pred n))
+ref (lambda n:Nat. if iszero n then 0 else !(ref ...) (pred n))
+1000000
+)");
+}
+
+TEST_F(EvaluatorTest, Ascription) {
+  TestEvaluator(R"(
+let f = lambda x:Nat. (cons (x as Nat) nil[Nat]) as List[Nat];
+f;
+(f 1) as List[Nat];
+(lambda g:Nat->Bool. g 0) (lambda n:Nat. iszero (n as Nat));
+)", R"(
+lambda x:Nat. cons x nil[Nat]
+lambda x:Nat. cons x nil[Nat]
+cons (1) nil[Nat]
+true
+)");
+}
+
 TEST_F(EvaluatorTest, ListSum) {
   TestEvaluator(R"(
 letrec gen:Nat->List[Nat] =
@@ -144,3 +264,544 @@ lambda a:Nat. lambda b:Nat. if iszero a then b else fix (lambda plus:Nat->Nat->N
 276
 )");
 }
+
+TEST_F(EvaluatorTest, CellReuse) {
+  CellPool::ResetStats();
+  TestEvaluator(R"(
+letrec inc:List[Nat]->List[Nat] =
+  lambda l:List[Nat].
+    if isnil l
+      then nil[Nat]
+      else cons (succ (head l)) (inc (tail l));
+
+inc (inc (inc (cons 1 (cons 2 (cons 3 nil[Nat])))));
+{x: 1, y: 2}.y;
+)", R"(
+lambda l:List[Nat]. if isnil l then nil[Nat] else cons (succ (head l)) (fix (lambda inc:List[Nat]->List[Nat]. lambda l_1:List[Nat]. if isnil l_1 then nil[Nat] else cons (succ (head l_1)) (inc (tail l_1))) (tail l))
+cons (4) (cons (5) (cons (6) nil[Nat]))
+2
+)");
+  // Cells of the intermediate lists are uniquely owned, and are reused in place by the next list.
+  EXPECT_GE(CellPool::stats().reused, 6);
+}
+
+TEST_F(EvaluatorTest, CellReuseArena) {
+  arena_ = true;
+  TestEvaluator(R"(
+letrec inc:List[Nat]->List[Nat] =
+  lambda l:List[Nat].
+    if isnil l
+      then nil[Nat]
+      else cons (succ (head l)) (inc (tail l));
+
+inc (inc (inc (cons 1 (cons 2 (cons 3 nil[Nat])))));
+{x: 1, y: 2}.y;
+)", R"(
+lambda l:List[Nat]. if isnil l then nil[Nat] else cons (succ (head l)) (fix (lambda inc:List[Nat]->List[Nat]. lambda l_1:List[Nat]. if isnil l_1 then nil[Nat] else cons (succ (head l_1)) (inc (tail l_1))) (tail l))
+cons (4) (cons (5) (cons (6) nil[Nat]))
+2
+)");
+  // Within an arena, the cells of the intermediate lists are reused through the free lists of the arena.
+  EXPECT_GE(arena_reused_, 6);
+}
+
+TEST_F(EvaluatorTest, SharedList) {
+  TestEvaluator(R"(
+let l = cons 1 (cons 2 nil[Nat]);
+let t = tail l;
+let l' = cons 0 t;
+head l;
+)", R"(
+cons (1) (cons (2) nil[Nat])
+cons (2) nil[Nat]
+cons 0 (cons (2) nil[Nat])
+1
+)");
+
+  // Both <t> and the tail of <l'> refer to the cell that follows the head of <l>.
+  auto value = [this](int index) {
+    const SharedTerm* shared_term = dynamic_cast<const SharedTerm*>(ctx_.get(index).second->term());
+    EXPECT_NE(shared_term, nullptr);
+    return shared_term->value().get();
+  };
+  const Term* l_tail = dynamic_cast<const BinaryTerm*>(value(2))->term2().get();
+  const Term* t = value(1);
+  const SharedTerm* l1_tail = dynamic_cast<const SharedTerm*>(dynamic_cast<const BinaryTerm*>(value(0))->term2().get());
+  EXPECT_EQ(l_tail, t);
+  ASSERT_NE(l1_tail, nullptr);
+  EXPECT_EQ(l1_tail->value().get(), t);
+}
+
+TEST_F(EvaluatorTest, PackedList) {
+  TestEvaluator(R"(
+letrec gen:Nat->List[Nat] =
+  lambda x:Nat.
+    if iszero x
+      then nil[Nat]
+      else cons x (gen (pred x));
+
+let l = gen 10;
+sum l;
+maximum l;
+length l;
+sum (cons 5 (tail l));
+head (tail (tail l));
+less l (cons 3 (cons 12 nil[Nat]));
+length (less (tail l) l);
+head (less (tail l) l);
+maximum nil[Nat];
+length nil[{x:Nat}];
+)", R"(
+lambda x:Nat. if iszero x then nil[Nat] else cons x (fix (lambda gen:Nat->List[Nat]. lambda x_1:Nat. if iszero x_1 then nil[Nat] else cons x_1 (gen (pred x_1))) (pred x))
+cons (10) (cons (9) (cons (8) (cons (7) (cons (6) (cons (5) (cons (4) (cons (3) (cons (2) (cons (1) nil[Nat])))))))))
+55
+10
+10
+50
+8
+cons false (cons true nil[Bool])
+9
+true
+runtime error: <maximum> on an empty list
+0
+)");
+
+  // A top-level list of Nats is stored packed.
+  const SharedTerm* shared_term = dynamic_cast<const SharedTerm*>(ctx_.get(0).second->term());
+  ASSERT_NE(shared_term, nullptr);
+  const PackedListTerm* packed_term = dynamic_cast<const PackedListTerm*>(shared_term->value().get());
+  ASSERT_NE(packed_term, nullptr);
+  EXPECT_EQ(packed_term->size(), 10);
+}
+
+TEST_F(EvaluatorTest, SharedPackedList) {
+  TestEvaluator(R"(
+let l = range 0 10;
+let t = tail l;
+let l' = cons 0 t;
+sum l';
+)", R"(
+cons 0 (cons (1) (cons (2) (cons (3) (cons (4) (cons (5) (cons (6) (cons (7) (cons (8) (cons (9) nil[Nat])))))))))
+cons (1) (cons (2) (cons (3) (cons (4) (cons (5) (cons (6) (cons (7) (cons (8) (cons (9) nil[Nat]))))))))
+cons 0 (cons (1) (cons (2) (cons (3) (cons (4) (cons (5) (cons (6) (cons (7) (cons (8) (cons (9) nil[Nat])))))))))
+45
+)");
+
+  // <t> is a view of the cells of <l>, and the tail of <l'> refers to it rather than to a copy.
+  auto value = [this](int index) {
+    const SharedTerm* shared_term = dynamic_cast<const SharedTerm*>(ctx_.get(index).second->term());
+    EXPECT_NE(shared_term, nullptr);
+    return shared_term->value().get();
+  };
+  const PackedListTerm* l = dynamic_cast<const PackedListTerm*>(value(2));
+  const PackedListTerm* t = dynamic_cast<const PackedListTerm*>(value(1));
+  const BinaryTerm* l1 = dynamic_cast<const BinaryTerm*>(value(0));
+  ASSERT_NE(l, nullptr);
+  ASSERT_NE(t, nullptr);
+  ASSERT_NE(l1, nullptr);
+  EXPECT_EQ(t->cells(), l->cells());
+  EXPECT_EQ(t->begin(), 1);
+  const SharedTerm* l1_tail = dynamic_cast<const SharedTerm*>(l1->term2().get());
+  ASSERT_NE(l1_tail, nullptr);
+  EXPECT_EQ(l1_tail->value().get(), t);
+}
+
+TEST_F(EvaluatorTest, ShadowedBuiltins) {
+  TestEvaluator(R"(
+let l = cons 1 (cons 2 nil[Nat]);
+sum l;
+let sum = lambda l:List[Nat]. head l;
+sum l;
+(lambda length:Nat. succ length) 2;
+let less = 3;
+maximum (cons less l);
+let range = lambda n:Nat. cons n nil[Nat];
+range 4;
+(lambda map_empty:Nat. map_empty) 5;
+let m = map_insert map_empty[Nat, Nat] 1 2;
+let map_size = 6;
+map_size;
+)", R"(
+cons (1) (cons (2) nil[Nat])
+3
+lambda l_1:List[Nat]. head l_1
+1
+3
+3
+3
+lambda n:Nat. cons n nil[Nat]
+cons (4) nil[Nat]
+5
+map_insert map_empty[Nat,Nat] (1) (2)
+6
+6
+)");
+}
+
+TEST_F(EvaluatorTest, ListBuiltins) {
+  TestEvaluator(R"(
+let l = cons {x: 1} (cons {x: 2} (cons {x: 3} nil[{x:Nat}]));
+reverse l;
+length (append l l);
+(nth l 2).x;
+nth l 3;
+append nil[Nat] (range 1 3);
+reverse (range 0 4);
+range 3 3;
+sum (foldl (lambda acc:List[Nat] r:{x:Nat}. cons r.x acc) nil[Nat] l);
+foldl (lambda acc:List[Nat] x:Nat. cons x acc) nil[Nat] (range 0 3);
+sum (range 0 100000);
+length (reverse (append (range 0 100000) (range 0 100000)));
+foldl (lambda acc:Nat x:Nat. succ acc) 0 (range 0 100000);
+range 0 100000000000;
+)", R"(
+cons {x:1} (cons {x:2} (cons {x:3} nil[{x:Nat}]))
+cons {x:3} (cons {x:2} (cons {x:1} nil[{x:Nat}]))
+6
+3
+runtime error: <nth> index out of bounds
+cons (1) (cons (2) nil[Nat])
+cons (3) (cons (2) (cons (1) (cons 0 nil[Nat])))
+nil[Nat]
+6
+cons (2) (cons (1) (cons 0 nil[Nat]))
+4999950000
+200000
+100000
+runtime error: <range> of more than 268435456 elements
+)");
+}
+
+TEST_F(EvaluatorTest, Equal) {
+  TestEvaluator(R"(
+let l = range 0 3;
+let l' = cons 0 (tail l);
+let r = {x: l, y: {z: true}};
+1 == 1;
+0 == 1;
+l == l';
+l == tail l;
+r == {y: {z: true}, x: l'};
+r == {x: l, y: {z: false}};
+cons {x: 1} nil[{x:Nat}] == cons {x: 1} nil[{x:Nat}];
+array_make 2 unit == array_make 2 unit;
+array_make 2 0 == array_set (array_make 2 0) 1 1;
+map_insert map_empty[Nat, List[Nat]] 1 l == map_insert map_empty[Nat, List[Nat]] 1 l';
+map_insert map_empty[Nat, Nat] 1 2 == map_insert map_empty[Nat, Nat] 2 1;
+let big = range 0 100000 in big == reverse (reverse big);
+let big = range 0 100000 in append big (cons 1 nil[Nat]) == append big (cons 2 nil[Nat]);
+)", R"(
+cons 0 (cons (1) (cons (2) nil[Nat]))
+cons 0 (cons (1) (cons (2) nil[Nat]))
+{x:cons 0 (cons (1) (cons (2) nil[Nat])),y:{z:true}}
+true
+false
+true
+false
+true
+false
+true
+true
+false
+true
+false
+true
+false
+)");
+}
+
+TEST_F(EvaluatorTest, Array) {
+  TestEvaluator(R"(
+let a = array_make 3 0;
+let b = array_set a 1 5;
+a;
+array_get b 1;
+array_length b;
+list_of_array b;
+let c = array_of_list (cons {x: 1} (cons {x: 2} nil[{x:Nat}]));
+(array_get c 1).x;
+list_of_array (array_make 0 true);
+array_get a 3;
+
+letrec fill:Array[Nat]->Nat->Array[Nat] =
+  lambda a:Array[Nat] n:Nat.
+    if iszero n
+      then a
+      else fill (array_set a (pred n) n) (pred n);
+fill (array_make 4 0) 4;
+array_make 100000000000 0;
+)", R"(
+[|0,0,0|]
+[|0,5,0|]
+[|0,0,0|]
+5
+3
+cons 0 (cons (5) (cons 0 nil[Nat]))
+[|{x:1},{x:2}|]
+2
+nil[Bool]
+runtime error: <array_get> index out of bounds
+lambda a_1:Array[Nat]. lambda n:Nat. if iszero n then a_1 else fix (lambda fill:Array[Nat]->Nat->Array[Nat]. lambda a_2:Array[Nat]. lambda n_1:Nat. if iszero n_1 then a_2 else fill (array_set a_2 (pred n_1) n_1) (pred n_1)) (array_set a_1 (pred n) n) (pred n)
+[|1,2,3,4|]
+runtime error: <array_make> of more than 268435456 elements
+)");
+}
+
+TEST_F(EvaluatorTest, Map) {
+  TestEvaluator(R"(
+let m = map_insert (map_insert map_empty[Nat, Bool] 1 true) 0 false;
+let m' = map_insert m 1 false;
+map_lookup m 1;
+map_lookup m' 1;
+map_lookup m 2;
+map_size m';
+map_size (map_insert m' 2 true);
+let p = map_insert map_empty[{x:Nat, y:Nat}, Nat] {x: 1, y: 2} 3;
+map_lookup p {y: 2, x: 1};
+map_lookup p {x: 2, y: 1};
+)", R"(
+map_insert (map_insert map_empty[Nat,Bool] 0 false) (1) true
+map_insert (map_insert map_empty[Nat,Bool] 0 false) (1) false
+cons true nil[Bool]
+cons false nil[Bool]
+nil[Bool]
+2
+3
+map_insert map_empty[{x:Nat,y:Nat},Nat] {x:1,y:2} (3)
+cons (3) nil[Nat]
+nil[Nat]
+)");
+}
+
+TEST_F(EvaluatorTest, Variant) {
+  TestEvaluator(R"(
+let some = <some: 3> as <none:Unit, some:Nat>;
+let get = lambda o:<some:Nat, none:Unit>. case o of <some: n> -> n | <none: _> -> 0;
+get some;
+get (<none: unit> as <none:Unit, some:Nat>);
+case <b: true> as <a:Nat, b:Bool, c:Unit> of <c: u> -> 0 | <a: n> -> succ n | <b: b> -> if b then 1 else 2;
+some == <some: 3> as <none:Unit, some:Nat>;
+some == <none: unit> as <none:Unit, some:Nat>;
+)", R"(
+<some:3> as <none:Unit,some:Nat>
+lambda o:<none:Unit,some:Nat>. case o of <none:_> -> 0 | <some:n> -> n
+3
+0
+1
+true
+false
+)");
+}
+
+TEST_F(EvaluatorTest, Match) {
+  TestEvaluator(R"(
+letrec len:List[Nat]->Nat = lambda l:List[Nat]. match l with nil -> 0 | cons h t -> succ (len t);
+letrec plus:Nat->Nat->Nat = lambda a:Nat b:Nat. match a with succ n -> succ (plus n b) | 0 -> b;
+let l = cons 3 (cons 4 nil[Nat]);
+len l;
+len (range 0 100);
+plus 2 3;
+match l with cons h t -> cons (plus h 10) t | nil -> nil[Nat];
+match range 5 7 with nil -> 0 | cons h t -> plus h (head t);
+match nil[Bool] with cons h _ -> h | nil -> false;
+l;
+)", R"(
+lambda l:List[Nat]. match l with nil -> 0 | cons h t -> succ (fix (lambda len:List[Nat]->Nat. lambda l_1:List[Nat]. match l_1 with nil -> 0 | cons h_1 t_1 -> succ (len t_1)) t)
+lambda a:Nat. lambda b:Nat. match a with 0 -> b | succ n -> succ (fix (lambda plus:Nat->Nat->Nat. lambda a_1:Nat. lambda b_1:Nat. match a_1 with 0 -> b_1 | succ n_1 -> succ (plus n_1 b_1)) n b)
+cons (3) (cons (4) nil[Nat])
+2
+100
+5
+cons (13) (cons (4) nil[Nat])
+11
+false
+cons (3) (cons (4) nil[Nat])
+)");
+}
+
+TEST_F(EvaluatorTest, LetRecAnd) {
+  TestEvaluator(R"(
+letrec even:Nat->Bool = lambda n:Nat. match n with 0 -> true | succ m -> odd m
+and odd:Nat->Bool = lambda n:Nat. match n with 0 -> false | succ m -> even m;
+even 10;
+odd 10;
+odd 7;
+letrec f:Nat->Nat = lambda n:Nat. if iszero n then 0 else g (pred n) and g:Nat->Nat = lambda n:Nat. succ (f n) in f 5;
+let k = 3 in letrec a:Nat->Nat = lambda n:Nat. plus k n and plus:Nat->Nat->Nat = lambda x:Nat y:Nat. match x with 0 -> y | succ x1 -> succ (plus x1 y) in a 4;
+let k = 10;
+letrec up:Nat->Nat = lambda n:Nat. if iszero n then k else down (pred n) and down:Nat->Nat = lambda n:Nat. succ (up n);
+down 2;
+letrec p:Nat->Nat = lambda n:Nat. k n and k:Nat->Nat = lambda n:Nat. succ n in p 1;
+)", R"(
+lambda n:Nat. match n with 0 -> true | succ m -> (letrec even:Nat->Bool = lambda n_1:Nat. match n_1 with 0 -> true | succ m_1 -> odd m_1 and odd:Nat->Bool = lambda n_1:Nat. match n_1 with 0 -> false | succ m_1 -> even m_1 in odd) m
+lambda n:Nat. match n with 0 -> false | succ m -> even m
+true
+false
+true
+5
+7
+10
+lambda n:Nat. if iszero n then k else (letrec up:Nat->Nat = lambda n_1:Nat. if iszero n_1 then k else down (pred n_1) and down:Nat->Nat = lambda n_1:Nat. succ (up n_1) in down) (pred n)
+lambda n:Nat. succ (up n)
+13
+2
+)");
+}
+
+TEST_F(EvaluatorTest, LazyTopLevel) {
+  lazy_ = true;
+  TestEvaluator(R"(
+let a = succ 1;
+let b = head nil[Nat];
+letrec len:List[Nat]->Nat = lambda l:List[Nat]. match l with nil -> 0 | cons h t -> succ (len t);
+let c = cons a (range 0 a);
+len c;
+c;
+)", R"(
+Nat
+Nat
+List[Nat]->Nat
+List[Nat]
+3
+cons (2) (cons 0 (cons (1) nil[Nat]))
+)");
+
+  // <b> is never looked up, so it is never evaluated, while <a> is forced through <c> and cached.
+  EXPECT_TRUE(ctx_.get(0).second->forced());
+  EXPECT_TRUE(ctx_.get(1).second->forced());
+  EXPECT_FALSE(ctx_.get(2).second->forced());
+  EXPECT_EQ(ctx_.get(2).second->term(), nullptr);
+  EXPECT_TRUE(ctx_.get(3).second->forced());
+  const SharedTerm* shared_term = dynamic_cast<const SharedTerm*>(ctx_.get(3).second->term());
+  ASSERT_NE(shared_term, nullptr);
+  const NatTerm* nat_term = dynamic_cast<const NatTerm*>(shared_term->value().get());
+  ASSERT_NE(nat_term, nullptr);
+  EXPECT_EQ(nat_term->value(), 2);
+
+  TestEvaluator(R"(
+b;
+)", R"(
+runtime error: <head> on an empty list
+)");
+  EXPECT_FALSE(ctx_.get(2).second->forced());
+}
+
+TEST_F(EvaluatorTest, Arena) {
+  arena_ = true;
+  TestEvaluator(R"(
+letrec gen:Nat->List[Nat] = lambda x:Nat. if iszero x then nil[Nat] else cons x (gen (pred x));
+let l = gen 3;
+let r = {x: l, y: 1};
+let r' = {r with y = 2};
+r.x == r'.x;
+let m = map_insert map_empty[Nat, List[Nat]] 1 (tail l);
+let c = ref l;
+(c := cons 0 (!c); map_insert m 2 (!c));
+!c;
+let f = lambda n:Nat. cons n l;
+f 4;
+)", R"(
+lambda x:Nat. if iszero x then nil[Nat] else cons x (fix (lambda gen:Nat->List[Nat]. lambda x_1:Nat. if iszero x_1 then nil[Nat] else cons x_1 (gen (pred x_1))) (pred x))
+cons (3) (cons (2) (cons (1) nil[Nat]))
+{x:cons (3) (cons (2) (cons (1) nil[Nat])),y:1}
+{x:cons (3) (cons (2) (cons (1) nil[Nat])),y:2}
+true
+map_insert map_empty[Nat,List[Nat]] (1) (cons (2) (cons (1) nil[Nat]))
+ref (cons (3) (cons (2) (cons (1) nil[Nat])))
+map_insert (map_insert map_empty[Nat,List[Nat]] (1) (cons (2) (cons (1) nil[Nat]))) (2) (cons 0 (cons (3) (cons (2) (cons (1) nil[Nat]))))
+cons 0 (cons (3) (cons (2) (cons (1) nil[Nat])))
+lambda n:Nat. cons n l
+cons (4) (cons (3) (cons (2) (cons (1) nil[Nat])))
+)");
+}
+
+// Terms nested a million levels deep, which overflow the stack if they are walked recursively.
+const int kDeepTermDepth = 1000000;
+const Location kNowhere(size_t{0}, size_t{0});
+
+// succ (succ ... x).
+unique_ptr<Term> DeepSuccTerm() {
+  Term* term = new VariableTerm(kNowhere, 0);
+  for (int i = 0; i < kDeepTermDepth; ++i) {
+    term = new UnaryTerm(kNowhere, UnaryTermToken::Succ, term);
+  }
+  return unique_ptr<Term>(term);
+}
+
+// cons x (cons x ... nil[Nat]), which is not packed as its elements are not values.
+unique_ptr<Term> DeepListTerm() {
+  Term* term = new NilTerm(kNowhere, new NatTermType(kNowhere));
+  for (int i = 0; i < kDeepTermDepth; ++i) {
+    term = new BinaryTerm(kNowhere, BinaryTermToken::Cons, new VariableTerm(kNowhere, 0), term);
+  }
+  return unique_ptr<Term>(term);
+}
+
+// The variable at the end of a deep 'succ' chain.
+const VariableTerm* DeepSuccVariable(const Term* term) {
+  while (isa<UnaryTerm>(term)) {
+    term = cast<UnaryTerm>(term)->term().get();
+  }
+  return dyn_cast<VariableTerm>(term);
+}
+
+TEST(DeepTermTest, Destroy) {
+  DeepSuccTerm().reset();
+  DeepListTerm().reset();
+  {
+    Arena arena;
+    DeepListTerm().reset();
+  }
+}
+
+TEST(DeepTermTest, Clone) {
+  unique_ptr<Term> term = DeepSuccTerm();
+  unique_ptr<Term> clone(term->clone());
+  term.reset();
+  const VariableTerm* const variable = DeepSuccVariable(clone.get());
+  ASSERT_NE(nullptr, variable);
+  EXPECT_EQ(0, variable->index());
+}
+
+TEST(DeepTermTest, Shift) {
+  unique_ptr<Term> term = TermShifter(2).TermShift(DeepSuccTerm().get());
+  const VariableTerm* const variable = DeepSuccVariable(term.get());
+  ASSERT_NE(nullptr, variable);
+  EXPECT_EQ(2, variable->index());
+}
+
+TEST(DeepTermTest, Print) {
+  Context ctx;
+  ctx.AddName("x");
+  PrettyPrinter pprinter(&ctx);
+
+  string pprint;
+  for (int i = 1; i < kDeepTermDepth; ++i) {
+    pprint += "succ (";
+  }
+  pprint += "succ x" + string(kDeepTermDepth - 1, ')');
+  EXPECT_EQ(pprint, pprinter.PrettyPrint(DeepSuccTerm().get()));
+
+  pprint.clear();
+  for (int i = 1; i < kDeepTermDepth; ++i) {
+    pprint += "cons x (";
+  }
+  pprint += "cons x nil[Nat]" + string(kDeepTermDepth - 1, ')');
+  EXPECT_EQ(pprint, pprinter.PrettyPrint(DeepListTerm().get()));
+}
+
+TEST(DeepTermTest, Extract) {
+  unique_ptr<Term> value;
+  {
+    Arena arena;
+    unique_ptr<Term> term = DeepListTerm();
+    value = TermExtractor().Extract(term.get());
+    EXPECT_FALSE(Arena::Owns(value.get()));
+  }
+  const BinaryTerm* cons_term = dyn_cast<BinaryTerm>(value.get());
+  int size = 0;
+  for (; cons_term != nullptr; cons_term = dyn_cast<BinaryTerm>(cons_term->term2().get())) {
+    ++size;
+  }
+  EXPECT_EQ(kDeepTermDepth, size);
+}
@@ -0,0 +1,87 @@
+#include "hamt.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "ast.h"
+#include "value-hash.h"
+
+using std::unique_ptr;
+
+namespace {
+
+const Location location(size_t(0), size_t(0));
+
+unique_ptr<Term> nat(uint64_t n) {
+  return std::make_unique<NatTerm>(location, n);
+}
+
+uint64_t nat_of(const Term* term) {
+  return dynamic_cast<const NatTerm*>(term)->value();
+}
+
+unique_ptr<Term> point(uint64_t x, uint64_t y, bool swapped) {
+  auto record = std::make_unique<RecordTerm>(location);
+  if (swapped) {
+    record->add("y", nat(y).release());
+    record->add("x", nat(x).release());
+  } else {
+    record->add("x", nat(x).release());
+    record->add("y", nat(y).release());
+  }
+  return std::move(record);
+}
+
+}  // namespace
+
+TEST(HamtTest, InsertAndFind) {
+  const int n = 10000;
+  Hamt hamt;
+
+  for (int i = 0; i < n; ++i) {
+    hamt = hamt.Insert(nat(i), nat(i * 2));
+  }
+  EXPECT_EQ(hamt.size(), n);
+  for (int i = 0; i < n; ++i) {
+    const Term* value = hamt.Find(nat(i).get());
+    ASSERT_NE(value, nullptr);
+    EXPECT_EQ(nat_of(value), i * 2);
+  }
+  EXPECT_EQ(hamt.Find(nat(n).get()), nullptr);
+
+  size_t count = 0;
+  hamt.ForEach([&count](const Term* key, const Term* value) {
+    EXPECT_EQ(nat_of(key) * 2, nat_of(value));
+    ++count;
+  });
+  EXPECT_EQ(count, n);
+}
+
+TEST(HamtTest, Persistence) {
+  Hamt empty;
+  Hamt hamt1 = empty.Insert(nat(1), nat(10));
+  Hamt hamt2 = hamt1.Insert(nat(1), nat(20));
+  Hamt hamt3 = hamt2.Insert(nat(2), nat(30));
+
+  EXPECT_EQ(empty.size(), 0);
+  EXPECT_EQ(hamt1.size(), 1);
+  EXPECT_EQ(hamt2.size(), 1);
+  EXPECT_EQ(hamt3.size(), 2);
+  EXPECT_EQ(empty.Find(nat(1).get()), nullptr);
+  EXPECT_EQ(nat_of(hamt1.Find(nat(1).get())), 10);
+  EXPECT_EQ(nat_of(hamt2.Find(nat(1).get())), 20);
+  EXPECT_EQ(hamt2.Find(nat(2).get()), nullptr);
+  EXPECT_EQ(nat_of(hamt3.Find(nat(2).get())), 30);
+}
+
+TEST(HamtTest, RecordKey) {
+  EXPECT_EQ(HashValue(point(1, 2, false).get()), HashValue(point(1, 2, true).get()));
+  EXPECT_TRUE(EqualValues(point(1, 2, false).get(), point(1, 2, true).get()));
+  EXPECT_FALSE(EqualValues(point(1, 2, false).get(), point(2, 1, false).get()));
+
+  Hamt hamt = Hamt().Insert(point(1, 2, false), nat(3));
+  hamt = hamt.Insert(point(2, 1, false), nat(4));
+  EXPECT_EQ(hamt.size(), 2);
+  EXPECT_EQ(nat_of(hamt.Find(point(1, 2, true).get())), 3);
+  EXPECT_EQ(nat_of(hamt.Find(point(2, 1, true).get())), 4);
+}
@@ -0,0 +1,125 @@
+#include "hash-cons.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "evaluator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "type-checker.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+class HashConsTest : public ::testing::Test {
+ protected:
+  void SetUp() override { HashCons::set_enabled(true); }
+  void TearDown() override { HashCons::set_enabled(false); }
+
+  // Binds every statement of <input> like the interpreter does.
+  void Bind(const string& input) {
+    unique_ptr<Lexer> lexer(Lexer::Create(input));
+    Parser parser(lexer.get());
+    TypeChecker type_checker(&ctx_);
+    TermEvaluator evaluator(&ctx_);
+
+    vector<unique_ptr<Stmt>> stmts = parser.ParseAST(&ctx_);
+    for (size_t i = 0; i < stmts.size(); ++i) {
+      BindTypeStmt* type_stmt = dynamic_cast<BindTypeStmt*>(stmts[i].get());
+      if (type_stmt != nullptr) {
+        ctx_.AddBinding(type_stmt->type_alias(), new Binding(nullptr, type_stmt->type()->clone()));
+        continue;
+      }
+      BindTermStmt* term_stmt = dynamic_cast<BindTermStmt*>(stmts[i].get());
+      ASSERT_NE(term_stmt, nullptr);
+      unique_ptr<TermType> type = type_checker.TypeCheck(term_stmt->term().get());
+      unique_ptr<Term> term = HashCons::Value(&ctx_, evaluator.Evaluate(term_stmt->term().get()), type.get());
+      ctx_.AddBinding(term_stmt->variable(), new Binding(term.release(), type.release()));
+    }
+  }
+
+  const Term* Value(const string& name) const {
+    return cast<SharedTerm>(ctx_.get(ctx_.ToIndex(name)).second->term())->value().get();
+  }
+
+  Context ctx_;
+};
+
+TEST_F(HashConsTest, Type) {
+  const Location location(size_t(0), size_t(0));
+  const size_t types = HashCons::stats().types;
+
+  SharedTermType nat = ShareType(new NatTermType(location));
+  SharedTermType list = ShareType(new ListTermType(location, new NatTermType(location)));
+  EXPECT_EQ(ShareType(new NatTermType(location)), nat);
+  EXPECT_EQ(ShareType(new ListTermType(location, new NatTermType(location))), list);
+  EXPECT_NE(ShareType(new ListTermType(location, new BoolTermType(location))), list);
+  EXPECT_EQ(HashCons::stats().types, types + 2);
+
+  // Types are only weakly referenced by the table.
+  nat.reset();
+  EXPECT_EQ(HashCons::stats().types, types + 1);
+
+  HashCons::set_enabled(false);
+  EXPECT_NE(ShareType(new ListTermType(location, new NatTermType(location))), list);
+}
+
+TEST_F(HashConsTest, Value) {
+  const size_t values = HashCons::stats().values;
+  Bind(R"(
+let a = {x: 1, y: cons 2 nil[Nat]};
+let b = {y: cons (succ 1) nil[Nat], x: pred 2};
+let c = {x: 1, y: nil[Nat]};
+let n = nil[Nat];
+let n' = nil[Bool];
+let f = lambda x:Nat. x;
+let g = lambda x:Nat. x;
+let r = ref 1;
+let s = ref 1;
+let m = map_insert map_empty[Nat, Nat] 1 2;
+let u = lambda x:Nat. x;
+)");
+  EXPECT_EQ(Value("a"), Value("b"));
+  EXPECT_NE(Value("a"), Value("c"));
+  // Values of different types are never shared, even if they look alike.
+  EXPECT_NE(Value("n"), Value("n'"));
+  // References are told apart by identity.
+  EXPECT_NE(Value("r"), Value("s"));
+  // Closures are not shared, but the types they carry are.
+  EXPECT_NE(Value("f"), Value("g"));
+  EXPECT_EQ(cast<AbsTerm>(Value("f"))->variable_type(), cast<AbsTerm>(Value("g"))->variable_type());
+
+  EXPECT_GT(HashCons::stats().values, values);
+  ctx_.DropBindings(ctx_.size());
+  EXPECT_EQ(HashCons::stats().values, values);
+}
+
+TEST_F(HashConsTest, AliasedRef) {
+  Bind(R"(
+type R = Nat;
+let mk = lambda x:Nat. lambda y:R. ref y;
+let q = mk 0 1;
+let p = ref 1;
+)");
+  // The value type of a reference made under binders is still the one of its alias.
+  const SharedTermType& value_type = cast<RefTerm>(Value("q"))->value_type();
+  ASSERT_NE(value_type, nullptr);
+  EXPECT_TRUE(value_type->Compare(&ctx_, cast<RefTerm>(Value("p"))->value_type().get()));
+}
+
+TEST_F(HashConsTest, AliasedValue) {
+  Bind(R"(
+type P = {x:Nat};
+let a = {x: 1} as P;
+let b = {x: 1};
+let c = {x: 1} as P;
+)");
+  // Values of an alias are keyed on its definition, neither on the alias nor on its index in the context.
+  EXPECT_EQ(Value("a"), Value("b"));
+  EXPECT_EQ(Value("a"), Value("c"));
+}
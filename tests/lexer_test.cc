@@ -56,11 +56,12 @@ TEST_F(LexerTest, KeywordsTest) {
 }
 
 TEST_F(LexerTest, SymbolsTest) {
-  Test(R"(.,:;=_->(){}[])",
+  Test(R"(.,:;=_->(){}[]===<>|:=!)",
        {create(TokenType::Dot), create(TokenType::Comma), create(TokenType::Colon), create(TokenType::Semi),
         create(TokenType::Eq), create(TokenType::UScore), create(TokenType::Arrow), create(TokenType::LParen),
         create(TokenType::RParen), create(TokenType::LCurly), create(TokenType::RCurly), create(TokenType::LBracket),
-        create(TokenType::RBracket)});
+        create(TokenType::RBracket), create(TokenType::EqEq), create(TokenType::Eq), create(TokenType::LAngle),
+        create(TokenType::RAngle), create(TokenType::Bar), create(TokenType::ColonEq), create(TokenType::Bang)});
 }
 
 TEST_F(LexerTest, VariablesTest) {
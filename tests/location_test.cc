@@ -0,0 +1,114 @@
+#include "location.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "evaluator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "type-checker.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+TEST(LocationTest, Span) {
+  EXPECT_EQ(sizeof(Location), 4);
+
+  const Location empty(size_t(0), size_t(0));
+  EXPECT_EQ(empty.begin(), 0);
+  EXPECT_EQ(empty.end(), 0);
+
+  const Location l(3, 7), r(12, 20);
+  EXPECT_EQ(l.begin(), 3);
+  EXPECT_EQ(l.end(), 7);
+  const Location span(l, r);
+  EXPECT_EQ(span.begin(), 3);
+  EXPECT_EQ(span.end(), 20);
+
+  // A span created again right after itself shares the entry.
+  const size_t spans = Location::stats().spans;
+  const Location again(3, 20);
+  EXPECT_EQ(Location::stats().spans, spans);
+  EXPECT_EQ(again.begin(), 3);
+}
+
+TEST(LocationTest, Table) {
+  const size_t spans = Location::stats().spans;
+  {
+    LocationTable table;
+    const Location l(3, 7);
+    EXPECT_EQ(l.begin(), 3);
+    EXPECT_EQ(l.end(), 7);
+    EXPECT_EQ(table.size(), 1);
+    EXPECT_EQ(Location::stats().spans, spans + 1);
+  }
+  // A table storing nothing gives its spans back.
+  EXPECT_EQ(Location::stats().spans, spans);
+
+  // A value stored in a reference pins the table of the spans it carries, which stay readable after the table is
+  // destroyed.
+  Context ctx;
+  auto evaluate = [&ctx](const string& input) {
+    unique_ptr<Lexer> lexer(Lexer::Create(input));
+    vector<unique_ptr<Stmt>> stmts = Parser(lexer.get()).ParseAST(&ctx);
+    return TermEvaluator(&ctx).Evaluate(cast<EvalStmt>(stmts[0].get())->term().get());
+  };
+  const Location nowhere(size_t{0}, size_t{0});
+  ctx.AddBinding("r", new Binding(evaluate("ref 0;").release(), new RefTermType(nowhere, new NatTermType(nowhere))));
+  const RefCell* const cell = cast<RefTerm>(cast<SharedTerm>(ctx.get(0).second->term())->value().get())->cell().get();
+  const string input = "r := succ 2;";
+  const size_t bound_spans = Location::stats().spans;
+  {
+    LocationTable table;
+    evaluate("succ 2;");
+    EXPECT_FALSE(table.pinned());
+    evaluate(input);
+    EXPECT_TRUE(table.pinned());
+  }
+  EXPECT_GT(Location::stats().spans, bound_spans);
+  {
+    LocationTable table;
+    const Location l(2, 3);
+    EXPECT_EQ(cell->value->location().begin(), input.find("succ"));
+    EXPECT_EQ(l.begin(), 2);
+  }
+}
+
+TEST(LocationTest, Evaluate) {
+  const string input = "let double = lambda n:Nat. letrec f:Nat->Nat = lambda m:Nat. if iszero m then n else "
+                       "succ (f (pred m)) in f n in double 100;";
+  unique_ptr<Lexer> lexer(Lexer::Create(input));
+  Parser parser(lexer.get());
+  Context ctx;
+  vector<unique_ptr<Stmt>> stmts = parser.ParseAST(&ctx);
+  ASSERT_EQ(stmts.size(), 1);
+  EvalStmt* const stmt = dyn_cast<EvalStmt>(stmts[0].get());
+  ASSERT_NE(stmt, nullptr);
+  TypeChecker(&ctx).TypeCheck(stmt->term().get());
+
+  // Values created at runtime carry the spans of the terms they come from.
+  const size_t spans = Location::stats().spans;
+  unique_ptr<Term> value = TermEvaluator(&ctx).Evaluate(stmt->term().get());
+  EXPECT_EQ(Location::stats().spans, spans);
+  EXPECT_LT(value->location().end(), input.length());
+}
+
+TEST(LocationTest, Error) {
+  const string input = "let x = 1 in\nsucc true;\nx;\n";
+  Locator locator("input", input);
+  int line1, column1, line2, column2;
+  locator.Locate(Location(13, 22), &line1, &column1, &line2, &column2);
+  EXPECT_EQ(line1, 1);
+  EXPECT_EQ(column1, 0);
+  EXPECT_EQ(line2, 1);
+  EXPECT_EQ(column2, 9);
+
+  testing::internal::CaptureStderr();
+  locator.Error(2, Location(13, 22), "mismatch");
+  EXPECT_EQ(testing::internal::GetCapturedStderr(), "input 1:0-9\nerror: mismatch\nlet x = 1 in\nsucc true;\nx;\n\n");
+}
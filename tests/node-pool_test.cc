@@ -0,0 +1,53 @@
+#include "node-pool.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "ast.h"
+#include "context.h"
+
+using std::unique_ptr;
+
+namespace {
+
+size_t InUse(size_t size) {
+  for (const NodePool::Stats& stats : NodePool::stats()) {
+    if (stats.size == (size + NodePool::kGranularity - 1) / NodePool::kGranularity * NodePool::kGranularity) {
+      return stats.in_use;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+TEST(NodePoolTest, Reuse) {
+  const Location location(size_t(0), size_t(0));
+  const size_t in_use = InUse(sizeof(NatTerm));
+
+  unique_ptr<Term> term = std::make_unique<NatTerm>(location, 1);
+  const void* const address = term.get();
+  EXPECT_EQ(InUse(sizeof(NatTerm)), in_use + 1);
+  term.reset();
+  EXPECT_EQ(InUse(sizeof(NatTerm)), in_use);
+
+  // The last node released is the first one allocated again.
+  term.reset(new NatTerm(location, 2));
+  EXPECT_EQ(term.get(), address);
+  unique_ptr<Term> clone(term->clone());
+  EXPECT_NE(clone.get(), address);
+  EXPECT_EQ(InUse(sizeof(NatTerm)), in_use + 2);
+}
+
+TEST(NodePoolTest, DropBindings) {
+  const Location location(size_t(0), size_t(0));
+  Context ctx;
+  const size_t in_use = InUse(sizeof(NatTermType));
+
+  for (int i = 0; i < 1000; ++i) {
+    ctx.AddBinding("x", new Binding(new NatTerm(location, i), new NatTermType(location)));
+  }
+  EXPECT_EQ(InUse(sizeof(NatTermType)), in_use + 1000);
+  ctx.DropBindings(1000);
+  EXPECT_EQ(InUse(sizeof(NatTermType)), in_use);
+}
@@ -7,6 +7,7 @@
 
 #include "ast.h"
 #include "context.h"
+#include "error.h"
 #include "lexer.h"
 #include "pprinter.h"
 #include "test-utils.h"
@@ -119,6 +120,30 @@ let equal_list = fix (lambda equal_list:List[Nat]->List[Nat]->Bool. lambda a:Lis
 )");
 }
 
+TEST_F(ParserTest, RecordUpdateTest) {
+  TestParser(R"(
+let r = {x: 1, y: {z: true}};
+{r with x = 2, y = {r.y with z = false}};
+{{x: 1} with x = match 1 with 0 -> 1 | succ n -> n};
+)", R"(
+{x:1,y:{z:true}}
+{r with x = 2, y = {r.y with z = false}}
+{{x:1} with x = match 1 with 0 -> 1 | succ n -> n}
+)");
+}
+
+TEST_F(ParserTest, RefTest) {
+  TestParser(R"(
+let r = lambda x:Ref[Nat]. x;
+lambda x:Ref[Ref[Nat]]. (!x := succ (!(!x)); x := ref 0; !x);
+lambda x:Ref[Nat]. (x := (x := 1; 2); ((!x)));
+)", R"(
+lambda x:Ref[Nat]. x
+lambda x:Ref[Ref[Nat]]. (!x := succ (!(!x)); x := ref 0; !x)
+lambda x:Ref[Nat]. (x := (x := 1; 2); !x)
+)");
+}
+
 TEST_F(ParserTest, AppTermTest) {
   TestParser(R"(
 (succ {x: 1, y: 2}).x;
@@ -130,3 +155,68 @@ succ {x:1,y:2}.x
 head (cons (lambda x:Nat->Nat. x) nil[Nat->Nat]) (lambda x:Nat->Nat. x) (lambda x:Nat->Nat. x)
 )");
 }
+
+TEST_F(ParserTest, VariantTest) {
+  TestParser(R"(
+type Opt = <some: Nat, none: Unit>;
+<some: pred 1> as Opt;
+lambda o:Opt. case o of <some: n> -> (case o of <none: _> -> n | <some: m> -> m) | <none: u> -> 0;
+)", R"(
+<none:Unit,some:Nat>
+<some:pred (1)> as Opt
+lambda o:Opt. case o of <none:u> -> 0 | <some:n> -> case o of <none:_> -> n | <some:m> -> m
+)");
+}
+
+TEST_F(ParserTest, MatchTest) {
+  TestParser(R"(
+let l = nil[Nat];
+match l with cons l l' -> l' | nil -> match l with nil -> l | cons h t -> t;
+lambda n:Nat. match n with 0 -> (match n with succ m -> m | 0 -> n) | succ n -> n;
+)", R"(
+nil[Nat]
+match l with nil -> (match l with nil -> l | cons h t -> t) | cons l_1 l' -> l'
+lambda n:Nat. match n with 0 -> (match n with 0 -> n | succ m -> m) | succ n_1 -> n_1
+)");
+}
+
+TEST_F(ParserTest, LetRecAndTest) {
+  TestParser(R"(
+type T = Nat;
+letrec f:T->T = lambda x:T. g x and g:T->T = lambda x:T. (letrec a:T = b and b:T = a in a);
+f;
+letrec h:T = (f h) and _:T = h in let and1 = h in and1;
+)", R"(
+Nat
+letrec f:T->T = lambda x:T. g x and g:T->T = lambda x:T. letrec a:T = b and b:T = a in a in f
+letrec g:T->T = lambda x:T. letrec a:T = b and b:T = a in a in g
+f
+letrec h:T = f h and _:T = h in let and1 = h in and1
+)");
+}
+
+TEST_F(ParserTest, LetRecForwardTest) {
+  // Later bindings of a group are in scope before them, and shadow the names bound outside of the group.
+  TestParser(R"(
+type T = Nat;
+let k = 0;
+letrec p:T = k and k:T = p in p;
+letrec p:T = (letrec r:T = q and s:T = r in s) and q:T = k in p;
+letrec p:T->T = lambda x:T. q x and q:T->T = lambda x:T. p k;
+)", R"(
+Nat
+0
+letrec p:T = k_1 and k_1:T = p in p
+letrec p:T = letrec r:T = q and s:T = r in s and q:T = k in p
+letrec p:T->T = lambda x:T. q x and q:T->T = lambda x:T. p k in p
+letrec q:T->T = lambda x:T. p k in q
+)");
+
+  for (const char* input : {"letrec p:Nat = q and r:Nat = p;",
+                            "letrec p:Nat = (letrec r:Nat = q and s:Nat = r in s) and t:Nat = p in t;",
+                            "letrec p:Nat->Nat = lambda n:Nat. length n and length:Nat->Nat = lambda n:Nat. n;"}) {
+    unique_ptr<Lexer> lexer(Lexer::Create(input));
+    Parser parser(lexer.get());
+    EXPECT_THROW(parser.ParseAST(nullptr), ast_exception) << input;
+  }
+}
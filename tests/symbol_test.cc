@@ -0,0 +1,23 @@
+#include "symbol.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(SymbolTest, Intern) {
+  const Symbol x("x"), y(std::string("y")), x2(std::string(1, 'x'));
+
+  EXPECT_EQ(x, x2);
+  EXPECT_EQ(x.id(), x2.id());
+  EXPECT_NE(x, y);
+  EXPECT_EQ(x.str(), "x");
+  EXPECT_EQ(y.str(), "y");
+}
+
+TEST(SymbolTest, OrderByName) {
+  // Interned before "a", but still ordered after it.
+  const Symbol b("order_b"), a("order_a");
+
+  EXPECT_TRUE(a < b);
+  EXPECT_FALSE(b < a);
+  EXPECT_FALSE(a < a);
+}
@@ -179,6 +179,124 @@ type error: <head> expects list type
 )");
 }
 
+TEST_F(TypeCheckerTest, BadListBuiltin) {
+  TestTypeChecker(R"(
+sum (cons true nil[Bool]);
+maximum 1;
+length {x: 1};
+less (cons 1 nil[Nat]) nil[Bool];
+sum (cons 1 nil[N]);
+reverse 1;
+append nil[Nat] nil[Bool];
+append nil[Nat] 0;
+nth nil[Nat] true;
+nth 0 0;
+range 0 true;
+foldl (lambda x:Nat. x) 0 nil[Nat];
+foldl (lambda x:Nat y:Bool. x) 0 nil[Nat];
+foldl 0 0 nil[Nat];
+foldl (lambda x:Nat y:Nat. x) 0 0;
+foldl (lambda x:Nat y:Bool. x) 0 nil[Bool];
+)", R"(
+type error: <sum> expects List[Nat] type
+type error: <maximum> expects List[Nat] type
+type error: <length> expects list type
+type error: <less> expects List[Nat] type on both parameters
+Nat
+type error: <reverse> expects list type
+type error: lists of <append> are incompatible
+type error: <append> expects list type on both parameters
+type error: <nth> expects Nat type on 2nd parameter
+type error: <nth> expects list type on 1st parameter
+type error: <range> expects Nat type on both parameters
+type error: function of <foldl> is incompatible with accumulator and list
+type error: function of <foldl> is incompatible with accumulator and list
+type error: <foldl> expects arrow type on 1st parameter
+type error: <foldl> expects list type on 3rd parameter
+Nat
+)");
+}
+
+TEST_F(TypeCheckerTest, BadArray) {
+  TestTypeChecker(R"(
+array_make true 1;
+array_get (cons 1 nil[Nat]) 0;
+array_get (array_make 1 1) true;
+array_set (array_make 1 1) 0 true;
+array_length nil[Nat];
+array_of_list 1;
+list_of_array (cons 1 nil[Nat]);
+array_of_list (cons 1 nil[N]);
+)", R"(
+type error: <array_make> expects Nat type on 1st parameter
+type error: <array_get> expects Array type on 1st parameter
+type error: <array_get> expects Nat type on 2nd parameter
+type error: element and array of <array_set> are incompatible
+type error: <array_length> expects Array type
+type error: <array_of_list> expects list type
+type error: <list_of_array> expects Array type
+Array[N]
+)");
+}
+
+TEST_F(TypeCheckerTest, BadMap) {
+  TestTypeChecker(R"(
+map_empty[Nat->Nat, Nat];
+map_empty[List[Nat], Nat];
+map_size nil[Nat];
+map_lookup 1 2;
+map_lookup map_empty[Nat, Bool] true;
+map_insert map_empty[Nat, Bool] true true;
+map_insert map_empty[Nat, Bool] 1 2;
+map_insert map_empty[F, B] {y: 1, x: 2} false;
+map_lookup map_empty[N, Unit] 1;
+)", R"(
+type error: <map_empty> expects hashable key type
+type error: <map_empty> expects hashable key type
+type error: <map_size> expects Map type
+type error: <map_lookup> expects Map type on 1st parameter
+type error: key and map of <map_lookup> are incompatible
+type error: key and map of <map_insert> are incompatible
+type error: value and map of <map_insert> are incompatible
+Map[F,B]
+List[Unit]
+)");
+}
+
+TEST_F(TypeCheckerTest, BadEqual) {
+  TestTypeChecker(R"(
+1 == true;
+(lambda x:Nat. x) == (lambda x:Nat. x);
+cons (lambda x:Nat. x) nil[T] == nil[T];
+{x: 1, y: nil[Nat]} == {y: nil[N], x: 2};
+iszero 0 == false;
+)", R"(
+type error: operands of <==> have different types
+type error: <==> expects first-order type
+type error: <==> expects first-order type
+Bool
+Bool
+)");
+}
+
+TEST_F(TypeCheckerTest, BadRef) {
+  TestTypeChecker(R"(
+!0;
+0 := 1;
+ref 0 := true;
+(0; 1);
+ref 0 == ref 0;
+(ref (lambda x:N. x) := lambda y:Nat. succ y; ref {x: 1});
+)", R"(
+type error: <!> expects Ref type
+type error: <:=> expects Ref type on left side
+type error: value and reference of <:=> are incompatible
+type error: non-last term of sequence is not unit
+type error: <==> expects first-order type
+Ref[{x:Nat}]
+)");
+}
+
 TEST_F(TypeCheckerTest, BadFix) {
   TestTypeChecker(R"(
 letrec foo:Nat->Nat = 2;
@@ -209,6 +327,20 @@ type error: field projection expects record type
 )");
 }
 
+TEST_F(TypeCheckerTest, BadRecordUpdate) {
+  TestTypeChecker(R"(
+{{x: true, y: 1} with z = 1};
+{true with x = 1};
+{{x: true, y: 1} with y = false};
+{(lambda f:F. f) {x: 1, y: 2} with x = 3};
+)", R"(
+type error: field <z> not found for record update
+type error: record update expects record type
+type error: field <y> is updated with another type
+{x:N,y:N}
+)");
+}
+
 TEST_F(TypeCheckerTest, BadAscribe) {
   TestTypeChecker(R"(
 if true then (1 as Bool) else false;
@@ -266,3 +398,51 @@ N
 T1
 )");
 }
+
+TEST_F(TypeCheckerTest, BadVariant) {
+  TestTypeChecker(R"(
+<x: 1> as Nat;
+<x: 1> as <y:Nat>;
+<x: true> as <x:Nat>;
+case 1 of <x: n> -> n;
+case <x: 1> as <x:N, y:B> of <x: n> -> n;
+case <x: 1> as <x:N, y:B> of <x: n> -> n | <y: b> -> b;
+case <x: 1> as <x:N, y:B> of <y: b> -> 0 | <x: n> -> succ n;
+)", R"(
+type error: variant expects variant type
+type error: tag <x> not found in variant type
+type error: body of variant does not have the type of its tag
+type error: <case> expects variant type
+type error: branches of <case> do not match tags of the variant type
+type error: branches of <case> have different types
+Nat
+)");
+}
+
+TEST_F(TypeCheckerTest, BadMatch) {
+  TestTypeChecker(R"(
+match 1 with nil -> 0 | cons h t -> h;
+match nil[Nat] with 0 -> 0 | succ n -> n;
+match nil[N] with nil -> true | cons h t -> h;
+match cons 1 nil[N] with nil -> nil[N] | cons h t -> t;
+match 2 with 0 -> 0 | succ n -> n;
+)", R"(
+type error: <match> expects list type
+type error: <match> expects Nat type
+type error: arms of <match> have different types
+List[N]
+Nat
+)");
+}
+
+TEST_F(TypeCheckerTest, BadLetRecAnd) {
+  TestTypeChecker(R"(
+letrec f:N->B = lambda n:N. g n and g:N->N = lambda n:N. f n in f;
+letrec f:T = lambda n:N. g n and g:T1 = lambda n:N. f n in {f: f, g: g};
+letrec x:N = 1 and y:B = x in y;
+)", R"(
+type error: binding of <letrec> does not have its declared type
+{f:T,g:T1}
+type error: binding of <letrec> does not have its declared type
+)");
+}